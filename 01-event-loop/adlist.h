@@ -1,16 +1,105 @@
+/* adlist.h - A generic doubly linked list implementation */
+
 #ifndef _ADLIST_H
 #define _ADLIST_H
 
+/*
+ * 指针详解
+ * http://www.runoob.com/w3cnote/c-pointer-detail.html
+ * void指针
+ * http://www.runoob.com/w3cnote/c-void-intro.html
+ * 范性编程
+ * http://www.runoob.com/w3cnote/c-general-function.html
+ */
+
+//
+// listNode 双端链表节点
+//
 typedef struct listNode {
-    struct listNode *prev;
-    struct listNode *next;
-    void *value;
+    struct listNode *prev;  // 前置节点
+    struct listNode *next;  // 后置节点
+    void *value;            // 节点的值
 } listNode;
 
-指针详解
-http://www.runoob.com/w3cnote/c-pointer-detail.html
-void指针
-http://www.runoob.com/w3cnote/c-void-intro.html
-范性编程
-http://www.runoob.com/w3cnote/c-general-function.html
+//
+// listIter 双端链表迭代器
+//
+typedef struct listIter {
+    listNode *next;   // 当前迭代到的节点
+    int direction;    // 迭代的方向
+} listIter;
+
+//
+// list 双端链表结构
+//
+typedef struct list {
+
+    listNode *head;   // 表头节点
+
+    listNode *tail;   // 表尾节点
+
+    void *(*dup)(void *ptr);   // 节点值复制函数
+
+    void (*free)(void *ptr);   // 节点值释放函数
+
+    int (*match)(void *ptr, void *key);   // 节点值对比函数
+
+    unsigned long len;   // 链表所包含的节点数量
+
+} list;
+
+/* Functions implemented as macros */
+// 返回给定链表所包含的节点数量
+#define listLength(l) ((l)->len)
+// 返回给定链表的表头节点
+#define listFirst(l) ((l)->head)
+// 返回给定链表的表尾节点
+#define listLast(l) ((l)->tail)
+// 返回给定节点的前置节点
+#define listPrevNode(n) ((n)->prev)
+// 返回给定节点的后置节点
+#define listNextNode(n) ((n)->next)
+// 返回给定节点的值
+#define listNodeValue(n) ((n)->value)
+
+// 将链表 l 的值复制函数设置为 m
+#define listSetDupMethod(l,m) ((l)->dup = (m))
+// 将链表 l 的值释放函数设置为 m
+#define listSetFreeMethod(l,m) ((l)->free = (m))
+// 将链表的对比函数设置为 m
+#define listSetMatchMethod(l,m) ((l)->match = (m))
+
+// 返回给定链表的值复制函数
+#define listGetDupMethod(l) ((l)->dup)
+// 返回给定链表的值释放函数
+#define listGetFree(l) ((l)->free)
+// 返回给定链表的值对比函数
+#define listGetMatchMethod(l) ((l)->match)
+
+/* Prototypes */
+list *listCreate(void);
+void listRelease(list *list);
+list *listAddNodeHead(list *list, void *value);
+list *listAddNodeTail(list *list, void *value);
+list *listInsertNode(list *list, listNode *old_node, void *value, int after);
+void listDelNode(list *list, listNode *node);
+listIter *listGetIterator(list *list, int direction);
+listNode *listNext(listIter *iter);
+void listReleaseIterator(listIter *iter);
+list *listDup(list *orig);
+listNode *listSearchKey(list *list, void *key);
+listNode *listIndex(list *list, long index);
+void listRewind(list *list, listIter *li);
+void listRewindTail(list *list, listIter *li);
+void listRotate(list *list);
+
+/* Directions for iterators
+ *
+ * 迭代器进行迭代的方向
+ */
+// 从表头向表尾进行迭代
+#define AL_START_HEAD 0
+// 从表尾到表头进行迭代
+#define AL_START_TAIL 1
+
 #endif
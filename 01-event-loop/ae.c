@@ -0,0 +1,1404 @@
+/* A simple event-driven programming library. Originally I wrote this code
+ * for the Jim's event-loop (Jim is a Tcl interpreter) but later translated
+ * it in form of a library for easy reuse.
+ *
+ * 事件处理器的实现
+ */
+
+#include <stdio.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <poll.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <sys/uio.h>
+
+#include "ae.h"
+#include "zmalloc.h"
+#include "config.h"
+
+/* Include the best multiplexing layer supported by this system.
+ * The following should be ordered by performances, descending. */
+#ifdef HAVE_EPOLL
+#include "ae_epoll.c"
+#else
+#error "ae: no multiplexing layer available (epoll required)"
+#endif
+
+static void aeFreeIoOp(aeIoOp *op);
+static int aeFlushIoSync(aeEventLoop *eventLoop, aeIoOp *ops);
+
+/* Asynchronous I/O is batched through io_uring when the kernel supports it,
+ * otherwise the operations are executed synchronously. */
+#ifdef HAVE_IO_URING
+#include "ae_iouring.c"
+#endif
+
+/*
+ * 初始化事件处理器状态
+ */
+aeEventLoop *aeCreateEventLoop(int setsize) {
+    aeEventLoop *eventLoop;
+
+    // 创建事件状态结构
+    if ((eventLoop = zmalloc(sizeof(*eventLoop))) == NULL) goto err;
+
+    // 初始化文件事件段表和已就绪文件事件结构数组
+    // 段本身在第一次有描述符注册时才分配
+    eventLoop->segments = (setsize+AE_SEGMENT_SIZE-1)/AE_SEGMENT_SIZE;
+    eventLoop->events = zcalloc(sizeof(aeFileEvent*)*eventLoop->segments);
+    eventLoop->fired = zmalloc(sizeof(aeFiredEvent)*setsize);
+    if (eventLoop->events == NULL || eventLoop->fired == NULL) goto err;
+    // 设置数组大小
+    eventLoop->setsize = setsize;
+    // 初始化执行最近一次执行时间
+    eventLoop->lastTime = time(NULL);
+
+    // 初始化时间事件堆
+    eventLoop->timeEventHeap = NULL;
+    eventLoop->timeEventCount = 0;
+    eventLoop->timeEventHeapSize = 0;
+    eventLoop->timeEventNextId = 0;
+    eventLoop->timeEventSlots = NULL;
+    eventLoop->timeEventFreeSlots = NULL;
+    eventLoop->timeEventFreeCount = 0;
+    eventLoop->timeEventSlotsSize = 0;
+
+    eventLoop->stop = 0;
+    eventLoop->maxfd = -1;
+    eventLoop->beforesleep = NULL;
+    eventLoop->apidata = NULL;
+    eventLoop->ioHead = eventLoop->ioTail = NULL;
+    eventLoop->iodata = NULL;
+    eventLoop->stallThreshold = 0;
+    eventLoop->stallproc = NULL;
+    eventLoop->pending = NULL;
+    eventLoop->pendingCount = eventLoop->pendingSize = 0;
+    memset(eventLoop->prioBudget,0,sizeof(eventLoop->prioBudget));
+    eventLoop->busyPollBudget = 0;
+    eventLoop->busyPollThreshold = 0;
+    eventLoop->busyPollUntil = 0;
+    eventLoop->stat_spin_time = eventLoop->stat_spins = 0;
+    eventLoop->stat_sleep_time = eventLoop->stat_sleeps = 0;
+    aeResetLatency(eventLoop);
+    if (aeApiCreate(eventLoop) == -1) goto err;
+
+#ifdef HAVE_IO_URING
+    // 尝试创建 io_uring 实例，内核不支持时 iodata 保持为 NULL
+    eventLoop->iodata = aeUringCreate(eventLoop);
+#endif
+
+    // 返回事件循环
+    return eventLoop;
+
+err:
+    if (eventLoop) {
+        zfree(eventLoop->events);
+        zfree(eventLoop->fired);
+        zfree(eventLoop);
+    }
+    return NULL;
+}
+
+/* Return the current set size.
+ *
+ * 返回当前事件槽大小
+ */
+int aeGetSetSize(aeEventLoop *eventLoop) {
+    return eventLoop->setsize;
+}
+
+/*
+ * 返回 fd 的文件事件结构，需要时分配 fd 所在的段
+ *
+ * 内存不足时返回 NULL
+ */
+static aeFileEvent *aeAllocFileEvent(aeEventLoop *eventLoop, int fd) {
+    aeFileEvent **segment = &eventLoop->events[fd>>AE_SEGMENT_SHIFT];
+
+    if (*segment == NULL) {
+        int j;
+
+        *segment = zmalloc(sizeof(aeFileEvent)*AE_SEGMENT_SIZE);
+        if (*segment == NULL) return NULL;
+
+        /* Events with mask == AE_NONE are not set. So let's initialize the
+         * vector with it. */
+        for (j = 0; j < AE_SEGMENT_SIZE; j++) {
+            (*segment)[j].mask = AE_NONE;
+            (*segment)[j].priority = AE_PRIO_NORMAL;
+            (*segment)[j].firedMask = 0;
+        }
+    }
+    return &(*segment)[fd&AE_SEGMENT_MASK];
+}
+
+/*
+ * 返回 fd 的文件事件结构，fd 所在的段还没有分配时返回 NULL
+ */
+static aeFileEvent *aeLookupFileEvent(aeEventLoop *eventLoop, int fd) {
+    aeFileEvent *segment;
+
+    if (fd < 0 || fd >= eventLoop->setsize) return NULL;
+    segment = eventLoop->events[fd>>AE_SEGMENT_SHIFT];
+    return segment ? &segment[fd&AE_SEGMENT_MASK] : NULL;
+}
+
+/* Resize the maximum set size of the event loop.
+ * If the requested set size is smaller than the current set size, but
+ * there is already a file descriptor in use that is >= the requested
+ * set size minus one, AE_ERR is returned and the operation is not
+ * performed at all.
+ *
+ * Otherwise AE_OK is returned and the operation is successful.
+ *
+ * 调整事件槽的大小
+ *
+ * 如果尝试调整的大小 setsize 小于等于已注册的最大描述符，
+ * 那么返回 AE_ERR ，不进行任何动作。
+ *
+ * 否则，执行大小调整操作，并返回 AE_OK 。
+ *
+ * 扩大时只追加空的段指针，已经分配的段和其中的 aeFileEvent 保持原地不动，
+ * 所以可以在文件事件或时间事件的处理器中调用，
+ * 比如在流量突增时在运行期间调大 maxclients 。
+ * 缩小时释放完全位于 setsize 之外的段。
+ */
+int aeResizeSetSize(aeEventLoop *eventLoop, int setsize) {
+    int segments, j;
+    aeFileEvent **events;
+    aeFiredEvent *fired;
+
+    if (setsize == eventLoop->setsize) return AE_OK;
+    if (setsize <= 0 || eventLoop->maxfd >= setsize) return AE_ERR;
+
+    segments = (setsize+AE_SEGMENT_SIZE-1)/AE_SEGMENT_SIZE;
+
+    // 先执行唯一可能失败的一步，失败时事件循环保持原样
+    if (aeApiResize(eventLoop,setsize) == -1) return AE_ERR;
+
+    // 缩小时，释放 setsize 之外的段（其中不会有已注册的描述符）
+    for (j = segments; j < eventLoop->segments; j++) {
+        zfree(eventLoop->events[j]);
+        eventLoop->events[j] = NULL;
+    }
+
+    // 段指针表和已就绪数组本身只保存指针和本轮就绪的事件，重新分配它们是安全的
+    events = zrealloc(eventLoop->events,sizeof(aeFileEvent*)*segments);
+    fired = zrealloc(eventLoop->fired,sizeof(aeFiredEvent)*setsize);
+    for (j = eventLoop->segments; j < segments; j++) events[j] = NULL;
+    eventLoop->events = events;
+    eventLoop->fired = fired;
+    eventLoop->segments = segments;
+
+    eventLoop->setsize = setsize;
+    return AE_OK;
+}
+
+/*
+ * 删除事件处理器
+ */
+void aeDeleteEventLoop(aeEventLoop *eventLoop) {
+    int j;
+    aeIoOp *op;
+
+    // 释放还没有提交的异步 I/O 操作
+    while ((op = eventLoop->ioHead) != NULL) {
+        eventLoop->ioHead = op->next;
+        aeFreeIoOp(op);
+    }
+#ifdef HAVE_IO_URING
+    if (eventLoop->iodata) aeUringFree(eventLoop,eventLoop->iodata);
+#endif
+    aeApiFree(eventLoop);
+
+    // 释放还没有执行的时间事件
+    for (j = 0; j < eventLoop->timeEventCount; j++)
+        zfree(eventLoop->timeEventHeap[j]);
+    zfree(eventLoop->timeEventHeap);
+    zfree(eventLoop->timeEventSlots);
+    zfree(eventLoop->timeEventFreeSlots);
+
+    for (j = 0; j < eventLoop->segments; j++)
+        zfree(eventLoop->events[j]);
+    zfree(eventLoop->events);
+    zfree(eventLoop->fired);
+    zfree(eventLoop->pending);
+    zfree(eventLoop);
+}
+
+/*
+ * 停止事件处理器
+ */
+void aeStop(aeEventLoop *eventLoop) {
+    eventLoop->stop = 1;
+}
+
+/*
+ * 根据 mask 参数的值，监听 fd 文件的状态，
+ * 当 fd 可用时，执行 proc 函数
+ *
+ * mask 中带有 AE_ET 时以边缘触发方式监听，
+ * 同一个 fd 上的读写事件共享同一种触发方式
+ */
+int aeCreateFileEvent(aeEventLoop *eventLoop, int fd, int mask,
+        aeFileProc *proc, void *clientData)
+{
+    if (fd >= eventLoop->setsize) {
+        errno = ERANGE;
+        return AE_ERR;
+    }
+
+    // 取出文件事件结构
+    aeFileEvent *fe = aeAllocFileEvent(eventLoop,fd);
+
+    if (fe == NULL) return AE_ERR;
+
+    // 监听指定 fd 的指定事件
+    if (aeApiAddEvent(eventLoop, fd, mask) == -1)
+        return AE_ERR;
+
+    // 设置文件事件类型，以及事件的处理器
+    fe->mask |= mask;
+    if (mask & AE_READABLE) fe->rfileProc = proc;
+    if (mask & AE_WRITABLE) fe->wfileProc = proc;
+
+    // 私有数据
+    fe->clientData = clientData;
+
+    // 如果有需要，更新事件处理器的最大 fd
+    if (fd > eventLoop->maxfd)
+        eventLoop->maxfd = fd;
+
+    return AE_OK;
+}
+
+/*
+ * 将 fd 从 mask 指定的监听队列中删除
+ */
+void aeDeleteFileEvent(aeEventLoop *eventLoop, int fd, int mask)
+{
+    // 取出文件事件结构
+    aeFileEvent *fe = aeLookupFileEvent(eventLoop,fd);
+
+    // 未设置监听的事件类型，直接返回
+    if (fe == NULL || fe->mask == AE_NONE) return;
+
+    // 取消对给定 fd 的给定事件的监视
+    aeApiDelEvent(eventLoop, fd, mask);
+
+    // 计算新掩码
+    fe->mask = fe->mask & (~mask);
+    // 读写事件都已经删除时，AE_ET 标志也一并清除，
+    // 优先级恢复为默认值，还没处理的就绪事件也不再处理
+    if (!(fe->mask & (AE_READABLE|AE_WRITABLE))) {
+        fe->mask = AE_NONE;
+        fe->priority = AE_PRIO_NORMAL;
+        fe->firedMask = 0;
+    }
+
+    if (fd == eventLoop->maxfd && fe->mask == AE_NONE) {
+        /* Update the max fd */
+        int j;
+
+        for (j = eventLoop->maxfd-1; j >= 0; j--) {
+            // 跳过整个未分配的段
+            if (eventLoop->events[j>>AE_SEGMENT_SHIFT] == NULL) {
+                j &= ~AE_SEGMENT_MASK;
+                continue;
+            }
+            if (aeFileEventAt(eventLoop,j)->mask != AE_NONE) break;
+        }
+        eventLoop->maxfd = j;
+    }
+}
+
+/*
+ * 获取给定 fd 正在监听的事件类型
+ */
+int aeGetFileEvents(aeEventLoop *eventLoop, int fd) {
+    aeFileEvent *fe = aeLookupFileEvent(eventLoop,fd);
+
+    return fe ? fe->mask : 0;
+}
+
+/*
+ * 设置 fd 的优先级，fd 必须已经注册了文件事件
+ *
+ * 优先级在 fd 的读写事件都被删除时恢复为 AE_PRIO_NORMAL
+ */
+int aeSetFileEventPriority(aeEventLoop *eventLoop, int fd, int priority) {
+    aeFileEvent *fe = aeLookupFileEvent(eventLoop,fd);
+
+    if (fe == NULL || fe->mask == AE_NONE) return AE_ERR;
+    if (priority < 0 || priority >= AE_PRIO_CLASSES) return AE_ERR;
+    fe->priority = priority;
+    return AE_OK;
+}
+
+/*
+ * 返回 fd 的优先级
+ */
+int aeGetFileEventPriority(aeEventLoop *eventLoop, int fd) {
+    aeFileEvent *fe = aeLookupFileEvent(eventLoop,fd);
+
+    return fe ? fe->priority : AE_PRIO_NORMAL;
+}
+
+/*
+ * 设置优先级 priority 在一轮中最多处理的事件数量，budget 为 0 时不限制
+ */
+void aeSetPriorityBudget(aeEventLoop *eventLoop, int priority, int budget) {
+    if (priority < 0 || priority >= AE_PRIO_CLASSES) return;
+    eventLoop->prioBudget[priority] = budget > 0 ? budget : 0;
+}
+
+/*
+ * 取出当前时间的秒和毫秒，
+ * 并分别将它们保存到 seconds 和 milliseconds 参数中
+ */
+static void aeGetTime(long *seconds, long *milliseconds)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    *seconds = tv.tv_sec;
+    *milliseconds = tv.tv_usec/1000;
+}
+
+/*
+ * 在当前时间上加上 milliseconds 毫秒，
+ * 并且将加上之后的秒数和毫秒数分别保存在 sec 和 ms 指针中。
+ */
+static void aeAddMillisecondsToNow(long long milliseconds, long *sec, long *ms) {
+    long cur_sec, cur_ms, when_sec, when_ms;
+
+    // 获取当前时间
+    aeGetTime(&cur_sec, &cur_ms);
+
+    // 计算增加 milliseconds 之后的秒数和毫秒数
+    when_sec = cur_sec + milliseconds/1000;
+    when_ms = cur_ms + milliseconds%1000;
+
+    // 进位：
+    // 如果 when_ms 大于等于 1000
+    // 那么将 when_sec 增大一秒
+    if (when_ms >= 1000) {
+        when_sec ++;
+        when_ms -= 1000;
+    }
+
+    // 保存到指针中
+    *sec = when_sec;
+    *ms = when_ms;
+}
+
+/* ------------------------- Time event min-heap ---------------------------- */
+
+/*
+ * 时间事件保存在一个以到达时间为键的二叉最小堆中：
+ *
+ *  - 堆顶总是最近的时间事件，查找是 O(1)
+ *  - 插入、删除和重新设定到达时间都是 O(log N)
+ *
+ * 每个事件都记录着自己在堆数组中的下标 heapIndex ，
+ * 所以已知事件结构时可以直接在原位置进行调整。
+ *
+ * 按 id 删除事件时，通过 timeEventSlots 找到事件结构：
+ * id 的低 AE_TIME_SLOT_BITS 位是事件所在的槽，高位是递增的序号，
+ * 所以 id 仍然按创建顺序递增，槽被重用之后，旧的 id 也不会找到新的事件。
+ */
+
+/*
+ * 如果 a 比 b 先到达，那么返回 1 ，否则返回 0
+ *
+ * 到达时间相同时，先创建的事件排在前面
+ */
+static int aeTimeEventBefore(aeTimeEvent *a, aeTimeEvent *b) {
+    if (a->when_sec != b->when_sec) return a->when_sec < b->when_sec;
+    if (a->when_ms != b->when_ms) return a->when_ms < b->when_ms;
+    return a->id < b->id;
+}
+
+/*
+ * 将 te 放到堆中 idx 位置，并更新 te 的下标
+ */
+static void aeTimeHeapSet(aeEventLoop *eventLoop, int idx, aeTimeEvent *te) {
+    eventLoop->timeEventHeap[idx] = te;
+    te->heapIndex = idx;
+}
+
+/*
+ * 将 idx 位置的事件向堆顶方向移动，直到满足堆性质
+ */
+static void aeTimeHeapSiftUp(aeEventLoop *eventLoop, int idx) {
+    aeTimeEvent **heap = eventLoop->timeEventHeap;
+    aeTimeEvent *te = heap[idx];
+
+    while (idx > 0) {
+        int parent = (idx-1)/2;
+
+        if (!aeTimeEventBefore(te,heap[parent])) break;
+        aeTimeHeapSet(eventLoop,idx,heap[parent]);
+        idx = parent;
+    }
+    aeTimeHeapSet(eventLoop,idx,te);
+}
+
+/*
+ * 将 idx 位置的事件向堆底方向移动，直到满足堆性质
+ */
+static void aeTimeHeapSiftDown(aeEventLoop *eventLoop, int idx) {
+    aeTimeEvent **heap = eventLoop->timeEventHeap;
+    aeTimeEvent *te = heap[idx];
+    int count = eventLoop->timeEventCount;
+
+    while (1) {
+        int child = idx*2+1;
+
+        if (child >= count) break;
+        // 选出较早到达的子节点
+        if (child+1 < count && aeTimeEventBefore(heap[child+1],heap[child]))
+            child++;
+        if (!aeTimeEventBefore(heap[child],te)) break;
+        aeTimeHeapSet(eventLoop,idx,heap[child]);
+        idx = child;
+    }
+    aeTimeHeapSet(eventLoop,idx,te);
+}
+
+/*
+ * 在 idx 位置的事件的到达时间被修改之后，恢复堆性质
+ */
+static void aeTimeHeapFix(aeEventLoop *eventLoop, int idx) {
+    if (idx > 0 && aeTimeEventBefore(eventLoop->timeEventHeap[idx],
+                    eventLoop->timeEventHeap[(idx-1)/2]))
+        aeTimeHeapSiftUp(eventLoop,idx);
+    else
+        aeTimeHeapSiftDown(eventLoop,idx);
+}
+
+/*
+ * 将时间事件加入到堆中
+ *
+ * 堆数组不够用时按两倍扩展
+ */
+static int aeTimeHeapPush(aeEventLoop *eventLoop, aeTimeEvent *te) {
+    if (eventLoop->timeEventCount == eventLoop->timeEventHeapSize) {
+        int size = eventLoop->timeEventHeapSize ?
+                   eventLoop->timeEventHeapSize*2 : 16;
+        aeTimeEvent **heap = zrealloc(eventLoop->timeEventHeap,
+                                      sizeof(aeTimeEvent*)*size);
+
+        if (heap == NULL) return AE_ERR;
+        eventLoop->timeEventHeap = heap;
+        eventLoop->timeEventHeapSize = size;
+    }
+    aeTimeHeapSet(eventLoop,eventLoop->timeEventCount,te);
+    eventLoop->timeEventCount++;
+    aeTimeHeapSiftUp(eventLoop,te->heapIndex);
+    return AE_OK;
+}
+
+/*
+ * 将 idx 位置的事件从堆中移除（不释放事件本身）
+ *
+ * 用堆的最后一个事件填补空位，然后对它进行调整
+ */
+static void aeTimeHeapRemove(aeEventLoop *eventLoop, int idx) {
+    aeTimeEvent *last = eventLoop->timeEventHeap[--eventLoop->timeEventCount];
+
+    if (idx == eventLoop->timeEventCount) return;
+    aeTimeHeapSet(eventLoop,idx,last);
+    aeTimeHeapFix(eventLoop,idx);
+}
+
+/*
+ * 为新的时间事件分配一个槽，返回槽的下标
+ *
+ * 没有空闲的槽时按两倍扩展
+ */
+static int aeTimeSlotAlloc(aeEventLoop *eventLoop) {
+    if (eventLoop->timeEventFreeCount == 0) {
+        int size = eventLoop->timeEventSlotsSize ?
+                   eventLoop->timeEventSlotsSize*2 : 16;
+        int j;
+
+        eventLoop->timeEventSlots = zrealloc(eventLoop->timeEventSlots,
+                                             sizeof(aeTimeEvent*)*size);
+        eventLoop->timeEventFreeSlots = zrealloc(eventLoop->timeEventFreeSlots,
+                                                 sizeof(int)*size);
+        // 从大到小压入，先使用下标小的槽
+        for (j = size-1; j >= eventLoop->timeEventSlotsSize; j--) {
+            eventLoop->timeEventSlots[j] = NULL;
+            eventLoop->timeEventFreeSlots[eventLoop->timeEventFreeCount++] = j;
+        }
+        eventLoop->timeEventSlotsSize = size;
+    }
+    return eventLoop->timeEventFreeSlots[--eventLoop->timeEventFreeCount];
+}
+
+/*
+ * 释放时间事件 te 占用的槽
+ */
+static void aeTimeSlotFree(aeEventLoop *eventLoop, aeTimeEvent *te) {
+    eventLoop->timeEventSlots[te->slot] = NULL;
+    eventLoop->timeEventFreeSlots[eventLoop->timeEventFreeCount++] = te->slot;
+}
+
+/*
+ * 返回给定 id 的时间事件，没有这个事件时返回 NULL
+ */
+static aeTimeEvent *aeLookupTimeEvent(aeEventLoop *eventLoop, long long id) {
+    long long slot = id & AE_TIME_SLOT_MASK;
+    aeTimeEvent *te;
+
+    if (id < 0 || slot >= eventLoop->timeEventSlotsSize) return NULL;
+    te = eventLoop->timeEventSlots[slot];
+    return (te && te->id == id) ? te : NULL;
+}
+
+/*
+ * 将时间事件从堆中移除，执行清理处理器，并释放事件
+ */
+static void aeFreeTimeEvent(aeEventLoop *eventLoop, aeTimeEvent *te) {
+    if (te->heapIndex != -1) aeTimeHeapRemove(eventLoop,te->heapIndex);
+    aeTimeSlotFree(eventLoop,te);
+
+    // 执行清理处理器
+    if (te->finalizerProc)
+        te->finalizerProc(eventLoop, te->clientData);
+
+    // 释放时间事件
+    zfree(te);
+}
+
+/*
+ * 创建时间事件
+ */
+long long aeCreateTimeEvent(aeEventLoop *eventLoop, long long milliseconds,
+        aeTimeProc *proc, void *clientData,
+        aeEventFinalizerProc *finalizerProc)
+{
+    long long id;
+    int slot;
+
+    // 创建时间事件结构
+    aeTimeEvent *te;
+
+    te = zmalloc(sizeof(*te));
+    if (te == NULL) return AE_ERR;
+
+    // 分配槽，设置 ID ：高位是递增的序号，低位是槽的下标
+    slot = aeTimeSlotAlloc(eventLoop);
+    id = (eventLoop->timeEventNextId++ << AE_TIME_SLOT_BITS) | slot;
+    te->id = id;
+    te->slot = slot;
+    te->next = NULL;
+    eventLoop->timeEventSlots[slot] = te;
+
+    // 设定处理事件的时间
+    aeAddMillisecondsToNow(milliseconds,&te->when_sec,&te->when_ms);
+    // 设置事件处理器
+    te->timeProc = proc;
+    te->finalizerProc = finalizerProc;
+    // 设置私有数据
+    te->clientData = clientData;
+    te->running = 0;
+
+    // 将新事件放入堆中
+    if (aeTimeHeapPush(eventLoop,te) == AE_ERR) {
+        aeTimeSlotFree(eventLoop,te);
+        zfree(te);
+        return AE_ERR;
+    }
+
+    return id;
+}
+
+/*
+ * 删除给定 id 的时间事件
+ *
+ * 通过 id 中的槽找到事件，再通过 heapIndex 从堆中删除，复杂度为 O(log N) 。
+ *
+ * 如果要删除的是正在执行处理器的事件，或者被 processTimeEvents 暂时移出了堆的事件，
+ * 那么只做标记，之后再由 processTimeEvents 释放
+ */
+int aeDeleteTimeEvent(aeEventLoop *eventLoop, long long id)
+{
+    aeTimeEvent *te = aeLookupTimeEvent(eventLoop,id);
+
+    if (te == NULL) return AE_ERR; /* NO event with the specified ID found */
+
+    if (te->running || te->heapIndex == -1)
+        te->id = AE_DELETED_EVENT_ID;
+    else
+        aeFreeTimeEvent(eventLoop,te);
+    return AE_OK;
+}
+
+/* Search the first timer to fire.
+ * This operation is useful to know how many time the select can be
+ * put in sleep without to delay any event.
+ * If there are no timers NULL is returned.
+ *
+ * 寻找里目前时间最近的时间事件
+ * 最近的时间事件就是堆顶，查找复杂度为 O(1)
+ */
+static aeTimeEvent *aeSearchNearestTimer(aeEventLoop *eventLoop)
+{
+    return eventLoop->timeEventCount ? eventLoop->timeEventHeap[0] : NULL;
+}
+
+/* ---------------------------- Asynchronous I/O ---------------------------- */
+
+/*
+ * 将操作加入等待提交队列的末尾
+ */
+static void aeQueueIoOp(aeEventLoop *eventLoop, aeIoOp *op) {
+    op->next = NULL;
+    if (eventLoop->ioTail)
+        eventLoop->ioTail->next = op;
+    else
+        eventLoop->ioHead = op;
+    eventLoop->ioTail = op;
+}
+
+/*
+ * 释放异步 I/O 操作
+ */
+static void aeFreeIoOp(aeIoOp *op) {
+    zfree(op->iov);
+    zfree(op);
+}
+
+/*
+ * 提交一个异步读操作：从 fd 中读取最多 len 字节到 buf
+ *
+ * 操作会在本轮 aeProcessEvents 处理完文件事件之后，和其他操作一起被成批提交，
+ * 完成之后调用 proc ，在此之前 buf 必须保持有效。
+ *
+ * fd 必须是非阻塞的。
+ */
+int aeSubmitRead(aeEventLoop *eventLoop, int fd, void *buf, size_t len,
+        aeIoProc *proc, void *clientData)
+{
+    aeIoOp *op = zmalloc(sizeof(*op));
+
+    if (op == NULL) return AE_ERR;
+    op->type = AE_IO_READ;
+    op->fd = fd;
+    op->buf = buf;
+    op->len = len;
+    op->iov = NULL;
+    op->iovcnt = 0;
+    op->proc = proc;
+    op->clientData = clientData;
+    aeQueueIoOp(eventLoop,op);
+    return AE_OK;
+}
+
+/*
+ * 提交一个异步写操作：将 iov 数组中的内容写入 fd
+ *
+ * iov 数组本身会被复制，但它所指向的缓冲区在 proc 被调用之前必须保持有效。
+ *
+ * fd 必须是非阻塞的。
+ */
+int aeSubmitWritev(aeEventLoop *eventLoop, int fd, const struct iovec *iov,
+        int iovcnt, aeIoProc *proc, void *clientData)
+{
+    aeIoOp *op = zmalloc(sizeof(*op));
+
+    if (op == NULL) return AE_ERR;
+    op->iov = zmalloc(sizeof(struct iovec)*iovcnt);
+    if (op->iov == NULL) {
+        zfree(op);
+        return AE_ERR;
+    }
+    memcpy(op->iov,iov,sizeof(struct iovec)*iovcnt);
+    op->type = AE_IO_WRITEV;
+    op->fd = fd;
+    op->buf = NULL;
+    op->len = 0;
+    op->iovcnt = iovcnt;
+    op->proc = proc;
+    op->clientData = clientData;
+    aeQueueIoOp(eventLoop,op);
+    return AE_OK;
+}
+
+/*
+ * 不使用 io_uring 时，逐个同步执行 ops 链表中的操作
+ */
+static int aeFlushIoSync(aeEventLoop *eventLoop, aeIoOp *ops) {
+    int processed = 0;
+
+    while (ops) {
+        aeIoOp *next = ops->next;
+        ssize_t res;
+
+        if (ops->type == AE_IO_READ)
+            res = read(ops->fd,ops->buf,ops->len);
+        else
+            res = writev(ops->fd,ops->iov,ops->iovcnt);
+        if (res == -1) res = -errno;
+
+        ops->proc(eventLoop,ops->fd,ops->clientData,res);
+        aeFreeIoOp(ops);
+        processed++;
+        ops = next;
+    }
+    return processed;
+}
+
+/* 完成处理器可能会提交新的操作，每次 aeFlushIo 最多执行这么多轮 */
+#define AE_IO_MAX_ROUNDS 16
+
+/*
+ * 执行所有等待提交的异步 I/O 操作，并调用它们的完成处理器
+ *
+ * 使用 io_uring 时，一轮中的所有操作只需要一次 io_uring_enter 。
+ *
+ * 返回已完成的操作数量
+ */
+int aeFlushIo(aeEventLoop *eventLoop) {
+    int processed = 0, rounds = AE_IO_MAX_ROUNDS;
+
+    while (eventLoop->ioHead && rounds--) {
+        // 取出整个队列，处理器新提交的操作会进入下一轮
+        aeIoOp *ops = eventLoop->ioHead;
+
+        eventLoop->ioHead = eventLoop->ioTail = NULL;
+#ifdef HAVE_IO_URING
+        if (eventLoop->iodata) {
+            processed += aeUringFlush(eventLoop,eventLoop->iodata,ops);
+            continue;
+        }
+#endif
+        processed += aeFlushIoSync(eventLoop,ops);
+    }
+    return processed;
+}
+
+/*
+ * 返回执行异步 I/O 所使用的方式
+ */
+char *aeGetIoApiName(aeEventLoop *eventLoop) {
+    return eventLoop->iodata ? "io_uring" : "sync";
+}
+
+/* ----------------------------- Latency monitoring ----------------------------
+ *
+ * 每个处理器执行前后各读一次单调时钟，执行时间记录到对应类型的直方图中，
+ * 同时记下本轮循环中耗时最长的处理器。
+ *
+ * 一轮循环从 beforesleep 开始，到时间事件处理完毕为止，
+ * 阻塞在 aeApiPoll 中的时间不计算在内。
+ * 忙碌时间达到 stallThreshold 时，调用 stallproc 并把这一轮记为一次卡顿。
+ */
+
+/*
+ * 返回单调时钟的当前时间，单位为微秒
+ */
+long long aeMonotonicMicroseconds(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return ((long long)ts.tv_sec)*1000000+ts.tv_nsec/1000;
+}
+
+/*
+ * 返回 value 所在的桶
+ */
+static int aeLatencyBucket(uint64_t value) {
+    int magnitude;
+
+    if (value < AE_LATENCY_SUB_BUCKETS) return (int)value;
+
+    // value 的最高位，以及紧跟在最高位之后的 AE_LATENCY_SUB_BITS 位
+    magnitude = 63-__builtin_clzll(value);
+    return (magnitude-AE_LATENCY_SUB_BITS+1)*AE_LATENCY_SUB_BUCKETS +
+           (int)((value >> (magnitude-AE_LATENCY_SUB_BITS)) &
+                 (AE_LATENCY_SUB_BUCKETS-1));
+}
+
+/*
+ * 返回桶 bucket 能容纳的最大值
+ */
+static uint64_t aeLatencyBucketUpperBound(int bucket) {
+    int magnitude, sub;
+
+    if (bucket < AE_LATENCY_SUB_BUCKETS) return bucket;
+
+    magnitude = bucket/AE_LATENCY_SUB_BUCKETS+AE_LATENCY_SUB_BITS-1;
+    sub = bucket%AE_LATENCY_SUB_BUCKETS;
+    return (((uint64_t)(AE_LATENCY_SUB_BUCKETS+sub+1)) <<
+            (magnitude-AE_LATENCY_SUB_BITS))-1;
+}
+
+/*
+ * 将一个样本添加到直方图中
+ */
+static void aeLatencyAddSample(aeLatencyHistogram *h, uint64_t value) {
+    h->counts[aeLatencyBucket(value)]++;
+    h->samples++;
+    h->sum += value;
+    if (value > h->max) h->max = value;
+}
+
+/*
+ * 返回直方图的 percentile 分位数（ 0 < percentile <= 100 ）
+ *
+ * 返回的是分位数所在的桶的上界，所以最多比真实值大 1/AE_LATENCY_SUB_BUCKETS
+ */
+uint64_t aeLatencyPercentile(aeLatencyHistogram *h, double percentile) {
+    uint64_t target, seen = 0;
+    int j;
+
+    if (h->samples == 0) return 0;
+
+    target = (uint64_t)(h->samples*percentile/100);
+    if (target == 0) target = 1;
+    for (j = 0; j < AE_LATENCY_BUCKETS; j++) {
+        seen += h->counts[j];
+        if (seen >= target) {
+            uint64_t upper = aeLatencyBucketUpperBound(j);
+            return upper < h->max ? upper : h->max;
+        }
+    }
+    return h->max;
+}
+
+/*
+ * 清空延迟直方图和卡顿记录
+ */
+void aeResetLatency(aeEventLoop *eventLoop) {
+    memset(eventLoop->latency,0,sizeof(eventLoop->latency));
+    memset(&eventLoop->current,0,sizeof(eventLoop->current));
+    memset(eventLoop->stalls,0,sizeof(eventLoop->stalls));
+    eventLoop->iteration = 0;
+    eventLoop->iterStart = 0;
+    eventLoop->stallCount = 0;
+}
+
+/*
+ * 设置卡顿检测的阈值（微秒）和卡顿处理器
+ *
+ * threshold 为 0 时不检测卡顿，直方图总是会被更新
+ */
+void aeSetStallProc(aeEventLoop *eventLoop, long long threshold, aeStallProc *stallproc) {
+    eventLoop->stallThreshold = threshold;
+    eventLoop->stallproc = stallproc;
+}
+
+/*
+ * 设置自适应忙轮询
+ *
+ * 一轮中就绪的文件事件达到 threshold 个时，接下来的 budget 微秒内
+ * aeProcessEvents 不会阻塞在多路复用库上，而是用零超时反复轮询；
+ * 期间又有一轮达到 threshold 时重新计时，预算用完之后恢复阻塞等待。
+ *
+ * budget 为 0 时关闭忙轮询。
+ */
+void aeSetBusyPoll(aeEventLoop *eventLoop, long long budget, int threshold) {
+    eventLoop->busyPollBudget = budget;
+    eventLoop->busyPollThreshold = threshold > 0 ? threshold : 1;
+    eventLoop->busyPollUntil = 0;
+}
+
+/*
+ * 返回延迟类型的名字
+ */
+char *aeLatencyTypeName(int type) {
+    switch(type) {
+    case AE_LATENCY_LOOP: return "loop";
+    case AE_LATENCY_BEFORESLEEP: return "beforesleep";
+    case AE_LATENCY_READ: return "read";
+    case AE_LATENCY_WRITE: return "write";
+    case AE_LATENCY_TIMER: return "timer";
+    default: return "unknown";
+    }
+}
+
+/*
+ * 记录一次从 start 开始的处理器执行
+ *
+ * 返回当前时间，可以直接作为下一个处理器的开始时间
+ */
+static long long aeLatencyRecord(aeEventLoop *eventLoop, int type,
+        long long start, void *proc, int fd)
+{
+    long long now = aeMonotonicMicroseconds();
+    long long duration = now-start;
+
+    aeLatencyAddSample(&eventLoop->latency[type],duration);
+
+    // 本轮中耗时最长的处理器
+    if (duration > eventLoop->current.slowest || eventLoop->current.proc == NULL) {
+        eventLoop->current.type = type;
+        eventLoop->current.slowest = duration;
+        eventLoop->current.proc = proc;
+        eventLoop->current.fd = fd;
+    }
+    return now;
+}
+
+/*
+ * 开始新一轮循环，如果已经开始了（比如在 aeMain 中）就什么也不做
+ */
+static void aeLatencyBeginIteration(aeEventLoop *eventLoop, long long now) {
+    if (eventLoop->iterStart == 0) eventLoop->iterStart = now;
+}
+
+/*
+ * 结束一轮循环，blocked 为阻塞在多路复用库中的时间
+ */
+static void aeLatencyEndIteration(aeEventLoop *eventLoop, long long blocked) {
+    long long busy = aeMonotonicMicroseconds()-eventLoop->iterStart-blocked;
+
+    aeLatencyAddSample(&eventLoop->latency[AE_LATENCY_LOOP],busy);
+
+    if (eventLoop->stallThreshold && busy >= eventLoop->stallThreshold) {
+        aeStall *stall = &eventLoop->current;
+
+        stall->when = time(NULL);
+        stall->iteration = eventLoop->iteration;
+        stall->duration = busy;
+        stall->tag[0] = '\0';
+        // 这一轮中一个处理器都没有执行
+        if (stall->proc == NULL) {
+            stall->type = AE_LATENCY_LOOP;
+            stall->fd = -1;
+        }
+        if (eventLoop->stallproc) eventLoop->stallproc(eventLoop,stall);
+
+        eventLoop->stalls[eventLoop->stallCount % AE_STALL_LOG_LEN] = *stall;
+        eventLoop->stallCount++;
+    }
+
+    eventLoop->iteration++;
+    eventLoop->iterStart = 0;
+    eventLoop->current.proc = NULL;
+    eventLoop->current.slowest = 0;
+}
+
+/* ------------------------- Prioritized dispatch --------------------------- */
+
+/*
+ * 将已就绪的事件加入 pending ，同一个 fd 只会加入一次，掩码会被合并
+ */
+static void aeQueueFiredEvent(aeEventLoop *eventLoop, int fd, int mask) {
+    aeFileEvent *fe = aeLookupFileEvent(eventLoop,fd);
+
+    if (fe == NULL) return;
+    if (fe->firedMask == 0) {
+        if (eventLoop->pendingCount == eventLoop->pendingSize) {
+            eventLoop->pendingSize = eventLoop->pendingSize ?
+                                     eventLoop->pendingSize*2 : 64;
+            eventLoop->pending = zrealloc(eventLoop->pending,
+                sizeof(int)*eventLoop->pendingSize);
+        }
+        eventLoop->pending[eventLoop->pendingCount++] = fd;
+    }
+    fe->firedMask |= mask;
+}
+
+/*
+ * 按优先级处理 pending 中的就绪事件
+ *
+ * 每个优先级最多处理 prioBudget 个事件，超出预算的 fd 按原来的顺序留在 pending 中，
+ * 下一轮优先于新就绪的同级事件处理。
+ * 已经在处理器中被删除的 fd （firedMask 被清零）会被直接丢弃。
+ *
+ * *now 为当前时间，用于延迟统计，返回时更新为最后一个处理器返回的时间。
+ *
+ * 返回处理的事件数量
+ */
+static int aeProcessPendingEvents(aeEventLoop *eventLoop, long long *now) {
+    int processed = 0, prio, j, k, count = eventLoop->pendingCount;
+
+    for (prio = 0; prio < AE_PRIO_CLASSES; prio++) {
+        int budget = eventLoop->prioBudget[prio], done = 0;
+
+        for (j = 0; j < count; j++) {
+            int fd = eventLoop->pending[j], mask, rfired = 0;
+            aeFileEvent *fe;
+
+            if (fd == -1) continue;
+
+            // 之前的处理器删除了这个 fd ，或者缩小了 setsize
+            fe = aeLookupFileEvent(eventLoop,fd);
+            if (fe == NULL || fe->firedMask == 0) {
+                eventLoop->pending[j] = -1;
+                continue;
+            }
+
+            if (fe->priority != prio) continue;
+            if (budget && done >= budget) continue;
+
+            mask = fe->firedMask;
+            fe->firedMask = 0;
+            eventLoop->pending[j] = -1;
+
+            /* note the fe->mask & mask & ... code: maybe an already processed
+             * event removed an element that fired and we still didn't
+             * processed, so we check if the event is still valid. */
+            // 读事件
+            if (fe->mask & mask & AE_READABLE) {
+                aeFileProc *rproc = fe->rfileProc;
+
+                // rfired 确保读/写事件只能执行其中一个
+                rfired = 1;
+                rproc(eventLoop,fd,fe->clientData,mask);
+                *now = aeLatencyRecord(eventLoop,AE_LATENCY_READ,*now,
+                                       (void*)rproc,fd);
+
+                // 读处理器可能删除了 fd ，或者缩小 setsize 释放了 fe 所在的段
+                fe = aeLookupFileEvent(eventLoop,fd);
+                if (fe == NULL) {
+                    done++;
+                    processed++;
+                    continue;
+                }
+            }
+            // 写事件
+            if (fe->mask & mask & AE_WRITABLE) {
+                if (!rfired || fe->wfileProc != fe->rfileProc) {
+                    aeFileProc *wproc = fe->wfileProc;
+
+                    wproc(eventLoop,fd,fe->clientData,mask);
+                    *now = aeLatencyRecord(eventLoop,AE_LATENCY_WRITE,*now,
+                                           (void*)wproc,fd);
+                }
+            }
+
+            done++;
+            processed++;
+        }
+    }
+
+    // 将留到下一轮的 fd 移到数组开头，处理器在这一轮中新加入的 fd 也一并保留
+    for (j = 0, k = 0; j < eventLoop->pendingCount; j++) {
+        if (eventLoop->pending[j] != -1)
+            eventLoop->pending[k++] = eventLoop->pending[j];
+    }
+    eventLoop->pendingCount = k;
+
+    return processed;
+}
+
+/* Process time events
+ *
+ * 处理所有已到达的时间事件
+ */
+static int processTimeEvents(aeEventLoop *eventLoop) {
+    int processed = 0, budget, j;
+    aeTimeEvent *te, *deferred = NULL;
+    long long maxId;
+    time_t now = time(NULL);
+
+    /* If the system clock is moved to the future, and then set back to the
+     * right value, time events may be delayed in a random way. Often this
+     * means that scheduled operations will not be performed soon enough.
+     *
+     * Here we try to detect system clock skews, and force all the time
+     * events to be processed ASAP when this happens: the idea is that
+     * processing events earlier is less dangerous than delaying them
+     * indefinitely, and practice suggests it is. */
+    // 通过重置事件的运行时间，
+    // 防止因时间穿插（skew）而造成的事件处理混乱
+    if (now < eventLoop->lastTime) {
+        for (j = 0; j < eventLoop->timeEventCount; j++)
+            eventLoop->timeEventHeap[j]->when_sec = 0;
+        // 到达时间被修改了，重新建堆
+        for (j = eventLoop->timeEventCount/2-1; j >= 0; j--)
+            aeTimeHeapSiftDown(eventLoop,j);
+    }
+    // 更新最后一次处理时间事件的时间
+    eventLoop->lastTime = now;
+
+    // 不断取出堆顶，执行那些已经到达的事件
+    //
+    // 处理器自己创建的事件（id 大于 maxId）留到下一轮再执行，
+    // 它们到达堆顶时被暂时移出堆，这样后面其他已经到达的事件仍然会在这一轮执行；
+    // 另外每一轮最多执行的次数不超过开始时的事件数量，
+    // 防止处理器不断地把自己重新设定为立即到达而造成死循环
+    maxId = (eventLoop->timeEventNextId << AE_TIME_SLOT_BITS)-1;
+    budget = eventLoop->timeEventCount;
+    while(budget > 0 && (te = aeSearchNearestTimer(eventLoop)) != NULL) {
+        long now_sec, now_ms;
+        long long id, start;
+        int retval;
+
+        // 获取当前时间
+        aeGetTime(&now_sec, &now_ms);
+
+        // 堆顶事件还没有到达，那么其他事件也都没有到达
+        if (now_sec < te->when_sec ||
+            (now_sec == te->when_sec && now_ms < te->when_ms))
+            break;
+
+        // 处理器在本轮中创建的事件
+        if (te->id > maxId) {
+            aeTimeHeapRemove(eventLoop,0);
+            te->heapIndex = -1;
+            te->next = deferred;
+            deferred = te;
+            continue;
+        }
+
+        budget--;
+        id = te->id;
+        // 执行事件处理器，并获取返回值
+        te->running = 1;
+        start = aeMonotonicMicroseconds();
+        retval = te->timeProc(eventLoop, id, te->clientData);
+        aeLatencyRecord(eventLoop,AE_LATENCY_TIMER,start,(void*)te->timeProc,-1);
+        te->running = 0;
+        processed++;
+
+        // 处理器执行期间，堆可能已经被改变了，
+        // 不过 te->heapIndex 总是指向 te 当前的位置
+        if (retval == AE_NOMORE || te->id == AE_DELETED_EVENT_ID) {
+            // 不再执行，或者已经在处理器中被删除，将这个事件删除
+            aeFreeTimeEvent(eventLoop,te);
+        } else {
+            // retval 毫秒之后继续执行这个时间事件
+            aeAddMillisecondsToNow(retval,&te->when_sec,&te->when_ms);
+            aeTimeHeapFix(eventLoop,te->heapIndex);
+        }
+    }
+
+    // 把暂时移出的事件放回堆中，下一轮再执行
+    while (deferred) {
+        te = deferred;
+        deferred = te->next;
+        if (te->id == AE_DELETED_EVENT_ID)
+            aeFreeTimeEvent(eventLoop,te);
+        else
+            aeTimeHeapPush(eventLoop,te);
+    }
+    return processed;
+}
+
+/* Process every pending time event, then every pending file event
+ * (that may be registered by time event callbacks just processed).
+ *
+ * 处理所有已到达的时间事件，以及所有已就绪的文件事件。
+ *
+ * Without special flags the function sleeps until some file event
+ * fires, or when the next time event occurs (if any).
+ *
+ * 如果不传入特殊 flags 的话，那么函数睡眠直到文件事件就绪，
+ * 或者下个时间事件到达（如果有的话）。
+ *
+ * If flags is 0, the function does nothing and returns.
+ * 如果 flags 为 0 ，那么函数不作动作，直接返回。
+ *
+ * if flags has AE_ALL_EVENTS set, all the kind of events are processed.
+ * 如果 flags 包含 AE_ALL_EVENTS ，所有类型的事件都会被处理。
+ *
+ * if flags has AE_FILE_EVENTS set, file events are processed.
+ * 如果 flags 包含 AE_FILE_EVENTS ，那么处理文件事件。
+ *
+ * if flags has AE_TIME_EVENTS set, time events are processed.
+ * 如果 flags 包含 AE_TIME_EVENTS ，那么处理时间事件。
+ *
+ * if flags has AE_DONT_WAIT set the function returns ASAP until all
+ * the events that's possible to process without to wait are processed.
+ * 如果 flags 包含 AE_DONT_WAIT ，
+ * 那么函数在处理完所有不许阻塞的事件之后，即刻返回。
+ *
+ * The function returns the number of events processed.
+ * 函数的返回值为已处理事件的数量
+ */
+int aeProcessEvents(aeEventLoop *eventLoop, int flags)
+{
+    int processed = 0, numevents;
+    long long now, blocked = 0;
+
+    /* Nothing to do? return ASAP */
+    if (!(flags & AE_TIME_EVENTS) && !(flags & AE_FILE_EVENTS)) return 0;
+
+    aeLatencyBeginIteration(eventLoop,aeMonotonicMicroseconds());
+
+    // 提交上一轮之后（比如 beforesleep 中）提交的异步 I/O 操作
+    if (flags & AE_FILE_EVENTS) processed += aeFlushIo(eventLoop);
+
+    /* Note that we want call select() even if there are no
+     * file events to process as long as we want to process time
+     * events, in order to sleep until the next time event is ready
+     * to fire. */
+    if (eventLoop->maxfd != -1 ||
+        ((flags & AE_TIME_EVENTS) && !(flags & AE_DONT_WAIT))) {
+        int j, spinning;
+        aeTimeEvent *shortest = NULL;
+        struct timeval tv, *tvp;
+
+        // 获取最近的时间事件
+        if (flags & AE_TIME_EVENTS && !(flags & AE_DONT_WAIT))
+            shortest = aeSearchNearestTimer(eventLoop);
+        if (shortest) {
+            // 如果时间事件存在的话
+            // 那么根据最近可执行时间事件和现在时间的时间差来决定文件事件的阻塞时间
+            long now_sec, now_ms;
+            long long ms;
+
+            /* Calculate the time missing for the nearest
+             * timer to fire. */
+            // 计算距今最近的时间事件还要多久才能达到
+            // 并将该时间距保存在 tv 结构中
+            aeGetTime(&now_sec, &now_ms);
+            tvp = &tv;
+            ms = (shortest->when_sec - now_sec)*1000LL +
+                 shortest->when_ms - now_ms;
+
+            if (ms > 0) {
+                tvp->tv_sec = ms/1000;
+                tvp->tv_usec = (ms%1000)*1000;
+            } else {
+                // 时间差小于 0 ，说明事件已经可以执行了，将秒和毫秒设为 0 （不阻塞）
+                // 注意不能分别对秒和毫秒取 0 ，否则已经到达的事件会多等将近一秒
+                tvp->tv_sec = 0;
+                tvp->tv_usec = 0;
+            }
+        } else {
+
+            // 执行到这一步，说明没有时间事件
+            // 那么根据 AE_DONT_WAIT 是否设置来决定是否阻塞，以及阻塞的时间长度
+
+            /* If we have to check for events but need to return
+             * ASAP because of AE_DONT_WAIT we need to set the timeout
+             * to zero */
+            if (flags & AE_DONT_WAIT) {
+                // 设置文件事件不阻塞
+                tv.tv_sec = tv.tv_usec = 0;
+                tvp = &tv;
+            } else {
+                /* Otherwise we can block */
+                // 文件事件可以阻塞直到有事件到达为止
+                tvp = NULL; /* wait forever */
+            }
+        }
+
+        // 还有没执行完的异步 I/O 操作，或者上一轮超出预算的就绪事件，不能阻塞
+        if (eventLoop->ioHead || eventLoop->pendingCount) {
+            tv.tv_sec = tv.tv_usec = 0;
+            tvp = &tv;
+        }
+
+        // 自适应忙轮询：最近一轮就绪的事件很多时，在 busyPollUntil 之前不阻塞，
+        // 用零超时反复轮询，省下睡眠和唤醒的延迟
+        now = aeMonotonicMicroseconds();
+        spinning = 0;
+        if (eventLoop->busyPollBudget && now < eventLoop->busyPollUntil &&
+            (tvp == NULL || tvp->tv_sec || tvp->tv_usec))
+        {
+            tv.tv_sec = tv.tv_usec = 0;
+            tvp = &tv;
+            spinning = 1;
+        }
+
+        // 处理文件事件，阻塞时间由 tvp 决定
+        numevents = aeApiPoll(eventLoop, tvp);
+        blocked = aeMonotonicMicroseconds()-now;
+        now += blocked;
+
+        // 更新忙轮询的统计，就绪的事件足够多时（重新）开始忙轮询
+        if (spinning) {
+            eventLoop->stat_spin_time += blocked;
+            eventLoop->stat_spins++;
+        } else if (tvp == NULL || tvp->tv_sec || tvp->tv_usec) {
+            eventLoop->stat_sleep_time += blocked;
+            eventLoop->stat_sleeps++;
+        }
+        if (eventLoop->busyPollBudget && numevents >= eventLoop->busyPollThreshold)
+            eventLoop->busyPollUntil = now+eventLoop->busyPollBudget;
+
+        // 将就绪的事件加入 pending ，然后按优先级处理
+        for (j = 0; j < numevents; j++)
+            aeQueueFiredEvent(eventLoop,eventLoop->fired[j].fd,
+                              eventLoop->fired[j].mask);
+        processed += aeProcessPendingEvents(eventLoop,&now);
+
+        // 文件事件处理器提交的异步 I/O 操作，一次性提交
+        processed += aeFlushIo(eventLoop);
+    }
+
+    /* Check time events */
+    // 执行时间事件
+    if (flags & AE_TIME_EVENTS)
+        processed += processTimeEvents(eventLoop);
+
+    aeLatencyEndIteration(eventLoop,blocked);
+
+    return processed; /* return the number of processed file/time events */
+}
+
+/* Wait for milliseconds until the given file descriptor becomes
+ * writable/readable/exception
+ *
+ * 在给定毫秒内等待，直到 fd 变成可写、可读或异常
+ */
+int aeWait(int fd, int mask, long long milliseconds) {
+    struct pollfd pfd;
+    int retmask = 0, retval;
+
+    memset(&pfd, 0, sizeof(pfd));
+    pfd.fd = fd;
+    if (mask & AE_READABLE) pfd.events |= POLLIN;
+    if (mask & AE_WRITABLE) pfd.events |= POLLOUT;
+
+    if ((retval = poll(&pfd, 1, milliseconds))== 1) {
+        if (pfd.revents & POLLIN) retmask |= AE_READABLE;
+        if (pfd.revents & POLLOUT) retmask |= AE_WRITABLE;
+        if (pfd.revents & POLLERR) retmask |= AE_WRITABLE;
+        if (pfd.revents & POLLHUP) retmask |= AE_WRITABLE;
+        return retmask;
+    } else {
+        return retval;
+    }
+}
+
+/*
+ * 事件处理器的主循环
+ */
+void aeMain(aeEventLoop *eventLoop) {
+
+    eventLoop->stop = 0;
+
+    while (!eventLoop->stop) {
+
+        // 一轮循环从 beforesleep 开始
+        eventLoop->iterStart = aeMonotonicMicroseconds();
+
+        // 如果有需要在事件处理前执行的函数，那么运行它
+        if (eventLoop->beforesleep != NULL) {
+            eventLoop->beforesleep(eventLoop);
+            aeLatencyRecord(eventLoop,AE_LATENCY_BEFORESLEEP,eventLoop->iterStart,
+                            (void*)eventLoop->beforesleep,-1);
+        }
+
+        // 开始处理事件
+        aeProcessEvents(eventLoop, AE_ALL_EVENTS);
+    }
+}
+
+/*
+ * 返回所使用的多路复用库的名称
+ */
+char *aeGetApiName(void) {
+    return aeApiName();
+}
+
+/*
+ * 设置处理事件前需要被执行的函数
+ */
+void aeSetBeforeSleepProc(aeEventLoop *eventLoop, aeBeforeSleepProc *beforesleep) {
+    eventLoop->beforesleep = beforesleep;
+}
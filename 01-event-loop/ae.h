@@ -2,6 +2,9 @@
 #define _AE_H
 
 #include <time.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/uio.h>
 
 /* 事件执行状态 */
 // 成功
@@ -16,6 +19,10 @@
 #define AE_READABLE 1
 // 可写
 #define AE_WRITABLE 2
+// 边缘触发（ET），和 AE_READABLE / AE_WRITABLE 一起使用
+// 使用 ET 注册的事件只会在状态变化时触发一次，
+// 所以处理器必须一直读（写）到返回 EAGAIN 为止，否则剩下的数据不会再通知
+#define AE_ET 4
 
 /* 时间处理器的执行 flags */
 // 文件事件
@@ -30,27 +37,215 @@
 /* 决定时间事件是否要持续执行的 flag */
 
 #define AE_NOMORE -1
+// 时间事件在自己的处理器中被删除时，先用这个 id 做标记，处理器返回之后再真正释放
+#define AE_DELETED_EVENT_ID -1
+
+// 时间事件 id 的低 AE_TIME_SLOT_BITS 位是事件在 timeEventSlots 中的下标
+#define AE_TIME_SLOT_BITS 32
+#define AE_TIME_SLOT_MASK ((1LL<<AE_TIME_SLOT_BITS)-1)
+
+/* 异步 I/O 操作类型 */
+#define AE_IO_READ 1
+#define AE_IO_WRITEV 2
+
+/* 文件事件的优先级
+ *
+ * 就绪的文件事件按优先级从高到低处理，每个优先级在一轮中最多处理的事件数量
+ * 可以用 aeSetPriorityBudget 限制，超出的事件留到下一轮 */
+// 管理命令、健康检查
+#define AE_PRIO_ADMIN 0
+// 复制
+#define AE_PRIO_REPL 1
+// 一般客户端（默认）
+#define AE_PRIO_NORMAL 2
+// 大批量流水线请求的客户端
+#define AE_PRIO_BULK 3
+#define AE_PRIO_CLASSES 4
+
+/* 延迟统计的处理器类型 */
+// 一轮循环中除去阻塞在多路复用库上之外的全部时间
+#define AE_LATENCY_LOOP 0
+// beforesleep
+#define AE_LATENCY_BEFORESLEEP 1
+// 读事件处理器
+#define AE_LATENCY_READ 2
+// 写事件处理器
+#define AE_LATENCY_WRITE 3
+// 时间事件处理器
+#define AE_LATENCY_TIMER 4
+#define AE_LATENCY_TYPES 5
+
+/* 延迟直方图的桶（单位为微秒）
+ *
+ * 和 HdrHistogram 一样，每个 2 的幂区间被平均分成 AE_LATENCY_SUB_BUCKETS 个桶，
+ * 所以任何取值的相对误差都不超过 1/AE_LATENCY_SUB_BUCKETS ，
+ * 小于 AE_LATENCY_SUB_BUCKETS 的值各占一个桶 */
+#define AE_LATENCY_SUB_BITS 3
+#define AE_LATENCY_SUB_BUCKETS (1<<AE_LATENCY_SUB_BITS)
+#define AE_LATENCY_BUCKETS ((64-AE_LATENCY_SUB_BITS+1)*AE_LATENCY_SUB_BUCKETS)
+
+/* 卡顿记录 */
+// 每个事件循环保留最近的卡顿记录数量
+#define AE_STALL_LOG_LEN 16
+// 卡顿记录中标签的最大长度
+#define AE_STALL_TAG_LEN 64
+
+/* 文件事件表按段分配，每段 AE_SEGMENT_SIZE 个描述符
+ *
+ * 调整 setsize 时只需要增减段指针，已经分配的段不会被移动，
+ * 所以处理器执行期间拿到的 aeFileEvent 指针一直有效 */
+#define AE_SEGMENT_SHIFT 10
+#define AE_SEGMENT_SIZE (1<<AE_SEGMENT_SHIFT)
+#define AE_SEGMENT_MASK (AE_SEGMENT_SIZE-1)
 
 /* Macros */
 #define AE_NOTUSED(V) ((void) V)
 
+// 返回 fd 的文件事件结构，fd 所在的段必须已经分配
+#define aeFileEventAt(el,fd) \
+    (&(el)->events[(fd)>>AE_SEGMENT_SHIFT][(fd)&AE_SEGMENT_MASK])
+
 /* 事件处理状态 */
 struct aeEventLoop;
+struct aeStall;
 
+/* Types and data structures
+ *
+ * 事件接口
+ */
+typedef void aeFileProc(struct aeEventLoop *eventLoop, int fd, void *clientData, int mask);
+typedef int aeTimeProc(struct aeEventLoop *eventLoop, long long id, void *clientData);
+typedef void aeEventFinalizerProc(struct aeEventLoop *eventLoop, void *clientData);
+typedef void aeBeforeSleepProc(struct aeEventLoop *eventLoop);
+// 异步 I/O 完成处理器， res 为读写的字节数，出错时为 -errno
+typedef void aeIoProc(struct aeEventLoop *eventLoop, int fd, void *clientData, ssize_t res);
+// 卡顿处理器，在记录卡顿之前调用，可以往 stall->tag 中写入附加信息（比如命令名）
+typedef void aeStallProc(struct aeEventLoop *eventLoop, struct aeStall *stall);
 
-
+//
+// aeFileEvent 文件事件结构
+//
 typedef struct aeFileEvent {
-    
-    int mask;
+
+    int mask;   // 监听事件类型掩码，值可以是 AE_READABLE 或 AE_WRITABLE ，或者两者的或
+                // 另外可以带上 AE_ET 表示以边缘触发方式注册
 
     aeFileProc *rfileProc;  // 读事件处理器
 
     aeFileProc *wfileProc;  // 写事件处理器
 
     void *clientData;       // 多路复用库的私有数据
-} aeFileEvent; 
 
+    int priority;           // 优先级 AE_PRIO_* ，默认为 AE_PRIO_NORMAL
+
+    int firedMask;          // 已经就绪、但还没有处理的事件类型掩码，
+                            // 不为 0 时 fd 在 eventLoop->pending 中等待处理
+} aeFileEvent;
+
+//
+// aeTimeEvent 时间事件结构
+//
+typedef struct aeTimeEvent {
+
+    long long id;   // 时间事件的唯一标识符
+
+    long when_sec;  // 事件的到达时间 seconds
+    long when_ms;   // milliseconds
+
+    aeTimeProc *timeProc;   // 事件处理函数
+
+    aeEventFinalizerProc *finalizerProc;   // 事件释放函数
+
+    void *clientData;   // 多路复用库的私有数据
+
+    int heapIndex;  // 在时间事件最小堆中的下标，被暂时移出堆时为 -1
+
+    int slot;       // 在 timeEventSlots 中的下标
+
+    int running;    // 处理器是否正在执行
+
+    struct aeTimeEvent *next;  // 被 processTimeEvents 暂时移出堆时，串成链表
+
+} aeTimeEvent;
+
+//
+// aeIoOp 异步 I/O 操作
+//
+// 通过 aeSubmitRead / aeSubmitWritev 提交，
+// 在 aeProcessEvents 中被成批地提交给内核，完成之后调用 proc
+//
+typedef struct aeIoOp {
+
+    int type;               // AE_IO_READ 或 AE_IO_WRITEV
+
+    int fd;                 // 操作的文件描述符
+
+    void *buf;              // AE_IO_READ ：读入的缓冲区和长度
+    size_t len;
+
+    struct iovec *iov;      // AE_IO_WRITEV ：要写出的 iovec 数组（提交时复制的副本）
+    int iovcnt;
+
+    aeIoProc *proc;         // 完成处理器
+
+    void *clientData;       // 私有数据
+
+    struct aeIoOp *prev, *next;  // 等待提交时 next 指向队列中的下一个操作，
+                                 // 提交给 io_uring 之后用 prev/next 链接所有执行中的操作
+
+} aeIoOp;
+
+//
+// aeFiredEvent 已就绪事件
+//
+typedef struct aeFiredEvent {
+
+    int fd;     // 已就绪文件描述符
+
+    int mask;   // 事件类型掩码，值可以是 AE_READABLE 或 AE_WRITABLE ，或者两者的或
+
+} aeFiredEvent;
+
+//
+// aeLatencyHistogram 延迟直方图
+//
+typedef struct aeLatencyHistogram {
+
+    uint64_t counts[AE_LATENCY_BUCKETS];  // 每个桶中的样本数量
+
+    uint64_t samples;   // 样本总数
 
+    uint64_t sum;       // 所有样本的和（微秒）
+
+    uint64_t max;       // 最大的样本（微秒）
+
+} aeLatencyHistogram;
+
+//
+// aeStall 卡顿记录
+//
+// 一轮循环的忙碌时间超过 stallThreshold 时产生一条记录，
+// 同时记下这一轮中耗时最长的处理器
+//
+typedef struct aeStall {
+
+    time_t when;            // 卡顿发生的时间
+
+    long long iteration;    // 发生在第几轮循环
+
+    long long duration;     // 这一轮循环的忙碌时间（微秒）
+
+    int type;               // 耗时最长的处理器类型 AE_LATENCY_*
+
+    long long slowest;      // 耗时最长的处理器执行的时间（微秒）
+
+    void *proc;             // 耗时最长的处理器
+
+    int fd;                 // 处理器对应的文件描述符，不是文件事件时为 -1
+
+    char tag[AE_STALL_TAG_LEN];  // 由卡顿处理器填写的附加信息
+
+} aeStall;
 
 typedef struct aeEventLoop {
     int maxfd;    // 目前已注册的最大描述符
@@ -61,11 +256,35 @@ typedef struct aeEventLoop {
 
     time_t lastTime;              // 最后一次执行时间事件的时间
 
-    aeFiredEvent *events;         // 已注册的文件事件
+    aeFileEvent **events;         // 已注册的文件事件，按段保存，
+                                  // 段在第一次有描述符注册时才分配，未分配的段为 NULL
+
+    int segments;                 // events 中段指针的数量
 
     aeFiredEvent *fired;          // 已就绪的文件事件
 
-    aeTimeEvent *timeEventHead;   // 时间事件
+    int *pending;                 // 已就绪、等待按优先级处理的描述符，
+                                  // 超出预算的描述符会留到下一轮
+
+    int pendingCount;             // pending 中的描述符数量
+
+    int pendingSize;              // pending 数组的容量
+
+    int prioBudget[AE_PRIO_CLASSES];  // 每个优先级在一轮中最多处理的事件数量，0 表示不限制
+
+    aeTimeEvent **timeEventHeap;  // 时间事件最小堆，按 when_sec/when_ms 排序，堆顶就是最近的时间事件
+
+    int timeEventCount;           // 堆中时间事件的数量
+
+    int timeEventHeapSize;        // 堆数组的容量
+
+    aeTimeEvent **timeEventSlots; // 按 id 的低位索引时间事件，按 id 删除时不需要扫描堆
+
+    int *timeEventFreeSlots;      // timeEventSlots 中空闲的下标
+
+    int timeEventFreeCount;       // 空闲下标的数量
+
+    int timeEventSlotsSize;       // timeEventSlots 的容量
 
     int stop;    // 事件处理器的开关
 
@@ -74,7 +293,76 @@ typedef struct aeEventLoop {
 
     aeBeforeSleepProc *beforesleep;   // 在处理事件前要执行的函数
 
+    aeIoOp *ioHead, *ioTail;  // 等待提交的异步 I/O 操作队列
+
+    void *iodata;    // io_uring 的私有数据
+                     // 内核不支持 io_uring 时为 NULL ，异步 I/O 操作退回到同步执行
+
+    /* Latency monitoring */
+    aeLatencyHistogram latency[AE_LATENCY_TYPES];  // 各类处理器的延迟直方图
+
+    long long iteration;      // 已经执行完的循环轮数
+
+    long long iterStart;      // 本轮循环开始的时间（单调时钟，微秒），为 0 表示还没有开始
+
+    aeStall current;          // 本轮循环中耗时最长的处理器
+
+    long long stallThreshold; // 忙碌时间达到多少微秒算作卡顿，为 0 时不检测
+
+    aeStallProc *stallproc;   // 卡顿处理器
+
+    aeStall stalls[AE_STALL_LOG_LEN];  // 最近的卡顿记录，环形数组
+
+    long long stallCount;     // 卡顿的总次数，下一条记录写入 stalls[stallCount % AE_STALL_LOG_LEN]
+
+    /* Adaptive busy polling */
+    long long busyPollBudget; // 每次开始忙轮询之后最多持续的时间（微秒），为 0 时不忙轮询
+
+    int busyPollThreshold;    // 一轮中就绪的事件达到多少个时开始忙轮询
+
+    long long busyPollUntil;  // 在这个时间（单调时钟，微秒）之前不阻塞
+
+    long long stat_spin_time; // 忙轮询（零超时轮询）花费的时间和次数
+    long long stat_spins;
+
+    long long stat_sleep_time;  // 阻塞等待花费的时间和次数
+    long long stat_sleeps;
+
 } aeEventLoop;
 
+/* Prototypes */
+aeEventLoop *aeCreateEventLoop(int setsize);
+void aeDeleteEventLoop(aeEventLoop *eventLoop);
+void aeStop(aeEventLoop *eventLoop);
+int aeCreateFileEvent(aeEventLoop *eventLoop, int fd, int mask,
+        aeFileProc *proc, void *clientData);
+void aeDeleteFileEvent(aeEventLoop *eventLoop, int fd, int mask);
+int aeGetFileEvents(aeEventLoop *eventLoop, int fd);
+long long aeCreateTimeEvent(aeEventLoop *eventLoop, long long milliseconds,
+        aeTimeProc *proc, void *clientData,
+        aeEventFinalizerProc *finalizerProc);
+int aeDeleteTimeEvent(aeEventLoop *eventLoop, long long id);
+int aeProcessEvents(aeEventLoop *eventLoop, int flags);
+int aeWait(int fd, int mask, long long milliseconds);
+void aeMain(aeEventLoop *eventLoop);
+char *aeGetApiName(void);
+void aeSetBeforeSleepProc(aeEventLoop *eventLoop, aeBeforeSleepProc *beforesleep);
+int aeGetSetSize(aeEventLoop *eventLoop);
+int aeSetFileEventPriority(aeEventLoop *eventLoop, int fd, int priority);
+int aeGetFileEventPriority(aeEventLoop *eventLoop, int fd);
+void aeSetPriorityBudget(aeEventLoop *eventLoop, int priority, int budget);
+int aeResizeSetSize(aeEventLoop *eventLoop, int setsize);
+int aeSubmitRead(aeEventLoop *eventLoop, int fd, void *buf, size_t len,
+        aeIoProc *proc, void *clientData);
+int aeSubmitWritev(aeEventLoop *eventLoop, int fd, const struct iovec *iov,
+        int iovcnt, aeIoProc *proc, void *clientData);
+int aeFlushIo(aeEventLoop *eventLoop);
+char *aeGetIoApiName(aeEventLoop *eventLoop);
+long long aeMonotonicMicroseconds(void);
+void aeSetBusyPoll(aeEventLoop *eventLoop, long long budget, int threshold);
+void aeSetStallProc(aeEventLoop *eventLoop, long long threshold, aeStallProc *stallproc);
+void aeResetLatency(aeEventLoop *eventLoop);
+uint64_t aeLatencyPercentile(aeLatencyHistogram *h, double percentile);
+char *aeLatencyTypeName(int type);
 
 #endif
@@ -0,0 +1,178 @@
+/* Linux epoll(2) based ae.c module */
+
+#include <sys/epoll.h>
+
+/*
+ * 事件状态
+ */
+typedef struct aeApiState {
+
+    // epoll_event 实例描述符
+    int epfd;
+
+    // 事件槽
+    struct epoll_event *events;
+
+} aeApiState;
+
+/*
+ * 创建一个新的 epoll 实例，并将它赋值给 eventLoop
+ */
+static int aeApiCreate(aeEventLoop *eventLoop) {
+
+    aeApiState *state = zmalloc(sizeof(aeApiState));
+
+    if (!state) return -1;
+
+    // 初始化事件槽空间
+    state->events = zmalloc(sizeof(struct epoll_event)*eventLoop->setsize);
+    if (!state->events) {
+        zfree(state);
+        return -1;
+    }
+
+    // 创建 epoll 实例
+    state->epfd = epoll_create(1024); /* 1024 is just a hint for the kernel */
+    if (state->epfd == -1) {
+        zfree(state->events);
+        zfree(state);
+        return -1;
+    }
+
+    // 赋值给 eventLoop
+    eventLoop->apidata = state;
+    return 0;
+}
+
+/*
+ * 调整事件槽大小
+ */
+static int aeApiResize(aeEventLoop *eventLoop, int setsize) {
+    aeApiState *state = eventLoop->apidata;
+
+    state->events = zrealloc(state->events, sizeof(struct epoll_event)*setsize);
+    return 0;
+}
+
+/*
+ * 释放 epoll 实例和事件槽
+ */
+static void aeApiFree(aeEventLoop *eventLoop) {
+    aeApiState *state = eventLoop->apidata;
+
+    close(state->epfd);
+    zfree(state->events);
+    zfree(state);
+}
+
+/*
+ * 根据 mask 计算出 epoll 的事件类型
+ *
+ * 只要 mask 中带有 AE_ET ，就以边缘触发方式监听
+ */
+static uint32_t aeApiEpollEvents(int mask) {
+    uint32_t events = 0;
+
+    if (mask & AE_READABLE) events |= EPOLLIN;
+    if (mask & AE_WRITABLE) events |= EPOLLOUT;
+    if (mask & AE_ET) events |= EPOLLET;
+    return events;
+}
+
+/*
+ * 关联给定事件到 fd
+ */
+static int aeApiAddEvent(aeEventLoop *eventLoop, int fd, int mask) {
+    aeApiState *state = eventLoop->apidata;
+    struct epoll_event ee;
+
+    /* If the fd was already monitored for some event, we need a MOD
+     * operation. Otherwise we need an ADD operation.
+     *
+     * 如果 fd 没有关联任何事件，那么这是一个 ADD 操作。
+     *
+     * 如果已经关联了某个/某些事件，那么这是一个 MOD 操作。
+     */
+    int op = aeFileEventAt(eventLoop,fd)->mask == AE_NONE ?
+            EPOLL_CTL_ADD : EPOLL_CTL_MOD;
+
+    // 注册事件到 epoll
+    ee.events = 0;
+    mask |= aeFileEventAt(eventLoop,fd)->mask; /* Merge old events */
+    ee.events = aeApiEpollEvents(mask);
+    ee.data.u64 = 0; /* avoid valgrind warning */
+    ee.data.fd = fd;
+
+    if (epoll_ctl(state->epfd,op,fd,&ee) == -1) return -1;
+
+    return 0;
+}
+
+/*
+ * 从 fd 中删除给定事件
+ */
+static void aeApiDelEvent(aeEventLoop *eventLoop, int fd, int delmask) {
+    aeApiState *state = eventLoop->apidata;
+    struct epoll_event ee;
+
+    int mask = aeFileEventAt(eventLoop,fd)->mask & (~delmask);
+
+    ee.events = aeApiEpollEvents(mask);
+    ee.data.u64 = 0; /* avoid valgrind warning */
+    ee.data.fd = fd;
+    if (mask & (AE_READABLE|AE_WRITABLE)) {
+        // 还有读或写事件，只修改
+        epoll_ctl(state->epfd,EPOLL_CTL_MOD,fd,&ee);
+    } else {
+        /* Note, Kernel < 2.6.9 requires a non null event pointer even for
+         * EPOLL_CTL_DEL. */
+        // 读写事件都没有了（只剩下 AE_ET 标志也算没有），从 epoll 中删除
+        epoll_ctl(state->epfd,EPOLL_CTL_DEL,fd,&ee);
+    }
+}
+
+/*
+ * 获取可执行事件
+ *
+ * epoll_wait 只返回已就绪的 fd ，
+ * 所以每次调用的开销只和就绪的事件数量有关，和已注册的 fd 数量无关
+ */
+static int aeApiPoll(aeEventLoop *eventLoop, struct timeval *tvp) {
+    aeApiState *state = eventLoop->apidata;
+    int retval, numevents = 0;
+
+    // 等待时间
+    retval = epoll_wait(state->epfd,state->events,eventLoop->setsize,
+            tvp ? (tvp->tv_sec*1000 + tvp->tv_usec/1000) : -1);
+
+    // 有至少一个事件就绪？
+    if (retval > 0) {
+        int j;
+
+        // 为已就绪事件设置相应的模式
+        // 并加入到 eventLoop 的 fired 数组中
+        numevents = retval;
+        for (j = 0; j < numevents; j++) {
+            int mask = 0;
+            struct epoll_event *e = state->events+j;
+
+            if (e->events & EPOLLIN) mask |= AE_READABLE;
+            if (e->events & EPOLLOUT) mask |= AE_WRITABLE;
+            if (e->events & EPOLLERR) mask |= AE_WRITABLE;
+            if (e->events & EPOLLHUP) mask |= AE_WRITABLE;
+
+            eventLoop->fired[j].fd = e->data.fd;
+            eventLoop->fired[j].mask = mask;
+        }
+    }
+
+    // 返回已就绪事件个数
+    return numevents;
+}
+
+/*
+ * 返回当前正在使用的 poll 库的名字
+ */
+static char *aeApiName(void) {
+    return "epoll";
+}
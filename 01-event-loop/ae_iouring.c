@@ -0,0 +1,382 @@
+/* Linux io_uring(7) based asynchronous I/O for ae.c
+ *
+ * 文件事件的就绪通知仍然由 epoll 负责，
+ * io_uring 只用来成批地执行 aeSubmitRead / aeSubmitWritev 提交的读写操作：
+ *
+ *  - 一轮事件处理中提交的所有操作，在 aeFlushIo 中通过一次 io_uring_enter 交给内核；
+ *
+ *  - 非阻塞套接字上的读写会在 io_uring_enter 返回之前完成，
+ *    完成队列和提交队列都是 mmap 出来的共享内存，收割完成事件不需要系统调用；
+ *
+ *  - 少数在内核中异步完成的操作，通过注册到 epoll 的 eventfd 唤醒事件循环。
+ *    比如在没有数据可读的 fd 上提交读操作，io_uring 会等到数据到达才完成，
+ *    而不是像同步执行那样立即以 -EAGAIN 完成，所以应该只在 fd 可读时提交读操作。
+ *
+ * 不使用 liburing ，直接通过系统调用操作 ring 。
+ * 内核不支持 io_uring （或者被 seccomp 等禁止）时 aeUringCreate 返回 NULL ，
+ * ae.c 会退回到同步执行这些操作。
+ */
+
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+
+/* 提交队列的大小 */
+#define AE_URING_ENTRIES 1024
+
+/*
+ * io_uring 实例状态
+ */
+typedef struct aeUring {
+
+    int ringfd;      // io_uring 实例描述符
+
+    int efd;         // 异步完成通知用的 eventfd
+
+    /* 提交队列 */
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned sq_entries;
+    struct io_uring_sqe *sqes;
+
+    /* 完成队列 */
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+
+    /* mmap 出来的内存 */
+    void *sq_ring;
+    size_t sq_ring_size;
+    void *cq_ring;
+    size_t cq_ring_size;
+    size_t sqes_size;
+
+    unsigned queued;     // 已经放入提交队列、还没有提交给内核的操作数量
+
+    unsigned inflight;   // 已经提交给内核、还没有收割的操作数量
+
+    aeIoOp *ops;         // 所有放入提交队列、还没有完成的操作
+
+} aeUring;
+
+static int aeUringSetup(unsigned entries, struct io_uring_params *p) {
+    return (int) syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int aeUringEnter(int fd, unsigned to_submit, unsigned min_complete,
+                        unsigned flags)
+{
+    return (int) syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+                         flags, NULL, 0);
+}
+
+static int aeUringRegister(int fd, unsigned opcode, void *arg, unsigned nr_args) {
+    return (int) syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+/*
+ * 检查内核是否支持我们需要用到的操作码
+ */
+static int aeUringProbe(int ringfd) {
+    size_t len = sizeof(struct io_uring_probe) +
+                 256*sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = zcalloc(len);
+    int ok = 0;
+
+    if (aeUringRegister(ringfd,IORING_REGISTER_PROBE,probe,256) == 0 &&
+        probe->last_op >= IORING_OP_READ &&
+        (probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED) &&
+        (probe->ops[IORING_OP_WRITEV].flags & IO_URING_OP_SUPPORTED))
+        ok = 1;
+    zfree(probe);
+    return ok;
+}
+
+/*
+ * 释放 io_uring 实例
+ */
+static void aeUringFree(aeEventLoop *eventLoop, aeUring *u) {
+    // 关闭 ring 时内核会取消还没有完成的操作，这里只释放它们的内存
+    while (u->ops) {
+        aeIoOp *op = u->ops;
+
+        u->ops = op->next;
+        aeFreeIoOp(op);
+    }
+    if (u->efd != -1) {
+        aeDeleteFileEvent(eventLoop,u->efd,AE_READABLE);
+        close(u->efd);
+    }
+    if (u->sqes && u->sqes != MAP_FAILED) munmap(u->sqes,u->sqes_size);
+    if (u->cq_ring && u->cq_ring != MAP_FAILED && u->cq_ring != u->sq_ring)
+        munmap(u->cq_ring,u->cq_ring_size);
+    if (u->sq_ring && u->sq_ring != MAP_FAILED) munmap(u->sq_ring,u->sq_ring_size);
+    close(u->ringfd);
+    zfree(u);
+}
+
+static int aeUringReap(aeEventLoop *eventLoop, aeUring *u);
+
+/*
+ * 将操作从执行中的操作链表中移除
+ */
+static void aeUringUnlinkOp(aeUring *u, aeIoOp *op) {
+    if (op->prev)
+        op->prev->next = op->next;
+    else
+        u->ops = op->next;
+    if (op->next) op->next->prev = op->prev;
+}
+
+/*
+ * eventfd 的读处理器：有操作在内核中异步完成了，收割它们
+ */
+static void aeUringCompletionHandler(aeEventLoop *eventLoop, int fd,
+                                     void *clientData, int mask)
+{
+    aeUring *u = clientData;
+    uint64_t count;
+    AE_NOTUSED(mask);
+
+    if (read(fd,&count,sizeof(count)) == -1) {
+        /* Spurious wakeup, the completions are reaped anyway. */
+    }
+    aeUringReap(eventLoop,u);
+}
+
+/*
+ * 创建 io_uring 实例
+ *
+ * 内核不支持 io_uring 或者缺少需要的操作码时返回 NULL
+ */
+static aeUring *aeUringCreate(aeEventLoop *eventLoop) {
+    struct io_uring_params p;
+    aeUring *u;
+
+    memset(&p,0,sizeof(p));
+    u = zcalloc(sizeof(*u));
+    u->efd = -1;
+
+    // 创建 io_uring 实例
+    if ((u->ringfd = aeUringSetup(AE_URING_ENTRIES,&p)) == -1) {
+        zfree(u);
+        return NULL;
+    }
+    if (!aeUringProbe(u->ringfd)) goto err;
+
+    // 映射提交队列和完成队列
+    u->sq_ring_size = p.sq_off.array + p.sq_entries*sizeof(unsigned);
+    u->cq_ring_size = p.cq_off.cqes + p.cq_entries*sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        // 两个队列共享同一段映射
+        if (u->cq_ring_size > u->sq_ring_size) u->sq_ring_size = u->cq_ring_size;
+        u->cq_ring_size = u->sq_ring_size;
+    }
+    u->sq_ring = mmap(NULL,u->sq_ring_size,PROT_READ|PROT_WRITE,
+                      MAP_SHARED|MAP_POPULATE,u->ringfd,IORING_OFF_SQ_RING);
+    if (u->sq_ring == MAP_FAILED) goto err;
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        u->cq_ring = u->sq_ring;
+    } else {
+        u->cq_ring = mmap(NULL,u->cq_ring_size,PROT_READ|PROT_WRITE,
+                          MAP_SHARED|MAP_POPULATE,u->ringfd,IORING_OFF_CQ_RING);
+        if (u->cq_ring == MAP_FAILED) goto err;
+    }
+    u->sqes_size = p.sq_entries*sizeof(struct io_uring_sqe);
+    u->sqes = mmap(NULL,u->sqes_size,PROT_READ|PROT_WRITE,
+                   MAP_SHARED|MAP_POPULATE,u->ringfd,IORING_OFF_SQES);
+    if (u->sqes == MAP_FAILED) goto err;
+
+    u->sq_head = (unsigned*)((char*)u->sq_ring + p.sq_off.head);
+    u->sq_tail = (unsigned*)((char*)u->sq_ring + p.sq_off.tail);
+    u->sq_mask = (unsigned*)((char*)u->sq_ring + p.sq_off.ring_mask);
+    u->sq_array = (unsigned*)((char*)u->sq_ring + p.sq_off.array);
+    u->sq_entries = p.sq_entries;
+    u->cq_head = (unsigned*)((char*)u->cq_ring + p.cq_off.head);
+    u->cq_tail = (unsigned*)((char*)u->cq_ring + p.cq_off.tail);
+    u->cq_mask = (unsigned*)((char*)u->cq_ring + p.cq_off.ring_mask);
+    u->cqes = (struct io_uring_cqe*)((char*)u->cq_ring + p.cq_off.cqes);
+
+    // 只有在内核中异步完成的操作才通过 eventfd 通知
+    if ((u->efd = eventfd(0,EFD_NONBLOCK|EFD_CLOEXEC)) == -1) goto err;
+    if (aeUringRegister(u->ringfd,IORING_REGISTER_EVENTFD_ASYNC,&u->efd,1) == -1)
+        goto err;
+    if (aeCreateFileEvent(eventLoop,u->efd,AE_READABLE,
+        aeUringCompletionHandler,u) == AE_ERR) goto err;
+
+    return u;
+
+err:
+    aeUringFree(eventLoop,u);
+    return NULL;
+}
+
+/*
+ * 将操作放入提交队列，队列已满时返回 -1
+ */
+static int aeUringQueue(aeUring *u, aeIoOp *op) {
+    unsigned tail = *u->sq_tail;
+    unsigned head = __atomic_load_n(u->sq_head,__ATOMIC_ACQUIRE);
+    unsigned idx;
+    struct io_uring_sqe *sqe;
+
+    if (tail - head >= u->sq_entries) return -1;
+
+    idx = tail & *u->sq_mask;
+    sqe = &u->sqes[idx];
+    memset(sqe,0,sizeof(*sqe));
+    sqe->fd = op->fd;
+    sqe->off = (uint64_t) -1;   /* Use (and update) the current file position. */
+    sqe->user_data = (uint64_t)(uintptr_t) op;
+    if (op->type == AE_IO_READ) {
+        sqe->opcode = IORING_OP_READ;
+        sqe->addr = (uint64_t)(uintptr_t) op->buf;
+        sqe->len = op->len;
+    } else {
+        sqe->opcode = IORING_OP_WRITEV;
+        sqe->addr = (uint64_t)(uintptr_t) op->iov;
+        sqe->len = op->iovcnt;
+    }
+    u->sq_array[idx] = idx;
+    __atomic_store_n(u->sq_tail,tail+1,__ATOMIC_RELEASE);
+    u->queued++;
+
+    // 链接到执行中的操作链表
+    op->prev = NULL;
+    op->next = u->ops;
+    if (u->ops) u->ops->prev = op;
+    u->ops = op;
+    return 0;
+}
+
+/*
+ * 收割完成队列中的所有完成事件，并调用它们的处理器
+ *
+ * 返回处理的完成事件数量
+ */
+static int aeUringReap(aeEventLoop *eventLoop, aeUring *u) {
+    int processed = 0;
+
+    while (1) {
+        unsigned head = *u->cq_head;
+        struct io_uring_cqe *cqe;
+        aeIoOp *op;
+        ssize_t res;
+
+        if (head == __atomic_load_n(u->cq_tail,__ATOMIC_ACQUIRE)) break;
+
+        cqe = &u->cqes[head & *u->cq_mask];
+        op = (aeIoOp*)(uintptr_t) cqe->user_data;
+        res = cqe->res;
+        // 先归还 cqe ，处理器中可能会提交新的操作
+        __atomic_store_n(u->cq_head,head+1,__ATOMIC_RELEASE);
+        u->inflight--;
+        aeUringUnlinkOp(u,op);
+
+        op->proc(eventLoop,op->fd,op->clientData,res);
+        aeFreeIoOp(op);
+        processed++;
+    }
+    return processed;
+}
+
+/*
+ * 撤回提交队列中还没有被内核取走的操作，返回它们组成的链表（按提交的顺序）
+ */
+static aeIoOp *aeUringTakeQueued(aeUring *u) {
+    unsigned head = __atomic_load_n(u->sq_head,__ATOMIC_ACQUIRE);
+    unsigned tail = *u->sq_tail;
+    aeIoOp *ops = NULL, **last = &ops;
+
+    __atomic_store_n(u->sq_tail,head,__ATOMIC_RELEASE);
+    u->queued = 0;
+    while (head != tail) {
+        struct io_uring_sqe *sqe = &u->sqes[u->sq_array[head & *u->sq_mask]];
+        aeIoOp *op = (aeIoOp*)(uintptr_t) sqe->user_data;
+
+        aeUringUnlinkOp(u,op);
+        op->next = NULL;
+        *last = op;
+        last = &op->next;
+        head++;
+    }
+    return ops;
+}
+
+/*
+ * 撤回提交队列中还没有被内核取走的操作，并以错误码 err 调用它们的处理器
+ */
+static void aeUringAbortQueued(aeEventLoop *eventLoop, aeUring *u, int err) {
+    // 先把队列恢复为空，处理器中可能会提交新的操作
+    aeIoOp *ops = aeUringTakeQueued(u);
+
+    while (ops) {
+        aeIoOp *next = ops->next;
+
+        ops->proc(eventLoop,ops->fd,ops->clientData,err);
+        aeFreeIoOp(ops);
+        ops = next;
+    }
+}
+
+/* io_uring_enter 暂时无法提交（ EAGAIN / EBUSY ）时最多重试的次数 */
+#define AE_URING_SUBMIT_RETRIES 16
+
+/*
+ * 将提交队列中的操作交给内核，然后收割已经完成的操作
+ *
+ * 内核暂时无法接受新的操作时，先收割完成事件再重试，
+ * 重试 AE_URING_SUBMIT_RETRIES 次之后仍然不行，就把剩下的操作退回到同步执行，
+ * 不会一直等待下去。
+ */
+static int aeUringSubmit(aeEventLoop *eventLoop, aeUring *u) {
+    int retries = AE_URING_SUBMIT_RETRIES, processed = 0;
+
+    while (u->queued) {
+        int n = aeUringEnter(u->ringfd,u->queued,0,IORING_ENTER_GETEVENTS);
+
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if ((errno == EAGAIN || errno == EBUSY) && retries--) {
+                // 完成队列太满了，先收割再重试
+                processed += aeUringReap(eventLoop,u);
+                continue;
+            }
+            if (errno == EAGAIN || errno == EBUSY) {
+                processed += aeFlushIoSync(eventLoop,aeUringTakeQueued(u));
+            } else {
+                // 无法提交，将还在队列中的操作以错误的形式完成
+                aeUringAbortQueued(eventLoop,u,-errno);
+            }
+            break;
+        }
+        u->queued -= n;
+        u->inflight += n;
+    }
+    return processed+aeUringReap(eventLoop,u);
+}
+
+/*
+ * 通过 io_uring 执行 ops 链表中的所有操作
+ *
+ * 提交队列满了就先提交一批，所以一次调用的系统调用次数约为 N / AE_URING_ENTRIES
+ */
+static int aeUringFlush(aeEventLoop *eventLoop, aeUring *u, aeIoOp *ops) {
+    int processed = 0;
+
+    while (ops) {
+        aeIoOp *next = ops->next;
+
+        if (aeUringQueue(u,ops) == -1) {
+            processed += aeUringSubmit(eventLoop,u);
+            continue;
+        }
+        ops = next;
+    }
+    processed += aeUringSubmit(eventLoop,u);
+    return processed;
+}
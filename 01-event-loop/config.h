@@ -0,0 +1,30 @@
+#ifndef __CONFIG_H
+#define __CONFIG_H
+
+/* Test for proc filesystem */
+// 从 /proc/self/statm 读取进程的 RSS ，从 /proc/self/smaps_rollup 读取私有脏页
+#ifdef __linux__
+#define HAVE_PROC_STAT 1
+#define HAVE_PROC_SMAPS 1
+#endif
+
+/* Test for polling API */
+// Linux 下使用 epoll 作为多路复用库
+#ifdef __linux__
+#define HAVE_EPOLL 1
+#endif
+
+/* Test for backtrace() */
+#if defined(__APPLE__) || defined(__linux__)
+#define HAVE_BACKTRACE 1
+#endif
+
+/* Test for io_uring (Linux 5.6+ headers), used for batched socket I/O.
+ * Whether the running kernel supports it is only known at runtime. */
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define HAVE_IO_URING 1
+#endif
+#endif
+
+#endif
@@ -0,0 +1,148 @@
+/* db.c -- 数据库键空间的底层操作和通用的键命令
+ *
+ * 单线程模式下 c->db 指向 server.db 中的数据库；
+ * 多 reactor 模式下命令在负责键的线程上执行，c->db 指向那个线程的键空间分片，
+ * 这里的函数只访问 c->db ，不需要区分两种模式。
+ */
+
+#include "redis.h"
+
+#include <assert.h>
+
+/*-----------------------------------------------------------------------------
+ * C-level DB API
+ *----------------------------------------------------------------------------*/
+
+/*
+ * 从数据库 db 中取出键 key 的值（对象），键不存在时返回 NULL
+ */
+robj *lookupKey(redisDb *db, robj *key) {
+    dictEntry *de = dictFind(db->dict,key->ptr);
+
+    return de ? dictGetVal(de) : NULL;
+}
+
+/*
+ * 为执行读取操作而取出键 key 在数据库 db 中的值
+ */
+robj *lookupKeyRead(redisDb *db, robj *key) {
+    return lookupKey(db,key);
+}
+
+/*
+ * 为执行写入操作而取出键 key 在数据库 db 中的值
+ */
+robj *lookupKeyWrite(redisDb *db, robj *key) {
+    return lookupKey(db,key);
+}
+
+/* Add the key to the DB. It's up to the caller to increment the reference
+ * counter of the value if needed.
+ *
+ * 将键值对 key 和 val 添加到数据库中，由调用者负责增加 val 的引用计数
+ *
+ * The program is aborted if the key already exists.
+ *
+ * 键已经存在时程序停止
+ */
+void dbAdd(redisDb *db, robj *key, robj *val) {
+    // 复制键名，字典拥有复制出来的 sds
+    sds copy = sdsdup(key->ptr);
+    int retval = dictAdd(db->dict,copy,val);
+
+    assert(retval == DICT_OK);
+    (void)retval;
+}
+
+/* Overwrite an existing key with a new value. Incrementing the reference
+ * count of the new value is up to the caller.
+ *
+ * 为已经存在的键关联一个新值，由调用者负责增加 val 的引用计数
+ *
+ * The program is aborted if the key was not already present.
+ *
+ * 键不存在时程序停止
+ */
+void dbOverwrite(redisDb *db, robj *key, robj *val) {
+    dictEntry *de = dictFind(db->dict,key->ptr);
+
+    assert(de != NULL);
+    (void)de;
+    // 键已经存在，dictReplace 只替换值，不会用到传入的 sds
+    dictReplace(db->dict,key->ptr,val);
+}
+
+/* High level Set operation. This function can be used in order to set
+ * a key, whatever it was existing or not, to a new object.
+ *
+ * 高层次的 SET 操作函数，不管键 key 是否存在，都将它和 val 关联起来
+ *
+ * 1) The ref count of the value object is incremented.
+ *    值对象的引用计数会被增加
+ */
+void setKey(redisDb *db, robj *key, robj *val) {
+    if (lookupKeyWrite(db,key) == NULL) {
+        dbAdd(db,key,val);
+    } else {
+        dbOverwrite(db,key,val);
+    }
+    incrRefCount(val);
+}
+
+/* Delete a key, value, and associated expiration entry if any, from the DB
+ *
+ * 从数据库中删除给定的键，键的值，以及键的过期时间。
+ *
+ * 删除成功返回 1 ，因为键不存在而导致删除失败时，返回 0 。
+ */
+int dbDelete(redisDb *db, robj *key) {
+    /* Deleting an entry from the expires dict will not free the sds of
+     * the key, because it is shared with the main dictionary. */
+    // 删除键的过期时间
+    if (dictSize(db->expires) > 0) dictDelete(db->expires,key->ptr);
+
+    // 删除键值对
+    return dictDelete(db->dict,key->ptr) == DICT_OK;
+}
+
+/*-----------------------------------------------------------------------------
+ * Type agnostic commands operating on the key space
+ *----------------------------------------------------------------------------*/
+
+void delCommand(redisClient *c) {
+    int deleted = 0, j;
+
+    // 遍历所有输入键
+    for (j = 1; j < c->argc; j++) {
+        // 尝试删除键
+        if (dbDelete(c->db,c->argv[j])) deleted++;
+    }
+
+    // 返回被删除键的数量
+    addReplyLongLong(c,deleted);
+}
+
+void existsCommand(redisClient *c) {
+    addReplyLongLong(c,lookupKeyRead(c->db,c->argv[1]) ? 1 : 0);
+}
+
+/*
+ * 切换客户端使用的数据库
+ *
+ * 多 reactor 模式下，命令执行之前 reactorCall 会根据 c->dictid
+ * 把 c->db 指向负责线程的键空间分片
+ */
+void selectCommand(redisClient *c) {
+    long long id;
+
+    if (!string2ll(c->argv[1]->ptr,sdslen(c->argv[1]->ptr),&id) ||
+        id < 0 || id >= server.dbnum)
+    {
+        addReplyError(c,"invalid DB index");
+        return;
+    }
+
+    c->dictid = (int)id;
+    c->db = (c->worker ? c->worker->db : server.db)+c->dictid;
+    addReplyStatus(c,"OK");
+}
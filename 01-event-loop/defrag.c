@@ -0,0 +1,253 @@
+/* defrag.c -- 主动内存碎片整理
+ *
+ * 服务器长时间运行之后，键被反复创建和删除，分配器的很多页面中只剩下零星几个
+ * 还在使用的内存块，这些页面不能归还给操作系统，RSS 会明显高于 used_memory 。
+ *
+ * 碎片率（ RSS / used_memory ）超过阈值时，databasesCron 每次调用 activeDefragCycle ，
+ * 用 dictScanBatch 渐进地遍历键空间，检查每个键和值的内存块，
+ * 分配器报告内存块所在的 slab 比较稀疏时（见 zmalloc_defrag_hint ），
+ * 绕过线程缓存把它复制到新的内存块中，再释放原来的内存块。
+ * 新的内存块会填进较满的 slab ，被搬空的稀疏 slab 就可以归还给操作系统。
+ *
+ * 只有 jemalloc 能报告内存块所在 slab 的使用率，其他分配器上不加挑选地复制
+ * 只会让新的内存块落回刚刚释放的位置，所以不使用 jemalloc 编译时（没有定义 HAVE_DEFRAG ）
+ * 不能开启碎片整理，activeDefragCycle 什么也不做。
+ *
+ * 一次整理完成之后重新检查碎片率，如果碎片率没有明显下降，说明剩下的碎片来自不能移动的内存，
+ * 马上重新整理只会再检查一遍所有的键和值，所以先冷却一段时间，连续无效时冷却时间加倍。
+ *
+ * 以下内存不会被移动：
+ *
+ *  - 内存池中的 robj 和 dictEntry ，slab 不会归还给 zmalloc ，移动没有意义；
+ *  - 嵌入在节点中的键，它和节点共用一块内存（只有链地址法的字典会嵌入键，
+ *    键空间使用开放寻址法，目前不会遇到）；
+ *  - 被共享的对象（ refcount 大于 1 ），其他地方还保存着它的指针；
+ *  - 允许其他线程并发读的字典，读线程可能还在使用原来的内存块。
+ *
+ * 每次调用最多使用 server.active_defrag_cycle% 的 CPU 时间，
+ * 整理的进度保存在线程局部变量中，多 reactor 模式下每个线程整理自己的键空间分片。
+ */
+
+#include "redis.h"
+
+#ifdef HAVE_DEFRAG
+
+/* 当前线程的整理进度 */
+static __thread int defrag_running = 0;           // 是否正在进行一次整理
+static __thread int defrag_db = 0;                // 正在整理的数据库
+static __thread unsigned long defrag_cursor = 0;  // 在这个数据库中的遍历游标
+static __thread float defrag_start_frag = 0;      // 这次整理开始时的碎片率
+static __thread long long defrag_cooldown = 0;    // 上一次无效整理之后的冷却时间（毫秒）
+static __thread long long defrag_resume_time = 0; // 冷却结束的时间（微秒）
+
+/* 传给 dictScanBatch 回调函数的参数 */
+typedef struct defragCtx {
+    redisDb *db;          // 正在整理的数据库
+    long long hits;       // 被重新分配的内存块数量
+    long long misses;     // 不能移动的内存块数量
+} defragCtx;
+
+/*
+ * 内存块 ptr 所在的 slab 比较稀疏时，把它移动到新的内存块中，释放原来的内存块，
+ * 返回新的地址；不值得移动时返回 NULL ，ptr 保持不变
+ */
+static void *activeDefragAlloc(void *ptr) {
+    size_t size;
+    void *newptr;
+
+    if (!zmalloc_defrag_hint(ptr)) return NULL;
+
+    size = zmalloc_size(ptr);
+    newptr = zmalloc_no_tcache(size);
+    memcpy(newptr,ptr,size);
+    zfree_no_tcache(ptr);
+    return newptr;
+}
+
+/*
+ * 移动 sds s 的内存块，返回新的 sds ，不值得移动时返回 NULL
+ */
+static sds activeDefragSds(sds s) {
+    char *newsh = activeDefragAlloc(s-sizeof(struct sdshdr));
+
+    return newsh ? newsh+sizeof(struct sdshdr) : NULL;
+}
+
+/*
+ * 移动字符串对象 o 的内存
+ *
+ * EMBSTR 编码的对象和它的 sds 在同一个内存块中，整个被移动，返回新的对象；
+ * RAW 编码的对象本身在内存池中，只移动它的 sds ，返回 NULL 。
+ * 对象不能或者不值得移动时也返回 NULL 。
+ */
+static robj *activeDefragStringObject(defragCtx *ctx, robj *o) {
+    robj *newo;
+    sds news;
+
+    if (o->type != REDIS_STRING || o->refcount != 1) {
+        ctx->misses++;
+        return NULL;
+    }
+
+    if (o->encoding == REDIS_ENCODING_EMBSTR) {
+        long offset = (char*)o->ptr-(char*)o;
+
+        if ((newo = activeDefragAlloc(o)) == NULL) {
+            ctx->misses++;
+            return NULL;
+        }
+        newo->ptr = (char*)newo+offset;
+        ctx->hits++;
+        return newo;
+    }
+
+    if (o->encoding == REDIS_ENCODING_RAW &&
+        (news = activeDefragSds(o->ptr)) != NULL)
+    {
+        o->ptr = news;
+        ctx->hits++;
+    } else {
+        ctx->misses++;
+    }
+    return NULL;
+}
+
+/*
+ * 重新分配键空间中一个节点的键和值
+ */
+static void activeDefragEntry(defragCtx *ctx, dictEntry *de) {
+    dict *d = ctx->db->dict;
+    sds key = dictGetKey(de), newkey;
+    robj *val = dictGetVal(de), *newval;
+
+    if (dictIsEmbeddedKey(d,key)) {
+        ctx->misses++;
+    } else {
+        // 过期字典的键和键空间的键是同一个 sds ，要一起更新，
+        // 移动之前先找到它，移动之后原来的 sds 就被释放了
+        dictEntry *ede = dictSize(ctx->db->expires) ?
+                         dictFind(ctx->db->expires,key) : NULL;
+
+        if ((newkey = activeDefragSds(key)) != NULL) {
+            if (ede) ede->key = newkey;
+            de->key = newkey;
+            ctx->hits++;
+        } else {
+            ctx->misses++;
+        }
+    }
+
+    if (val && (newval = activeDefragStringObject(ctx,val)) != NULL)
+        de->v.val = newval;
+}
+
+/*
+ * dictScanBatch 的回调函数
+ */
+static void activeDefragScanCallback(void *privdata, dictEntry **des, int count) {
+    defragCtx *ctx = privdata;
+    int j;
+
+    for (j = 0; j < count; j++)
+        activeDefragEntry(ctx,des[j]);
+}
+
+/*
+ * 碎片率超过阈值、碎片也足够多时返回 1 ，否则返回 0
+ */
+static int activeDefragNeeded(void) {
+    size_t rss = zmalloc_get_rss();
+    size_t used = zmalloc_used_memory();
+    float frag;
+
+    if (rss <= used) return 0;
+    if ((long long)(rss-used) < server.active_defrag_ignore_bytes) return 0;
+
+    frag = zmalloc_get_fragmentation_ratio(rss);
+    return frag*100 >= 100+server.active_defrag_threshold;
+}
+
+/*
+ * 一次整理完成时调用，碎片率没有下降足够多时进入冷却
+ */
+static void activeDefragFinish(void) {
+    float frag = zmalloc_get_fragmentation_ratio(zmalloc_get_rss());
+
+    if ((defrag_start_frag-frag)*100 >= REDIS_ACTIVE_DEFRAG_MIN_GAIN) {
+        defrag_cooldown = 0;
+        return;
+    }
+
+    defrag_cooldown = defrag_cooldown ? defrag_cooldown*2 :
+                                        REDIS_ACTIVE_DEFRAG_COOLDOWN;
+    if (defrag_cooldown > REDIS_ACTIVE_DEFRAG_COOLDOWN_MAX)
+        defrag_cooldown = REDIS_ACTIVE_DEFRAG_COOLDOWN_MAX;
+    defrag_resume_time = aeMonotonicMicroseconds()+defrag_cooldown*1000;
+}
+
+/*
+ * 对 db （共 server.dbnum 个数据库）进行一小步碎片整理，在 databasesCron 中调用
+ *
+ * 没有正在进行的整理、也不在冷却期间时，先检查碎片率，碎片率超过阈值才开始一次新的整理；
+ * 每次最多运行 server.active_defrag_cycle% 的 cron 周期，下次从游标处继续。
+ */
+void activeDefragCycle(redisDb *db) {
+    defragCtx ctx;
+    long long start, budget;
+
+    if (!server.active_defrag) return;
+
+    if (!defrag_running) {
+        if (aeMonotonicMicroseconds() < defrag_resume_time) return;
+        if (!activeDefragNeeded()) return;
+        defrag_start_frag = zmalloc_get_fragmentation_ratio(zmalloc_get_rss());
+        defrag_running = 1;
+        defrag_db = 0;
+        defrag_cursor = 0;
+        __atomic_add_fetch(&server.stat_active_defrag_running,1,__ATOMIC_RELAXED);
+    }
+
+    // 本次调用可以使用的时间，单位为微秒
+    budget = 1000000LL/server.hz*server.active_defrag_cycle/100;
+    start = aeMonotonicMicroseconds();
+    ctx.hits = 0;
+    ctx.misses = 0;
+
+    while (defrag_db < server.dbnum) {
+        ctx.db = &db[defrag_db];
+
+        if (ctx.db->dict->concurrent || dictSize(ctx.db->dict) == 0) {
+            defrag_db++;
+            defrag_cursor = 0;
+            continue;
+        }
+
+        defrag_cursor = dictScanBatch(ctx.db->dict,defrag_cursor,DICT_SCAN_BATCH,
+            activeDefragScanCallback,&ctx);
+        if (defrag_cursor == 0) defrag_db++;
+
+        if (aeMonotonicMicroseconds()-start >= budget) break;
+    }
+
+    // 所有数据库都整理完毕，下次调用时重新检查碎片率
+    if (defrag_db >= server.dbnum) {
+        defrag_running = 0;
+        __atomic_sub_fetch(&server.stat_active_defrag_running,1,__ATOMIC_RELAXED);
+        activeDefragFinish();
+    }
+
+    __atomic_add_fetch(&server.stat_active_defrag_hits,ctx.hits,__ATOMIC_RELAXED);
+    __atomic_add_fetch(&server.stat_active_defrag_misses,ctx.misses,__ATOMIC_RELAXED);
+}
+
+#else
+
+/*
+ * 分配器不能报告内存块所在 slab 的使用率，不进行碎片整理，
+ * initServer 会关闭 server.active_defrag
+ */
+void activeDefragCycle(redisDb *db) {
+    REDIS_NOTUSED(db);
+}
+
+#endif
@@ -5,10 +5,14 @@
 #include <stdarg.h>
 #include <limits.h>
 #include <sys/time.h>
-#include <ctype.h>
 #include <assert.h>
+#include <pthread.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #include "dict.h"
 #include "zmalloc.h"
+#include "zpool.h"
 
 /*
  * 通过 dictEnableResize() 和 dictDisableResize() 两个函数.
@@ -23,6 +27,7 @@
 
 
  // 指示字典是否启用 rehash 的标识
+ // 主线程的 serverCron 写入，reactor 线程在调整自己的字典大小时读取，所以用原子操作访问
  static int dict_can_resize = 1;
  // 强制 rehash 的比率
  static unsigned int dict_force_resize_ratio = 5;
@@ -31,8 +36,11 @@
 
 static int _dictExpandIfNeeded(dict *ht);
 static unsigned long _dictNextPower(unsigned long size);
-static int _dictKeyIndex(dict *ht, const void *key);
+static long _dictKeyIndex(dict *ht, const void *key);
 static int _dictInit(dict *ht, dictType *type, void *privDataPtr);
+static int _dictClear(dict *d, dictht *ht, void(callback)(void *));
+static dictEntry *_dictAddRaw(dict *d, void *key, int setval, void *val);
+static void _dictFreeEntry(dict *d, dictEntry *he, int nofree);
 
 /* -------------------------- private prototypes ---------------------------- */
 
@@ -53,83 +61,682 @@ unsigned int dictIdentityHashFunction(unsigned int key) {
     return key;
 }
 
-static uint32_t dict_hash_function_seed = 5381;
+/* -------------------------- hash functions -------------------------------- */
+
+static uint8_t dict_hash_function_seed[16];
 
 /*
- * 设定种子值
+ * 设定种子值，seed 为 16 字节的随机数
  */
-void dictSetHashFunctionSeed(uint32_t seed) {
-     dict_hash_function_seed = seed;
+void dictSetHashFunctionSeed(uint8_t *seed) {
+    memcpy(dict_hash_function_seed,seed,sizeof(dict_hash_function_seed));
 }
 
 /*
  * 获取种子值
  */
-uint32_t dictGetHashFunctionSeed(void) {
-     return dict_hash_function_seed;
+uint8_t *dictGetHashFunctionSeed(void) {
+    return dict_hash_function_seed;
+}
+
+/* The default hashing function uses SipHash implementation
+ * in siphash.c.
+ *
+ * 默认的哈希函数是带密钥的 SipHash-1-3 ，密钥就是种子值，
+ * 用户可以控制键的字典（比如数据库键空间）都应该使用它 */
+
+uint64_t siphash(const uint8_t *in, const size_t inlen, const uint8_t *k);
+uint64_t siphash_nocase(const uint8_t *in, const size_t inlen, const uint8_t *k);
+
+uint64_t dictGenHashFunction(const void *key, int len) {
+    return siphash(key,len,dict_hash_function_seed);
+}
+
+/* And a case insensitive hash function
+ *
+ * 不区分大小写的哈希函数，用于命令表等字典 */
+uint64_t dictGenCaseHashFunction(const unsigned char *buf, int len) {
+    return siphash_nocase(buf,len,dict_hash_function_seed);
+}
+
+/* 快速哈希函数的混合常数 */
+#define DICT_FAST_P0 0xa0761d6478bd642fULL
+#define DICT_FAST_P1 0xe7037ed1a0b428dbULL
+#define DICT_FAST_P2 0x8ebc6af09c88c6e3ULL
+#define DICT_FAST_P3 0x589965cc75374cc3ULL
+
+/*
+ * 计算 a * b 的 128 位乘积，返回高 64 位和低 64 位的异或
+ */
+static inline uint64_t _dictMum(uint64_t a, uint64_t b) {
+#ifdef __SIZEOF_INT128__
+    __uint128_t r = (__uint128_t)a * b;
+
+    return (uint64_t)(r >> 64) ^ (uint64_t)r;
+#else
+    uint64_t ha = a >> 32, hb = b >> 32, la = (uint32_t)a, lb = (uint32_t)b;
+    uint64_t rh = ha*hb, rm0 = ha*lb, rm1 = hb*la, rl = la*lb;
+    uint64_t t = rl + (rm0 << 32), c = t < rl, lo, hi;
+
+    lo = t + (rm1 << 32);
+    c += lo < t;
+    hi = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+    return hi ^ lo;
+#endif
+}
+
+static inline uint64_t _dictRead64(const uint8_t *p) {
+    uint64_t v;
+
+    memcpy(&v,p,sizeof(v));
+    return v;
+}
+
+static inline uint64_t _dictRead32(const uint8_t *p) {
+    uint32_t v;
+
+    memcpy(&v,p,sizeof(v));
+    return v;
+}
+
+/*
+ * 快速哈希函数（ wyhash 一类的乘法混合哈希）
+ *
+ * 每次 64 位乘法混合 16 个字节，短键只需要两次乘法，比 SipHash 快几倍，
+ * 但不能抵抗精心构造的碰撞，所以只用于键不受用户控制的字典，
+ * 通过 dictType 的 hashFunction 按字典类型选择。
+ *
+ * 和 MurmurHash2 一样，在大端和小端机器上的结果不同。
+ */
+uint64_t dictGenFastHashFunction(const void *key, int len) {
+    const uint8_t *p = key;
+    uint64_t seed = _dictRead64(dict_hash_function_seed) ^
+                    _dictRead64(dict_hash_function_seed+8) ^ DICT_FAST_P0;
+    uint64_t a, b;
+
+    if (len <= 16) {
+        if (len >= 4) {
+            // 读入头尾各 8 个字节（可能重叠），覆盖 4 到 16 字节的输入
+            a = (_dictRead32(p) << 32) | _dictRead32(p+((len>>3)<<2));
+            b = (_dictRead32(p+len-4) << 32) |
+                _dictRead32(p+len-4-((len>>3)<<2));
+        } else if (len > 0) {
+            a = ((uint64_t)p[0] << 16) | ((uint64_t)p[len>>1] << 8) | p[len-1];
+            b = 0;
+        } else {
+            a = b = 0;
+        }
+    } else {
+        int i = len;
+
+        // 长键用三条独立的乘法链，让 CPU 可以并行执行
+        if (i > 48) {
+            uint64_t s1 = seed, s2 = seed;
+
+            do {
+                seed = _dictMum(_dictRead64(p) ^ DICT_FAST_P1,
+                                _dictRead64(p+8) ^ seed);
+                s1 = _dictMum(_dictRead64(p+16) ^ DICT_FAST_P2,
+                              _dictRead64(p+24) ^ s1);
+                s2 = _dictMum(_dictRead64(p+32) ^ DICT_FAST_P3,
+                              _dictRead64(p+40) ^ s2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            seed ^= s1 ^ s2;
+        }
+        while (i > 16) {
+            seed = _dictMum(_dictRead64(p) ^ DICT_FAST_P1,
+                            _dictRead64(p+8) ^ seed);
+            p += 16;
+            i -= 16;
+        }
+        a = _dictRead64(p+i-16);
+        b = _dictRead64(p+i-8);
+    }
+
+    return _dictMum(DICT_FAST_P1 ^ (uint64_t)len,
+                    _dictMum(a ^ DICT_FAST_P1, b ^ seed));
+}
+
+/* ------------------------- Open addressing layout -------------------------
+ *
+ * 开放寻址的字典不为每个键分配 dictEntry ，节点直接保存在槽数组 slots 中，
+ * 槽（ dictSlot ）只有键和值，没有 next 指针，
+ * 另有一个控制字节数组 ctrl ，每个槽对应一个字节：
+ *
+ *  - DICT_CTRL_EMPTY   空槽，探测到这里就可以停止；
+ *  - DICT_CTRL_DELETED 已删除的槽，探测时跳过，插入时可以复用；
+ *  - 0 ~ 127           槽中有节点，值为节点哈希值的低 7 位。
+ *
+ * 槽按 DICT_GROUP_SIZE 个一组，探测以组为单位进行：
+ * 先用一条 SSE2 指令把整组控制字节和哈希值的低 7 位比较，
+ * 只有控制字节相同的槽才需要比较键，所以查找一个键通常只需访问一个组。
+ * 组内没有匹配、也没有空槽时，按三角数序列探测下一个组，
+ * 组的数量是 2 的幂，所以这个序列会访问到所有的组。
+ *
+ * 已用的槽加上已删除的槽超过 7/8 时扩展哈希表，扩展同样是渐进式的，
+ * 每次 rehash 步骤迁移 ht[0] 中的一个组。
+ *
+ * 因为节点保存在槽数组中，任何写操作都可能移动节点，
+ * 所以 dictFind 等只读操作不执行 rehash 步骤，它们返回的节点在下一次写操作之前有效。
+ */
+
+// 空槽
+#define DICT_CTRL_EMPTY 0x80
+// 已删除的槽
+#define DICT_CTRL_DELETED 0xFE
+// 判断控制字节对应的槽中是否有节点
+#define dictCtrlIsFull(c) (((c) & 0x80) == 0)
+
+// 每组的槽数量
+#define DICT_GROUP_SIZE 16
+// 开放寻址哈希表的最小大小
+#define DICT_OPEN_MIN_SIZE DICT_GROUP_SIZE
+
+// 把槽 idx 作为节点返回给调用者
+#define dictOpenEntry(ht, idx) ((dictEntry*)&(ht)->slots[idx])
+
+// 返回链表中的下一个节点，开放寻址的节点没有 next 属性，总是返回 NULL
+#define dictEntryNext(d, he) \
+    ((d)->layout == DICT_LAYOUT_OPEN ? NULL : (he)->next)
+
+// 用哈希值的高位选择组，低 7 位保存在控制字节中
+#define dictHashGroup(h) ((h) >> 7)
+#define dictHashTag(h) ((unsigned char)((h) & 0x7f))
+
+// 哈希表最多使用的槽数量（包括已删除的槽）
+#define dictOpenMaxLoad(ht) ((ht)->size - (ht)->size/8)
+
+/*
+ * 返回组中控制字节等于 c 的槽的位图，第 i 位对应组中的第 i 个槽
+ */
+static unsigned int _dictGroupMatch(const unsigned char *ctrl, unsigned char c) {
+#ifdef __SSE2__
+    __m128i group = _mm_loadu_si128((const __m128i*)ctrl);
+
+    return (unsigned int)_mm_movemask_epi8(
+        _mm_cmpeq_epi8(group,_mm_set1_epi8((char)c)));
+#else
+    unsigned int mask = 0;
+    int i;
+
+    for (i = 0; i < DICT_GROUP_SIZE; i++)
+        if (ctrl[i] == c) mask |= 1u << i;
+    return mask;
+#endif
+}
+
+/*
+ * 返回组中空槽和已删除的槽的位图
+ */
+static unsigned int _dictGroupMatchFree(const unsigned char *ctrl) {
+#ifdef __SSE2__
+    // 只有空槽和已删除的槽的最高位为 1
+    return (unsigned int)_mm_movemask_epi8(
+        _mm_loadu_si128((const __m128i*)ctrl));
+#else
+    unsigned int mask = 0;
+    int i;
+
+    for (i = 0; i < DICT_GROUP_SIZE; i++)
+        if (!dictCtrlIsFull(ctrl[i])) mask |= 1u << i;
+    return mask;
+#endif
+}
+
+/*
+ * 为开放寻址的哈希表 ht 分配 size 个槽
+ */
+static void _dictOpenInit(dictht *ht, unsigned long size) {
+    ht->table = NULL;
+    ht->ctrl = zmalloc(size);
+    memset(ht->ctrl,DICT_CTRL_EMPTY,size);
+    ht->slots = zmalloc(size*sizeof(dictSlot));
+    ht->size = size;
+    ht->sizemask = size-1;
+    ht->used = 0;
+    ht->deleted = 0;
+}
+
+/*
+ * 在开放寻址的哈希表 ht 中查找键 key ，h 为键的哈希值
+ *
+ * 找到时返回槽的索引，找不到返回 -1
+ */
+static long _dictOpenLookup(dict *d, dictht *ht, const void *key, uint64_t h) {
+    unsigned long groupmask, group, step;
+    unsigned char tag = dictHashTag(h);
+
+    if (ht->size == 0) return -1;
+
+    groupmask = ht->size/DICT_GROUP_SIZE - 1;
+    group = dictHashGroup(h) & groupmask;
+    for (step = 0; step <= groupmask; step++) {
+        unsigned char *ctrl = ht->ctrl + group*DICT_GROUP_SIZE;
+        unsigned int match = _dictGroupMatch(ctrl,tag);
+
+        // 只比较控制字节相同的槽
+        while (match) {
+            long idx = group*DICT_GROUP_SIZE + __builtin_ctz(match);
+
+            if (dictCompareKeys(d, key, ht->slots[idx].key)) return idx;
+            match &= match-1;
+        }
+
+        // 组中有空槽，说明插入时探测不会越过这个组
+        if (_dictGroupMatch(ctrl,DICT_CTRL_EMPTY)) return -1;
+
+        group = (group+step+1) & groupmask;
+    }
+    return -1;
+}
+
+/*
+ * 返回开放寻址的哈希表 ht 中，哈希值 h 的探测序列上第一个可用的槽
+ *
+ * 调用者需要保证哈希表中还有可用的槽
+ */
+static unsigned long _dictOpenFreeSlot(dictht *ht, uint64_t h) {
+    unsigned long groupmask = ht->size/DICT_GROUP_SIZE - 1;
+    unsigned long group = dictHashGroup(h) & groupmask, step = 0;
+
+    while (1) {
+        unsigned int free = _dictGroupMatchFree(ht->ctrl + group*DICT_GROUP_SIZE);
+
+        if (free) return group*DICT_GROUP_SIZE + __builtin_ctz(free);
+        group = (group+(++step)) & groupmask;
+    }
+}
+
+/*
+ * 把哈希值为 h 的节点放进开放寻址的哈希表 ht 中，返回节点所在的槽
+ */
+static dictSlot *_dictOpenInsert(dictht *ht, uint64_t h) {
+    unsigned long idx = _dictOpenFreeSlot(ht,h);
+
+    if (ht->ctrl[idx] == DICT_CTRL_DELETED) ht->deleted--;
+    ht->ctrl[idx] = dictHashTag(h);
+    ht->used++;
+    return &ht->slots[idx];
+}
+
+/*
+ * 清空开放寻址的哈希表 ht 中的槽 idx
+ */
+static void _dictOpenRemove(dictht *ht, unsigned long idx) {
+    unsigned char *ctrl = ht->ctrl + (idx & ~(unsigned long)(DICT_GROUP_SIZE-1));
+
+    // 组中还有空槽时，探测不会越过这个组，可以直接标记为空槽，
+    // 否则要标记为已删除，以免截断其他键的探测序列
+    if (_dictGroupMatch(ctrl,DICT_CTRL_EMPTY)) {
+        ht->ctrl[idx] = DICT_CTRL_EMPTY;
+    } else {
+        ht->ctrl[idx] = DICT_CTRL_DELETED;
+        ht->deleted++;
+    }
+    ht->used--;
+}
+
+/*
+ * 在开放寻址的字典中查找键 key ，h 为键的哈希值
+ *
+ * 找到时返回节点，并将节点所在的哈希表号码保存到 *table ，
+ * 将节点所在的槽保存到 *slot ，找不到返回 NULL
+ */
+static dictEntry *_dictOpenFind(dict *d, const void *key, uint64_t h,
+                                int *table, long *slot)
+{
+    int t;
+
+    for (t = 0; t <= 1; t++) {
+        long idx = _dictOpenLookup(d,&d->ht[t],key,h);
+
+        if (idx != -1) {
+            if (table) *table = t;
+            if (slot) *slot = idx;
+            return dictOpenEntry(&d->ht[t],idx);
+        }
+        if (!dictIsRehashing(d)) break;
+    }
+    return NULL;
+}
+
+/*
+ * 检查开放寻址的哈希表 ht 中的组 group 是否没有任何节点
+ */
+static int _dictOpenGroupIsEmpty(dictht *ht, unsigned long group) {
+    return _dictGroupMatchFree(ht->ctrl + group*DICT_GROUP_SIZE) ==
+           (1u << DICT_GROUP_SIZE)-1;
+}
+
+/*
+ * 将 ht[0] 中 rehashidx 指向的组迁移到 ht[1]
+ */
+static void _dictOpenRehashGroup(dict *d) {
+    dictht *from = &d->ht[0], *to = &d->ht[1];
+    unsigned long base = (unsigned long)d->rehashidx*DICT_GROUP_SIZE;
+    unsigned int full = ~_dictGroupMatchFree(from->ctrl+base) &
+                        ((1u << DICT_GROUP_SIZE)-1);
+
+    while (full) {
+        unsigned long idx = base + __builtin_ctz(full);
+        dictSlot *slot = &from->slots[idx];
+
+        *_dictOpenInsert(to,dictHashKey(d, slot->key)) = *slot;
+
+        // 组中剩下的节点可能越过这个组探测，所以要标记为已删除
+        from->ctrl[idx] = DICT_CTRL_DELETED;
+        from->deleted++;
+        from->used--;
+        full &= full-1;
+    }
+    d->rehashidx++;
+}
+
+/*
+ * 把正在 rehash 的字典的 1 号哈希表重建为能容纳整个字典的更大的哈希表
+ *
+ * 只移动 1 号哈希表中的节点，0 号哈希表和 rehash 的进度保持不变
+ */
+static void _dictOpenGrowTarget(dict *d) {
+    dictht *to = &d->ht[1], n;
+    unsigned long idx;
+
+    _dictOpenInit(&n,_dictNextPower((d->ht[0].used+to->used)*2));
+    for (idx = 0; idx < to->size; idx++) {
+        dictSlot *slot = &to->slots[idx];
+
+        if (!dictCtrlIsFull(to->ctrl[idx])) continue;
+        *_dictOpenInsert(&n,dictHashKey(d, slot->key)) = *slot;
+    }
+    zfree(to->ctrl);
+    zfree(to->slots);
+    *to = n;
 }
 
-/* MurmurHash2, by Austin Appleby
- * Note - This code makes a few assumptions about how your machine behaves -
- * 1. We can read a 4-byte value from any address without crashing
- * 2. sizeof(int) == 4
+/* ------------------------- Concurrent readers -----------------------------
+ *
+ * 用 dictCreateConcurrent() 创建的字典允许一个写线程修改字典的同时，
+ * 多个读线程不加锁地调用 dictFind ：
+ *
+ *   dictReadBegin();
+ *   de = dictFind(d,key);
+ *   ... 使用 de 的键和值 ...
+ *   dictReadEnd();
+ *
+ * 写线程对链表的修改都用 release 写入发布，读线程用 acquire 读取，
+ * 所以读线程看到的节点总是已经设置好键和值的完整节点。
  *
- * And it has a few limitations -
+ * 被删除的节点、被替换的值、rehash 完成后的旧哈希表数组都不会立即释放，
+ * 而是放进字典的 retired 链表，标上当时的全局纪元（epoch）。
+ * 每个读线程进入读区间时记录当时的纪元，
+ * 只有比所有正在读的线程的纪元都旧的内存才会被 dictReclaim() 释放，
+ * 因此读线程在读区间内拿到的指针一直有效，离开读区间之后就不能再使用了。
+ *
+ * rehash 迁移一个桶时，节点会被逐个移到 1 号哈希表，
+ * 同时在 0 号哈希表上查找的读线程可能会跟着节点走到 1 号哈希表的链表上，
+ * 错过还留在 0 号哈希表的节点。迁移期间 rehashseq 为奇数，
+ * 读线程找不到键时检查 rehashseq 是否变过，变过就重新查找。
+ *
+ * 并发读只支持链地址法的字典，只有 dictFind 可以在读线程中调用，
+ * 其他函数（包括迭代器）只能由写线程调用。
+ */
+
+/* 一个读线程的状态，独占一个缓存行，避免读线程之间互相干扰
  *
- * 1. It will not work incrementally.
- * 2. It will not produce the same results on little-endian and big-endian
- *    machines.
+ * 线程第一次进入读区间时占用一个空闲的槽，线程退出时由 pthread 键的析构函数归还，
+ * 所以 DICT_MAX_READERS 限制的是同时存在的读线程数量，而不是总共创建过的线程数量。 */
+typedef struct dictReader {
+    // 进入读区间时的纪元，为 0 表示不在读区间内
+    uint64_t epoch;
+    // 槽是否被某个线程占用
+    int used;
+    char pad[64-sizeof(uint64_t)-sizeof(int)];
+} dictReader;
+
+static dictReader dict_readers[DICT_MAX_READERS];
+// 被占用过的槽的最大索引加一，dictReclaim 只需检查这些槽
+static int dict_readers_count = 0;
+// 线程退出时归还读线程槽
+static pthread_key_t dict_reader_key;
+static pthread_once_t dict_reader_once = PTHREAD_ONCE_INIT;
+// 全局纪元，从 1 开始
+static uint64_t dict_epoch = 1;
+
+// 当前线程使用的读线程槽，以及读区间的嵌套深度
+static __thread int dict_reader_slot = -1;
+static __thread int dict_read_depth = 0;
+
+/* 发布给读线程的哈希表数组，每次数组改变时整体替换 */
+typedef struct dictView {
+    dictEntry **table[2];
+    unsigned long sizemask[2];
+} dictView;
+
+/* 等待回收的内存 */
+#define DICT_RETIRE_ENTRY 0         // 节点，连同它的键和值
+#define DICT_RETIRE_ENTRY_NOFREE 1  // 只释放节点本身（来自内存池）
+#define DICT_RETIRE_VAL 2           // 被 dictReplace 替换掉的值
+#define DICT_RETIRE_TABLE 3         // 哈希表数组
+#define DICT_RETIRE_VIEW 4          // 旧的 dictView
+#define DICT_RETIRE_HT 5            // 被 dictEmpty 清空的整个哈希表
+#define DICT_RETIRE_EMBEDDED_NOFREE 6 // 只释放嵌入了键的节点本身（来自 zmalloc）
+
+typedef struct dictRetired {
+    struct dictRetired *next;
+    uint64_t epoch;
+    int kind;
+    void *ptr;
+    dictht ht;                      // 只在 DICT_RETIRE_HT 时使用
+} dictRetired;
+
+/* retired 链表积累到这个长度时，自动尝试回收 */
+#define DICT_RECLAIM_BATCH 128
+
+#define dictAtomicGet(p) __atomic_load_n(&(p),__ATOMIC_ACQUIRE)
+#define dictAtomicSet(p,v) __atomic_store_n(&(p),(v),__ATOMIC_RELEASE)
+
+/*
+ * 线程退出时归还它的读线程槽，arg 为槽的索引加一
+ */
+static void dictReaderRelease(void *arg) {
+    dictReader *r = &dict_readers[(long)arg-1];
+
+    __atomic_store_n(&r->epoch,0,__ATOMIC_RELEASE);
+    __atomic_store_n(&r->used,0,__ATOMIC_RELEASE);
+}
+
+static void dictReaderKeyInit(void) {
+    pthread_key_create(&dict_reader_key,dictReaderRelease);
+}
+
+/*
+ * 为当前线程占用一个空闲的读线程槽，返回槽的索引
+ */
+static int dictReaderClaim(void) {
+    int j;
+
+    pthread_once(&dict_reader_once,dictReaderKeyInit);
+    for (j = 0; j < DICT_MAX_READERS; j++) {
+        int expected = 0, count;
+
+        if (__atomic_load_n(&dict_readers[j].used,__ATOMIC_RELAXED)) continue;
+        if (!__atomic_compare_exchange_n(&dict_readers[j].used,&expected,1,0,
+                __ATOMIC_ACQ_REL,__ATOMIC_RELAXED)) continue;
+
+        // 在记录纪元之前让 dictReclaim 能看到这个槽
+        count = __atomic_load_n(&dict_readers_count,__ATOMIC_SEQ_CST);
+        while (count <= j &&
+               !__atomic_compare_exchange_n(&dict_readers_count,&count,j+1,0,
+                    __ATOMIC_SEQ_CST,__ATOMIC_SEQ_CST));
+
+        pthread_setspecific(dict_reader_key,(void*)(long)(j+1));
+        return j;
+    }
+    assert(!"too many concurrent dict reader threads");
+    return -1;
+}
+
+/*
+ * 当前线程进入读区间，可以嵌套
+ */
+void dictReadBegin(void) {
+    uint64_t epoch;
+    dictReader *r;
+
+    if (dict_read_depth++ > 0) return;
+
+    if (dict_reader_slot == -1) dict_reader_slot = dictReaderClaim();
+    r = &dict_readers[dict_reader_slot];
+
+    // 记录纪元之后要确认全局纪元没有在这期间前进，
+    // 否则写线程可能已经按照前进之前的读线程状态回收了内存
+    do {
+        epoch = __atomic_load_n(&dict_epoch,__ATOMIC_ACQUIRE);
+        __atomic_store_n(&r->epoch,epoch,__ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    } while (epoch != __atomic_load_n(&dict_epoch,__ATOMIC_ACQUIRE));
+}
+
+/*
+ * 当前线程离开读区间，之后不能再使用读区间内取得的节点
+ */
+void dictReadEnd(void) {
+    assert(dict_read_depth > 0);
+    if (--dict_read_depth > 0) return;
+
+    __atomic_store_n(&dict_readers[dict_reader_slot].epoch,0,__ATOMIC_RELEASE);
+}
+
+/*
+ * 将 ptr 放进字典的 retired 链表，等所有可能看到它的读线程离开读区间之后再释放
+ */
+static void _dictRetire(dict *d, int kind, void *ptr, dictht *ht) {
+    dictRetired *r = zmalloc(sizeof(*r));
+
+    r->epoch = __atomic_load_n(&dict_epoch,__ATOMIC_SEQ_CST);
+    r->kind = kind;
+    r->ptr = ptr;
+    if (ht) r->ht = *ht;
+    r->next = d->retired;
+    d->retired = r;
+
+    if (++d->retiredCount >= DICT_RECLAIM_BATCH) dictReclaim(d);
+}
+
+/*
+ * 释放一个 retired 节点
  */
-unsigned int dictGenHashFunction(const void *key, int len) {
-	/* 'm' and 'r' are mixing constants generated offline.
-	They're not really 'magic', they just happen to work well.  */
-	uint32_t seed = dict_hash_function_seed;
-	const uint32_t m = 0x5bd1e995;
-	const int r = 24;
+static void _dictFreeRetired(dict *d, dictRetired *r) {
+    dictEntry *he = r->ptr;
 
-	/* Initialize the hash to a 'random' value */
-	uint32_t h = seed ^ len;
+    switch (r->kind) {
+    case DICT_RETIRE_ENTRY:
+        _dictFreeEntry(d,he,0);
+        break;
+    case DICT_RETIRE_ENTRY_NOFREE:
+        zpoolFree(ZPOOL_DICT_ENTRY,he);
+        break;
+    case DICT_RETIRE_EMBEDDED_NOFREE:
+    case DICT_RETIRE_TABLE:
+    case DICT_RETIRE_VIEW:
+        zfree(r->ptr);
+        break;
+    case DICT_RETIRE_VAL:
+        if (d->type->valDestructor)
+            d->type->valDestructor(d->privdata, r->ptr);
+        break;
+    case DICT_RETIRE_HT:
+        _dictClear(d,&r->ht,NULL);
+        break;
+    }
+    zfree(r);
+}
 
-	/* Mix 4 bytes at a time into the hash */
-	const unsigned char *data = (const unsigned char *)key;
+/*
+ * 推进全局纪元，释放字典中所有读线程都已经看不到的内存
+ *
+ * 只能由写线程调用，retired 链表较长时会自动调用，
+ * 写入停止之后也可以由定时任务调用，尽快归还内存。
+ */
+void dictReclaim(dict *d) {
+    dictRetired **pr, *r;
+    uint64_t min;
+    int j, count;
 
-	while (len >= 4) {
-		uint32_t k = *(uint32_t*)data;
+    if (!d->retired) return;
 
-		k *= m;
-		k ^= k >> r;
-		k *= m;
+    // 推进纪元，之后进入读区间的线程都看不到已经放进 retired 链表的内存
+    min = __atomic_add_fetch(&dict_epoch,1,__ATOMIC_SEQ_CST);
 
-		h *= m;
-		h ^= k;
+    // 找出仍在读区间内的线程中最旧的纪元
+    count = __atomic_load_n(&dict_readers_count,__ATOMIC_SEQ_CST);
+    for (j = 0; j < count; j++) {
+        uint64_t epoch = __atomic_load_n(&dict_readers[j].epoch,__ATOMIC_SEQ_CST);
 
-		data += 4;
-		len -= 4;
-	}
+        if (epoch && epoch < min) min = epoch;
+    }
 
-	/* Handle the last few bytes of the input array  */
-	switch (len) {
-	case 3: h ^= data[2] << 16;
-	case 2: h ^= data[1] << 8;
-	case 1: h ^= data[0]; h *= m;
-	};
+    // 释放比它更旧的内存
+    pr = &d->retired;
+    while ((r = *pr) != NULL) {
+        if (r->epoch < min) {
+            *pr = r->next;
+            _dictFreeRetired(d,r);
+            d->retiredCount--;
+        } else {
+            pr = &r->next;
+        }
+    }
+}
 
-	/* Do a few final mixes of the hash to ensure the last few
-	* bytes are well-incorporated. */
-	h ^= h >> 13;
-	h *= m;
-	h ^= h >> 15;
+/*
+ * 将字典当前的哈希表数组发布给读线程，旧的 dictView 等待回收
+ */
+static void _dictPublishView(dict *d) {
+    dictView *v = zmalloc(sizeof(*v)), *old = d->view;
+    int table;
 
-	return (unsigned int)h;
+    for (table = 0; table <= 1; table++) {
+        v->table[table] = d->ht[table].table;
+        v->sizemask[table] = d->ht[table].sizemask;
+    }
+    dictAtomicSet(d->view,v);
+    if (old) _dictRetire(d,DICT_RETIRE_VIEW,old,NULL);
 }
 
-/* And a case insensitive hash function (based on djb hash) */
-unsigned int dictGenCaseHashFunction(const unsigned char *buf, int len) {
-	unsigned int hash = (unsigned int)dict_hash_function_seed;
+/*
+ * 读线程使用的 dictFind ，不执行 rehash
+ */
+static dictEntry *_dictConcurrentFind(dict *d, const void *key) {
+    uint64_t h = dictHashKey(d, key);
+
+    for (;;) {
+        unsigned long seq = dictAtomicGet(d->rehashseq);
+        dictView *v;
+        int table;
 
-	while (len--)
-		hash = ((hash << 5) + hash) + (tolower(*buf++)); /* hash * 33 + c */
-	return hash;
+        // 写线程正在迁移桶，等它完成
+        if (seq & 1) continue;
+
+        v = dictAtomicGet(d->view);
+        for (table = 0; v && table <= 1; table++) {
+            dictEntry *he;
+
+            if (v->table[table] == NULL) continue;
+            he = dictAtomicGet(v->table[table][h & v->sizemask[table]]);
+            while (he) {
+                if (dictCompareKeys(d, key, he->key)) return he;
+                he = dictAtomicGet(he->next);
+            }
+        }
+
+        // 查找期间没有发生迁移，可以确定键不存在
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&d->rehashseq,__ATOMIC_RELAXED) == seq)
+            return NULL;
+    }
 }
 
 /* ----------------------------- API implementation ------------------------- */
@@ -141,9 +748,12 @@ unsigned int dictGenCaseHashFunction(const unsigned char *buf, int len) {
  */
 static void _dictReset(dictht *ht) {
      ht->table = NULL;
+     ht->ctrl = NULL;
+     ht->slots = NULL;
      ht->size = 0;
      ht->sizemask = 0;
      ht->used = 0;
+     ht->deleted = 0;
  }
 
 /*
@@ -154,33 +764,1890 @@ static void _dictReset(dictht *ht) {
 dict *dictCreate(dictType *type, 
     void *privDataPtr) {
     dict *d = zmalloc(sizeof(*d));
-    //pause
-                     
+
+    _dictInit(d,type,privDataPtr);
+
+    return d;
+}
+
+/*
+ * 创建一个新的开放寻址的字典
+ *
+ * 节点直接保存在槽数组中，每个键少一次内存分配和一次指针跳转，
+ * 适合数据库键空间这样只用 dictFind/dictAdd/dictDelete 访问的大字典
+ *
+ * T = o(1)
+ */
+dict *dictCreateOpen(dictType *type, void *privDataPtr) {
+    dict *d = dictCreate(type,privDataPtr);
+
+    d->layout = DICT_LAYOUT_OPEN;
+
+    return d;
+}
+
+/*
+ * 创建一个允许多个线程并发读取的字典，见 Concurrent readers
+ *
+ * T = o(1)
+ */
+dict *dictCreateConcurrent(dictType *type, void *privDataPtr) {
+    dict *d = dictCreate(type,privDataPtr);
+
+    d->concurrent = 1;
+
+    return d;
+}
+
+/*
+ * 初始化哈希表
+ *
+ * T = O(1)
+ */
+static int _dictInit(dict *d, dictType *type,
+        void *privDataPtr)
+{
+    // 初始化两个哈希表的各项属性值
+    // 但暂时还不分配内存给哈希表数组
+    _dictReset(&d->ht[0]);
+    _dictReset(&d->ht[1]);
+
+    // 设置类型特定函数
+    d->type = type;
+
+    // 设置私有数据
+    d->privdata = privDataPtr;
+
+    // 设置哈希表 rehash 状态
+    d->rehashidx = -1;
+
+    // 设置字典的安全迭代器数量
+    d->iterators = 0;
+
+    // 默认使用链地址法
+    d->layout = DICT_LAYOUT_CHAINED;
+
+    // 默认不允许并发读
+    d->concurrent = 0;
+    d->view = NULL;
+    d->rehashseq = 0;
+    d->retired = NULL;
+    d->retiredCount = 0;
+
+    return DICT_OK;
+}
+
+/* Resize the table to the minimal size that contains all the elements,
+ * but with the invariant of a USED/BUCKETS ratio near to <= 1 
+ *
+ * 缩小给定字典
+ * 让它的已用节点数和字典大小之间的比率接近 1:1
+ *
+ * 返回 DICT_ERR 表示字典已经在 rehash ，或者 dict_can_resize 为假。
+ *
+ * 成功创建体积更小的 ht[1] ，可以开始 resize 时，返回 DICT_OK。
+ *
+ * T = O(N)
+ */
+int dictResize(dict *d)
+{
+    int minimal;
+
+    // 不能在关闭 rehash 或者正在 rehash 的时候调用
+    if (!__atomic_load_n(&dict_can_resize,__ATOMIC_RELAXED) ||
+        dictIsRehashing(d)) return DICT_ERR;
+
+    // 计算让比率接近 1：1 所需要的最少节点数量
+    minimal = d->ht[0].used;
+    if (minimal < DICT_HT_INITIAL_SIZE)
+        minimal = DICT_HT_INITIAL_SIZE;
+
+    // 调整字典的大小
+    return dictExpand(d, minimal);
+}
+
+/*
+ * 字典的使用率低于 DICT_HT_MIN_FILL% 时，缩小字典
+ *
+ * 扩展在使用率达到 100% 时进行（开放寻址为 7/8），两个阈值相差 10 倍，
+ * 大量键被删除之后哈希表可以归还内存，又不会在扩展和缩小之间来回切换。
+ *
+ * 和 dictResize 一样受 dict_can_resize 控制，
+ * 有子进程在保存数据时不缩小，以免 rehash 触发大量写时复制。
+ *
+ * 开始缩小时返回 DICT_OK ，否则返回 DICT_ERR 。
+ *
+ * T = O(N)
+ */
+int dictShrinkIfNeeded(dict *d) {
+    unsigned long size = d->ht[0].size;
+    unsigned long minsize = d->layout == DICT_LAYOUT_OPEN ?
+                            DICT_OPEN_MIN_SIZE : DICT_HT_INITIAL_SIZE;
+
+    if (!__atomic_load_n(&dict_can_resize,__ATOMIC_RELAXED) ||
+        dictIsRehashing(d)) return DICT_ERR;
+    if (size <= minsize || d->ht[0].used*100/size >= DICT_HT_MIN_FILL)
+        return DICT_ERR;
+
+    return dictResize(d);
 }
 
+/* Expand or create the hash table 
+ *
+ * 创建一个新的哈希表，并根据字典的情况，选择以下其中一个动作来进行：
+ *
+ * 1) 如果字典的 0 号哈希表为空，那么将新哈希表设置为 0 号哈希表
+ * 2) 如果字典的 0 号哈希表非空，那么将新哈希表设置为 1 号哈希表，
+ *    并打开字典的 rehash 标识，使得程序可以开始对字典进行 rehash
+ *
+ * size 参数不够大，或者 rehash 已经在进行时，返回 DICT_ERR 。
+ *
+ * 成功创建 0 号哈希表，或者 1 号哈希表时，返回 DICT_OK 。
+ *
+ * T = O(N)
+ */
+int dictExpand(dict *d, unsigned long size)
+{
+    // 新哈希表
+    dictht n; /* the new hash table */
+
+    // 根据 size 参数，计算哈希表的大小
+    // T = O(1)
+    unsigned long realsize = _dictNextPower(size);
+
+    /* the size is invalid if it is smaller than the number of
+     * elements already inside the hash table */
+    // 不能在字典正在 rehash 时进行
+    // size 的值也不能小于 0 号哈希表的当前已使用节点
+    if (dictIsRehashing(d) || d->ht[0].used > size)
+        return DICT_ERR;
 
+    if (d->layout == DICT_LAYOUT_OPEN) {
+        // 开放寻址的哈希表不能装满，留出 1/8 的空槽
+        if (realsize < DICT_OPEN_MIN_SIZE) realsize = DICT_OPEN_MIN_SIZE;
+        while (realsize - realsize/8 <= d->ht[0].used) realsize *= 2;
 
+        // 大小不变时，只有在需要清理已删除的槽时才 rehash
+        if (realsize == d->ht[0].size && d->ht[0].deleted == 0)
+            return DICT_ERR;
 
+        _dictOpenInit(&n,realsize);
+    } else {
+        /* Allocate the new hash table and initialize all pointers to NULL */
+        // 为哈希表分配空间，并将所有指针指向 NULL
+        n.size = realsize;
+        n.sizemask = realsize-1;
+        // T = O(N)
+        n.table = zcalloc(realsize*sizeof(dictEntry*));
+        n.ctrl = NULL;
+        n.slots = NULL;
+        n.used = 0;
+        n.deleted = 0;
+    }
 
+    /* Is this the first initialization? If so it's not really a rehashing
+     * we just set the first hash table so that it can accept keys. */
+    // 如果 0 号哈希表为空，那么这是一次初始化：
+    // 程序将新哈希表赋给 0 号哈希表的指针，然后字典就可以开始处理键值对了。
+    if (d->ht[0].size == 0) {
+        d->ht[0] = n;
+        if (d->concurrent) _dictPublishView(d);
+        return DICT_OK;
+    }
 
+    /* Prepare a second hash table for incremental rehashing */
+    // 如果 0 号哈希表非空，那么这是一次 rehash ：
+    // 程序将新哈希表设置为 1 号哈希表，
+    // 并将字典的 rehash 标识打开，让程序可以开始对字典进行 rehash
+    d->ht[1] = n;
+    d->rehashidx = 0;
+    if (d->concurrent) _dictPublishView(d);
+    return DICT_OK;
+}
 
+/*
+ * 释放链地址法的节点 he ，nofree 为假时同时调用键和值的释放函数
+ *
+ * 嵌入了键的节点由 zmalloc 分配，其他节点来自内存池，
+ * 所以要在释放键之前判断节点是否嵌入了键。
+ */
+static void _dictFreeEntry(dict *d, dictEntry *he, int nofree) {
+    int embedded = dictIsEmbeddedKey(d, he->key);
 
+    if (!nofree) {
+        dictFreeKey(d, he);
+        dictFreeVal(d, he);
+    }
+    if (embedded)
+        zfree(he);
+    else
+        zpoolFree(ZPOOL_DICT_ENTRY,he);
+}
 
+/*
+ * 释放哈希表 ht 的数组
+ */
+static void _dictFreeTable(dictht *ht) {
+    zfree(ht->table);
+    zfree(ht->ctrl);
+    zfree(ht->slots);
+}
 
+/* Performs N steps of incremental rehashing. Returns 1 if there are still
+ * keys to move from the old to the new hash table, otherwise 0 is returned.
+ *
+ * 执行 N 步渐进式 rehash 。
+ *
+ * 返回 1 表示仍有键需要从 0 号哈希表移动到 1 号哈希表，
+ * 返回 0 则表示所有键都已经迁移完毕。
+ *
+ * Note that a rehashing step consists in moving a bucket (that may have more
+ * than one key as we use chaining) from the old to the new hash table.
+ *
+ * 注意，每步 rehash 都是以一个哈希表索引（桶）作为单位的，
+ * 一个桶里可能会有多个节点，
+ * 被 rehash 的桶里的所有节点都会被移动到新哈希表。
+ * 开放寻址的字典每步迁移一个组。
+ *
+ * Since part of the hash table may be composed of empty spaces, it is not
+ * guaranteed that this function will rehash even a single bucket, since it
+ * will visit at max N*10 empty buckets in total, otherwise the amount of
+ * work it does would be unbound and the function may block for a long time.
+ *
+ * 哈希表中可能有大段连续的空桶，所以每次调用最多只访问 N*10 个空桶，
+ * 以免在稀疏的大表上一次调用阻塞很长时间。
+ *
+ * T = O(N)
+ */
+int dictRehash(dict *d, int n) {
+    int empty_visits = n*10; /* Max number of empty buckets to visit. */
 
+    // 只可以在 rehash 进行中时执行
+    if (!dictIsRehashing(d)) return 0;
 
+    // 进行 N 步迁移
+    // T = O(N)
+    while(n--) {
+        dictEntry *de, *nextde;
 
+        /* Check if we already rehashed the whole table... */
+        // 如果 0 号哈希表为空，那么表示 rehash 执行完毕
+        // T = O(1)
+        if (d->ht[0].used == 0) {
+            // 释放 0 号哈希表
+            // 并发读的字典要等读线程不再使用旧数组之后才能释放
+            if (d->concurrent)
+                _dictRetire(d,DICT_RETIRE_TABLE,d->ht[0].table,NULL);
+            else
+                _dictFreeTable(&d->ht[0]);
+            // 将原来的 1 号哈希表设置为新的 0 号哈希表
+            d->ht[0] = d->ht[1];
+            // 重置旧的 1 号哈希表
+            _dictReset(&d->ht[1]);
+            // 关闭 rehash 标识
+            d->rehashidx = -1;
+            if (d->concurrent) _dictPublishView(d);
+            // 返回 0 ，向调用者表示 rehash 已经完成
+            return 0;
+        }
 
+        if (d->layout == DICT_LAYOUT_OPEN) {
+            assert(d->ht[0].size/DICT_GROUP_SIZE > (unsigned)d->rehashidx);
+            while (_dictOpenGroupIsEmpty(&d->ht[0],d->rehashidx)) {
+                d->rehashidx++;
+                if (--empty_visits == 0) return 1;
+            }
+            _dictOpenRehashGroup(d);
+            continue;
+        }
 
+        /* Note that rehashidx can't overflow as we are sure there are more
+         * elements because ht[0].used != 0 */
+        // 确保 rehashidx 没有越界
+        assert(d->ht[0].size > (unsigned)d->rehashidx);
 
+        // 略过数组中为空的索引，找到下一个非空索引
+        while(d->ht[0].table[d->rehashidx] == NULL) {
+            d->rehashidx++;
+            if (--empty_visits == 0) return 1;
+        }
 
+        // 迁移期间 rehashseq 为奇数，让没找到键的读线程重新查找
+        if (d->concurrent)
+            __atomic_store_n(&d->rehashseq,d->rehashseq+1,__ATOMIC_SEQ_CST);
 
+        // 指向该索引的链表表头节点
+        de = d->ht[0].table[d->rehashidx];
+        /* Move all the keys in this bucket from the old to the new hash HT */
+        // 将链表中的所有节点迁移到新哈希表
+        // T = O(1)
+        while(de) {
+            unsigned long h;
 
+            // 保存下个节点的指针
+            nextde = de->next;
 
+            /* Get the index in the new hash table */
+            // 计算新哈希表的哈希值，以及节点插入的索引位置
+            h = dictHashKey(d, de->key) & d->ht[1].sizemask;
 
+            // 插入节点到新哈希表
+            dictAtomicSet(de->next,d->ht[1].table[h]);
+            dictAtomicSet(d->ht[1].table[h],de);
 
+            // 更新计数器
+            d->ht[0].used--;
+            d->ht[1].used++;
 
+            // 继续处理下个节点
+            de = nextde;
+        }
+        // 将刚迁移完的哈希表索引的指针设为空
+        dictAtomicSet(d->ht[0].table[d->rehashidx],NULL);
+        if (d->concurrent)
+            __atomic_store_n(&d->rehashseq,d->rehashseq+1,__ATOMIC_RELEASE);
+        // 更新 rehash 索引
+        d->rehashidx++;
+    }
 
+    return 1;
+}
 
+/*
+ * 返回以微秒为单位的 UNIX 时间戳
+ *
+ * T = O(1)
+ */
+static long long timeInMicroseconds(void) {
+    struct timeval tv;
 
+    gettimeofday(&tv,NULL);
+    return (((long long)tv.tv_sec)*1000000)+tv.tv_usec;
+}
 
+/* Rehash for an amount of time between ms milliseconds and ms+1 milliseconds 
+ *
+ * 在给定毫秒数内，以 100 步为单位，对字典进行 rehash 。
+ *
+ * 每 100 步最多访问 1000 个空桶，所以两次检查时间之间的工作量是有上限的，
+ * 实际花费的时间不会明显超过 ms 毫秒。
+ *
+ * 字典有安全迭代器时不进行 rehash ，返回 0 。
+ *
+ * 返回执行的 rehash 步数。
+ *
+ * T = O(N)
+ */
+int dictRehashMilliseconds(dict *d, int ms) {
+    // 记录开始时间
+    long long start = timeInMicroseconds();
+    int rehashes = 0;
+    // 开放寻址的字典每步迁移一个组，每次少走几步，
+    // 让两次检查时间之间迁移的节点数量和链地址法相近
+    int steps = d->layout == DICT_LAYOUT_OPEN ? 100/DICT_GROUP_SIZE : 100;
+
+    if (d->iterators) return 0;
+
+    while(dictRehash(d,steps)) {
+        rehashes += steps;
+        // 如果时间已过，跳出
+        if (timeInMicroseconds()-start >= (long long)ms*1000) break;
+    }
+
+    return rehashes;
+}
+
+/* This function performs just a step of rehashing, and only if there are
+ * no safe iterators bound to our hash table. When we have iterators in the
+ * middle of a rehashing we can't mess with the two hash tables otherwise
+ * some element can be missed or duplicated.
+ *
+ * 在字典不存在安全迭代器的情况下，对字典进行单步 rehash 。
+ *
+ * 字典有安全迭代器的情况下不能进行 rehash ，
+ * 因为两种不同的迭代和修改操作可能会弄乱字典。
+ *
+ * This function is called by common lookup or update operations in the
+ * dictionary so that the hash table automatically migrates from H1 to H2
+ * while it is actively used. 
+ *
+ * 这个函数被多个通用的查找、更新操作调用，
+ * 它可以让字典在被使用的同时进行 rehash 。
+ *
+ * T = O(1)
+ */
+static void _dictRehashStep(dict *d) {
+    if (d->iterators == 0) dictRehash(d,1);
+}
+
+/* Add an element to the target hash table 
+ *
+ * 尝试将给定键值对添加到字典中
+ *
+ * 只有给定键 key 不存在于字典时，添加操作才会成功
+ *
+ * 添加成功返回 DICT_OK ，失败返回 DICT_ERR
+ *
+ * 最坏 T = O(N) ，平滩 O(1) 
+ */
+int dictAdd(dict *d, void *key, void *val)
+{
+    // 尝试添加键到字典，并返回包含了这个键的新哈希节点
+    // 值在节点链接进哈希表之前设置，并发读的线程不会看到没有值的节点
+    // T = O(N)
+    dictEntry *entry = _dictAddRaw(d,key,1,val);
+
+    // 键已存在，添加失败
+    if (!entry) return DICT_ERR;
+
+    // 添加成功
+    return DICT_OK;
+}
+
+/* Low level add. This function adds the entry but instead of setting
+ * a value returns the dictEntry structure to the user, that will make
+ * sure to fill the value field as he wishes.
+ *
+ * 尝试将键插入到字典中
+ *
+ * 如果键已经在字典存在，那么返回 NULL
+ *
+ * 如果键不存在，那么程序创建新的哈希节点，
+ * 将节点和键关联，并插入到字典，然后返回节点本身。
+ *
+ * T = O(N)
+ */
+dictEntry *dictAddRaw(dict *d, void *key)
+{
+    return _dictAddRaw(d,key,0,NULL);
+}
+
+/*
+ * dictAddRaw 和 dictAdd 的实现
+ *
+ * setval 为真时，在新节点链接进哈希表之前将值设置为 val ，
+ * 否则值为 NULL ，由调用者稍后设置。
+ */
+static dictEntry *_dictAddRaw(dict *d, void *key, int setval, void *val)
+{
+    long index;
+    dictEntry *entry;
+    dictht *ht;
+    size_t embedlen;
+
+    // 如果条件允许的话，进行单步 rehash
+    // T = O(1)
+    if (dictIsRehashing(d)) _dictRehashStep(d);
+
+    if (d->layout == DICT_LAYOUT_OPEN) {
+        uint64_t h = dictHashKey(d, key);
+
+        // 先检查键是否已经存在，添加已有的键不应该触发扩展
+        if (_dictOpenFind(d,key,h,NULL,NULL)) return NULL;
+        if (_dictExpandIfNeeded(d) == DICT_ERR) return NULL;
+
+        // 正在 rehash 时，新节点总是放进 1 号哈希表
+        ht = dictIsRehashing(d) ? &d->ht[1] : &d->ht[0];
+        entry = (dictEntry*)_dictOpenInsert(ht,h);
+        dictSetKey(d, entry, key);
+        if (setval) dictSetVal(d, entry, val);
+        return entry;
+    }
+
+    /* Get the index of the new element, or -1 if
+     * the element already exists. */
+    // 计算键在哈希表中的索引值
+    // 如果值为 -1 ，那么表示键已经存在
+    // T = O(N)
+    if ((index = _dictKeyIndex(d, key)) == -1)
+        return NULL;
+
+    // T = O(1)
+    /* Allocate the memory and store the new entry */
+    // 如果字典正在 rehash ，那么将新键添加到 1 号哈希表
+    // 否则，将新键添加到 0 号哈希表
+    ht = dictIsRehashing(d) ? &d->ht[1] : &d->ht[0];
+    // 为新节点分配空间，嵌入的键紧跟在节点后面
+    // 不嵌入键的节点大小固定，从内存池中分配
+    embedlen = d->type->keyEmbedLen ? d->type->keyEmbedLen(key) : 0;
+    if (embedlen)
+        entry = zmalloc(sizeof(*entry)+embedlen);
+    else
+        entry = zpoolAlloc(ZPOOL_DICT_ENTRY,sizeof(*entry));
+
+    /* Set the hash entry fields. */
+    // 设置新节点的键和值
+    // T = O(1)
+    if (embedlen) {
+        entry->key = d->type->keyEmbed(entry+1,key);
+        // 原来的键归字典所有，已经复制过了，不再需要
+        if (!d->type->keyDup && d->type->keyDestructor)
+            d->type->keyDestructor(d->privdata,key);
+    } else {
+        dictSetKey(d, entry, key);
+    }
+    if (setval)
+        dictSetVal(d, entry, val);
+    else
+        entry->v.val = NULL;
+
+    // 将新节点插入到链表表头
+    entry->next = ht->table[index];
+    dictAtomicSet(ht->table[index],entry);
+    // 更新哈希表已使用节点数量
+    ht->used++;
+
+    return entry;
+}
+
+/* Add an element, discarding the old if the key already exists.
+ *
+ * 将给定的键值对添加到字典中，如果键已经存在，那么删除旧有的键值对。
+ *
+ * Return 1 if the key was added from scratch, 0 if there was already an
+ * element with such key and dictReplace() just performed a value update
+ * operation. 
+ *
+ * 如果键值对为全新添加，那么返回 1 。
+ * 如果键值对是通过对原有的键值对更新得来的，那么返回 0 。
+ *
+ * T = O(N)
+ */
+int dictReplace(dict *d, void *key, void *val)
+{
+    dictEntry *entry;
+    dictSlot auxentry;
+
+    /* Try to add the element. If the key
+     * does not exists dictAdd will suceed. */
+    // 尝试直接将键值对添加到字典
+    // 如果键 key 不存在的话，添加会成功
+    // T = O(N)
+    if (dictAdd(d, key, val) == DICT_OK)
+        return 1;
+
+    /* It already exists, get the entry */
+    // 运行到这里，说明键 key 已经存在，那么找出包含这个 key 的节点
+    // T = O(1)
+    entry = dictFind(d, key);
+    /* Set the new value and free the old one. Note that it is important
+     * to do that in this order, as the value may just be exactly the same
+     * as the previous one. In this context, think to reference counting,
+     * you want to increment (set), and then decrement (free), and not the
+     * reverse. */
+    // 先保存原有的值的指针
+    // 开放寻址的字典返回的是槽，只能复制键和值，不能整个复制节点
+    auxentry.key = entry->key;
+    auxentry.v.val = entry->v.val;
+    // 并发读的字典中，读线程可能还在使用旧值，新值发布之后旧值稍后释放
+    if (d->concurrent) {
+        dictAtomicSet(entry->v.val, d->type->valDup ?
+            d->type->valDup(d->privdata, val) : val);
+        _dictRetire(d,DICT_RETIRE_VAL,auxentry.v.val,NULL);
+        return 0;
+    }
+    // 然后设置新的值
+    // T = O(1)
+    dictSetVal(d, entry, val);
+    // 然后释放旧值
+    // T = O(1)
+    dictFreeVal(d, &auxentry);
+
+    return 0;
+}
+
+/* dictReplaceRaw() is simply a version of dictAddRaw() that always
+ * returns the hash entry of the specified key, even if the key already
+ * exists and can't be added (in that case the entry of the already
+ * existing key is returned.)
+ *
+ * See dictAddRaw() for more information. 
+ *
+ * dictAddRaw() 根据给定 key 释放存在，执行以下动作：
+ *
+ * 1) key 已经存在，返回包含该 key 的字典节点
+ * 2) key 不存在，那么将 key 添加到字典
+ *
+ * 不论发生以上的哪一种情况，
+ * dictAddRaw() 都总是返回包含给定 key 的字典节点。
+ *
+ * T = O(N)
+ */
+dictEntry *dictReplaceRaw(dict *d, void *key) {
+    
+    // 使用 key 在字典中查找节点
+    // T = O(1)
+    dictEntry *entry = dictFind(d,key);
+
+    // 如果节点找到了直接返回节点，否则添加并返回一个新节点
+    // T = O(N)
+    return entry ? entry : dictAddRaw(d,key);
+}
+
+/* Search and remove an element 
+ *
+ * 查找并删除包含给定键的节点
+ *
+ * 参数 nofree 决定是否调用键和值的释放函数
+ * 0 表示调用，1 表示不调用
+ *
+ * 找到并成功删除返回 DICT_OK ，没找到则返回 DICT_ERR
+ *
+ * T = O(1)
+ */
+static int dictGenericDelete(dict *d, const void *key, int nofree)
+{
+    uint64_t h;
+    unsigned long idx;
+    dictEntry *he, *prevHe;
+    int table;
+
+    // 字典（的哈希表）为空
+    if (d->ht[0].size == 0) return DICT_ERR; /* d->ht[0].table is NULL */
+
+    // 进行单步 rehash ，T = O(1)
+    if (dictIsRehashing(d)) _dictRehashStep(d);
+
+    // 计算哈希值
+    h = dictHashKey(d, key);
+
+    if (d->layout == DICT_LAYOUT_OPEN) {
+        long slot;
+
+        he = _dictOpenFind(d,key,h,&table,&slot);
+        if (!he) return DICT_ERR;
+        if (!nofree) {
+            dictFreeKey(d, he);
+            dictFreeVal(d, he);
+        }
+        _dictOpenRemove(&d->ht[table],slot);
+        return DICT_OK;
+    }
+
+    // 遍历哈希表
+    // T = O(1)
+    for (table = 0; table <= 1; table++) {
+
+        // 计算索引值 
+        idx = h & d->ht[table].sizemask;
+        // 指向该索引上的链表
+        he = d->ht[table].table[idx];
+        prevHe = NULL;
+        // 遍历链表上的所有节点
+        // T = O(1)
+        while(he) {
+        
+            if (dictCompareKeys(d, key, he->key)) {
+                // 超找目标节点
+
+                /* Unlink the element from the list */
+                // 从链表中删除
+                if (prevHe)
+                    dictAtomicSet(prevHe->next,he->next);
+                else
+                    dictAtomicSet(d->ht[table].table[idx],he->next);
+
+                if (d->concurrent) {
+                    int kind = DICT_RETIRE_ENTRY;
+
+                    // 调用者可能在回收之前释放键，所以现在就要判断节点是否嵌入了键
+                    if (nofree)
+                        kind = dictIsEmbeddedKey(d, he->key) ?
+                               DICT_RETIRE_EMBEDDED_NOFREE :
+                               DICT_RETIRE_ENTRY_NOFREE;
+                    // 读线程可能还停留在这个节点上，稍后释放
+                    _dictRetire(d, kind, he, NULL);
+                    d->ht[table].used--;
+                    return DICT_OK;
+                }
+
+                // 释放节点本身，nofree 决定是否调用键和值的释放函数
+                _dictFreeEntry(d,he,nofree);
+
+                // 更新已使用节点数量
+                d->ht[table].used--;
+
+                // 返回已找到信号
+                return DICT_OK;
+            }
+
+            prevHe = he;
+            he = he->next;
+        }
+
+        // 如果执行到这里，说明在 0 号哈希表中找不到给定键
+        // 那么根据字典是否正在进行 rehash ，决定要不要查找 1 号哈希表
+        if (!dictIsRehashing(d)) break;
+    }
+
+    // 没找到
+    return DICT_ERR; /* not found */
+}
+
+/*
+ * 从字典中删除包含给定键的节点
+ * 
+ * 并且调用键值的释放函数来删除键值
+ *
+ * 找到并成功删除返回 DICT_OK ，没找到则返回 DICT_ERR
+ * T = O(1)
+ */
+int dictDelete(dict *ht, const void *key) {
+    if (dictGenericDelete(ht,key,0) == DICT_ERR) return DICT_ERR;
+
+    // 删除之后使用率可能过低
+    dictShrinkIfNeeded(ht);
+    return DICT_OK;
+}
+
+/*
+ * 从字典中删除包含给定键的节点
+ * 
+ * 但不调用键值的释放函数来删除键值
+ *
+ * 找到并成功删除返回 DICT_OK ，没找到则返回 DICT_ERR
+ * T = O(1)
+ */
+int dictDeleteNoFree(dict *ht, const void *key) {
+    if (dictGenericDelete(ht,key,1) == DICT_ERR) return DICT_ERR;
+
+    dictShrinkIfNeeded(ht);
+    return DICT_OK;
+}
+
+/* Destroy an entire dictionary
+ *
+ * 删除哈希表上的所有节点，并重置哈希表的各项属性
+ *
+ * T = O(N)
+ */
+static int _dictClear(dict *d, dictht *ht, void(callback)(void *)) {
+    unsigned long i;
+
+    /* Free all the elements */
+    // 遍历整个哈希表
+    // T = O(N)
+    for (i = 0; i < ht->size && ht->used > 0; i++) {
+        dictEntry *he, *nextHe;
+
+        if (callback && (i & 65535) == 0) callback(d->privdata);
+
+        if (d->layout == DICT_LAYOUT_OPEN) {
+            if (!dictCtrlIsFull(ht->ctrl[i])) continue;
+            he = dictOpenEntry(ht,i);
+            dictFreeKey(d, he);
+            dictFreeVal(d, he);
+            ht->used--;
+            continue;
+        }
+
+        // 跳过空索引
+        if ((he = ht->table[i]) == NULL) continue;
+
+        // 遍历整个链表
+        // T = O(1)
+        while(he) {
+            nextHe = he->next;
+            // 删除键和值，释放节点
+            _dictFreeEntry(d,he,0);
+
+            // 更新已使用节点计数
+            ht->used--;
+
+            // 处理下个节点
+            he = nextHe;
+        }
+    }
+
+    /* Free the table and the allocated cache structure */
+    // 释放哈希表结构
+    _dictFreeTable(ht);
+
+    /* Re-initialize the table */
+    // 重置哈希表属性
+    _dictReset(ht);
+
+    return DICT_OK; /* never fails */
+}
+
+/* Clear & Release the hash table */
+/*
+ * 删除并释放整个字典
+ *
+ * T = O(N)
+ */
+void dictRelease(dict *d)
+{
+    // 释放字典时不能再有读线程，等待回收的内存可以直接释放
+    while (d->retired) {
+        dictRetired *r = d->retired;
+
+        d->retired = r->next;
+        _dictFreeRetired(d,r);
+    }
+    zfree(d->view);
+
+    // 删除并清空两个哈希表
+    _dictClear(d,&d->ht[0],NULL);
+    _dictClear(d,&d->ht[1],NULL);
+    // 释放节点结构
+    zfree(d);
+}
+
+/*
+ * 返回字典中包含键 key 的节点
+ *
+ * 找到返回节点，找不到返回 NULL
+ *
+ * T = O(1)
+ */
+dictEntry *dictFind(dict *d, const void *key)
+{
+    dictEntry *he;
+    uint64_t h;
+    unsigned long idx;
+    int table;
+
+    // 并发读的字典可能同时被多个线程查找，查找不能读写 ht 中的任何属性
+    if (d->concurrent) return _dictConcurrentFind(d,key);
+
+    /* We don't have a table at all */
+    // 字典（的哈希表）为空
+    if (d->ht[0].size == 0) return NULL; /* We don't have a table at all */
+
+    // 开放寻址的字典在只读操作中不 rehash ，以免移动调用者手中的节点
+    if (d->layout == DICT_LAYOUT_OPEN)
+        return _dictOpenFind(d,key,dictHashKey(d, key),NULL,NULL);
+
+    // 如果条件允许的话，进行单步 rehash
+    if (dictIsRehashing(d)) _dictRehashStep(d);
+
+    // 计算键的哈希值
+    h = dictHashKey(d, key);
+    // 在字典的哈希表中查找这个键
+    // T = O(1)
+    for (table = 0; table <= 1; table++) {
+
+        // 计算索引值
+        idx = h & d->ht[table].sizemask;
+
+        // 遍历给定索引上的链表的所有节点，查找 key
+        he = d->ht[table].table[idx];
+        // T = O(1)
+        while(he) {
+
+            if (dictCompareKeys(d, key, he->key))
+                return he;
+
+            he = he->next;
+        }
+
+        // 如果程序遍历完 0 号哈希表，仍然没找到指定的键的节点
+        // 那么程序会检查字典是否在进行 rehash ，
+        // 然后才决定是直接返回 NULL ，还是继续查找 1 号哈希表
+        if (!dictIsRehashing(d)) return NULL;
+    }
+
+    // 进行到这里时，说明两个哈希表都没找到
+    return NULL;
+}
+
+/* 预取 addr 所在的缓存行 */
+#if defined(__GNUC__)
+#define dictPrefetch(addr) __builtin_prefetch(addr)
+#else
+#define dictPrefetch(addr) ((void)(addr))
+#endif
+
+/*
+ * 批量查找 keys 中的 n 个键，包含 keys[i] 的节点保存在 out[i] 中，
+ * 找不到的键对应 NULL 。
+ *
+ * 逐个调用 dictFind 时，每次查找都要依次等待桶（或控制字节）、节点和键的缓存未命中。
+ * 这里每次处理 DICT_FIND_MANY_BATCH 个键，分阶段进行：
+ *
+ *  1) 计算所有键的哈希值，预取它们的桶（开放寻址时为控制字节组）；
+ *  2) 读取桶中的第一个节点（开放寻址时为第一个哈希值匹配的槽），预取节点；
+ *  3) 预取节点的键；
+ *  4) 按正常流程比较键，这时需要的数据大多已经在缓存中了。
+ *
+ * 这样多个键的内存访问可以重叠进行。结果和逐个调用 dictFind 相同，
+ * 但整批查找最多只执行一步 rehash 。
+ *
+ * 返回找到的键的数量。
+ */
+int dictFindMany(dict *d, const void **keys, int n, dictEntry **out) {
+    uint64_t hashes[DICT_FIND_MANY_BATCH];
+    dictEntry *first[DICT_FIND_MANY_BATCH];
+    int found = 0, base;
+
+    if (n <= 0) return 0;
+    // 并发读的字典逐个查找
+    if (d->concurrent) {
+        int j;
+
+        for (j = 0; j < n; j++)
+            if ((out[j] = dictFind(d,keys[j])) != NULL) found++;
+        return found;
+    }
+    if (d->ht[0].size == 0) {
+        memset(out,0,sizeof(dictEntry*)*n);
+        return 0;
+    }
+
+    // 开放寻址的字典在只读操作中不 rehash
+    if (d->layout == DICT_LAYOUT_CHAINED && dictIsRehashing(d))
+        _dictRehashStep(d);
+
+    for (base = 0; base < n; base += DICT_FIND_MANY_BATCH) {
+        int count = n-base < DICT_FIND_MANY_BATCH ? n-base : DICT_FIND_MANY_BATCH;
+        const void **bkeys = keys+base;
+        dictEntry **bout = out+base;
+        int j, table;
+
+        // 1) 计算哈希值，预取 0 号哈希表（以及正在 rehash 时 1 号哈希表）的桶
+        for (j = 0; j < count; j++) {
+            hashes[j] = dictHashKey(d, bkeys[j]);
+            for (table = 0; table <= dictIsRehashing(d); table++) {
+                dictht *ht = &d->ht[table];
+
+                if (d->layout == DICT_LAYOUT_OPEN)
+                    dictPrefetch(ht->ctrl + (dictHashGroup(hashes[j]) &
+                        (ht->size/DICT_GROUP_SIZE-1))*DICT_GROUP_SIZE);
+                else
+                    dictPrefetch(&ht->table[hashes[j] & ht->sizemask]);
+            }
+        }
+
+        // 2) 找到 0 号哈希表中可能包含键的第一个节点，预取节点
+        for (j = 0; j < count; j++) {
+            dictht *ht = &d->ht[0];
+
+            first[j] = NULL;
+            if (d->layout == DICT_LAYOUT_OPEN) {
+                unsigned long group = dictHashGroup(hashes[j]) &
+                                      (ht->size/DICT_GROUP_SIZE-1);
+                unsigned int match = _dictGroupMatch(
+                    ht->ctrl+group*DICT_GROUP_SIZE,dictHashTag(hashes[j]));
+
+                if (match)
+                    first[j] = dictOpenEntry(ht,group*DICT_GROUP_SIZE +
+                                                 __builtin_ctz(match));
+            } else {
+                first[j] = ht->table[hashes[j] & ht->sizemask];
+            }
+            if (first[j]) dictPrefetch(first[j]);
+        }
+
+        // 3) 预取节点的键
+        for (j = 0; j < count; j++)
+            if (first[j]) dictPrefetch(first[j]->key);
+
+        // 4) 完成查找
+        for (j = 0; j < count; j++) {
+            if (d->layout == DICT_LAYOUT_OPEN) {
+                bout[j] = _dictOpenFind(d,bkeys[j],hashes[j],NULL,NULL);
+            } else {
+                dictEntry *he = NULL;
+
+                for (table = 0; table <= 1; table++) {
+                    he = d->ht[table].table[hashes[j] & d->ht[table].sizemask];
+                    while (he) {
+                        if (dictCompareKeys(d, bkeys[j], he->key)) break;
+                        he = he->next;
+                    }
+                    if (he || !dictIsRehashing(d)) break;
+                }
+                bout[j] = he;
+            }
+            if (bout[j]) found++;
+        }
+    }
+
+    return found;
+}
+
+/*
+ * 获取包含给定键的节点的值
+ *
+ * 如果节点不为空，返回节点的值
+ * 否则返回 NULL
+ *
+ * T = O(1)
+ */
+void *dictFetchValue(dict *d, const void *key) {
+    dictEntry *he;
+
+    // T = O(1)
+    he = dictFind(d,key);
+
+    return he ? dictGetVal(he) : NULL;
+}
+
+/* ------------------------------ Iterators --------------------------------- */
+
+/*
+ * 返回哈希表 ht 中索引 i 上的第一个节点，没有节点时返回 NULL
+ *
+ * 链地址法的索引是桶，返回链表的表头；
+ * 开放寻址的索引是槽，槽中只有一个节点，用 dictEntryNext 取下一个节点。
+ * 这样随机采样的代码可以用同一个循环处理两种存储方式。
+ */
+static dictEntry *_dictSlotEntry(dict *d, dictht *ht, unsigned long i) {
+    if (d->layout == DICT_LAYOUT_OPEN)
+        return dictCtrlIsFull(ht->ctrl[i]) ? dictOpenEntry(ht,i) : NULL;
+    return ht->table[i];
+}
+
+/*
+ * 计算字典的指纹
+ *
+ * A fingerprint is a 64 bit number that represents the state of the dictionary
+ * at a given time, it's just a few dict properties xored together.
+ * When an unsafe iterator is initialized, we get the dict fingerprint, and check
+ * the fingerprint again when the iterator is released.
+ * If the two fingerprints are different it means that the user of the iterator
+ * performed forbidden operations against the dictionary while iterating.
+ *
+ * 指纹由哈希表数组的地址、大小和已使用节点数量计算得出，
+ * 不安全迭代器在开始迭代时记录指纹，释放时再次计算并比较，
+ * 两次结果不同说明迭代期间字典被修改了。
+ */
+long long dictFingerprint(dict *d) {
+    long long integers[6], hash = 0;
+    int j;
+
+    // 开放寻址的哈希表没有 table 数组，用控制字节数组的地址代替
+    integers[0] = (long) (d->ht[0].table ? (void*)d->ht[0].table : (void*)d->ht[0].ctrl);
+    integers[1] = d->ht[0].size;
+    integers[2] = d->ht[0].used;
+    integers[3] = (long) (d->ht[1].table ? (void*)d->ht[1].table : (void*)d->ht[1].ctrl);
+    integers[4] = d->ht[1].size;
+    integers[5] = d->ht[1].used;
+
+    /* We hash N integers by summing every successive integer with the integer
+     * hashing of the previous sum. Basically:
+     *
+     * Result = hash(hash(hash(int1)+int2)+int3) ...
+     *
+     * This way the same set of integers in a different order will (likely) hash
+     * to a different number. */
+    for (j = 0; j < 6; j++) {
+        hash += integers[j];
+        /* For the hashing step we use Tomas Wang's 64 bit integer hash. */
+        hash = (~hash) + (hash << 21); // hash = (hash << 21) - hash - 1;
+        hash = hash ^ (hash >> 24);
+        hash = (hash + (hash << 3)) + (hash << 8); // hash * 265
+        hash = hash ^ (hash >> 14);
+        hash = (hash + (hash << 2)) + (hash << 4); // hash * 21
+        hash = hash ^ (hash >> 28);
+        hash = hash + (hash << 31);
+    }
+    return hash;
+}
+
+/*
+ * 创建并返回给定字典的不安全迭代器
+ *
+ * 迭代期间不能修改字典，释放迭代器时会检查字典的指纹
+ *
+ * T = O(1)
+ */
+dictIterator *dictGetIterator(dict *d)
+{
+    dictIterator *iter = zmalloc(sizeof(*iter));
+
+    iter->d = d;
+    iter->table = 0;
+    iter->index = -1;
+    iter->safe = 0;
+    iter->entry = NULL;
+    iter->nextEntry = NULL;
+    iter->fingerprint = 0;
+
+    return iter;
+}
+
+/*
+ * 创建并返回给定节点的安全迭代器
+ *
+ * 迭代期间可以对字典执行添加、删除和查找，字典不会进行 rehash ，
+ * 所以迭代开始时已经存在、并且没有被删除的节点都会被返回恰好一次。
+ *
+ * 开放寻址的字典在 rehash 期间 1 号哈希表装满时，1 号哈希表会被重建得更大，
+ * 0 号哈希表不受影响。已经开始迭代 1 号哈希表的迭代器这时可能遗漏或重复返回
+ * 1 号哈希表中的节点，还在迭代 0 号哈希表的迭代器不受影响。
+ *
+ * T = O(1)
+ */
+dictIterator *dictGetSafeIterator(dict *d) {
+    dictIterator *i = dictGetIterator(d);
+
+    // 设置安全迭代器标识
+    i->safe = 1;
+
+    return i;
+}
+
+/*
+ * 返回迭代器指向的当前节点
+ *
+ * 字典迭代完毕时，返回 NULL
+ *
+ * 链地址法逐个遍历桶中的链表，开放寻址逐个遍历槽，
+ * 两种存储方式都由 _dictSlotEntry 取出索引上的第一个节点。
+ *
+ * T = O(1)
+ */
+dictEntry *dictNext(dictIterator *iter)
+{
+    while (1) {
+
+        // 进入这个循环有两种可能：
+        // 1) 这是迭代器第一次运行
+        // 2) 当前索引链表中的节点已经迭代完（NULL 为链表的表尾）
+        if (iter->entry == NULL) {
+
+            // 指向被迭代的哈希表
+            dictht *ht = &iter->d->ht[iter->table];
+
+            // 初次迭代时执行
+            if (iter->index == -1 && iter->table == 0) {
+                // 如果是安全迭代器，那么更新安全迭代器计数器
+                if (iter->safe)
+                    iter->d->iterators++;
+                // 如果是不安全迭代器，那么计算指纹
+                else
+                    iter->fingerprint = dictFingerprint(iter->d);
+            }
+            // 更新索引
+            iter->index++;
+
+            // 如果迭代器的当前索引大于当前被迭代的哈希表的大小
+            // 那么说明这个哈希表已经迭代完毕
+            if (iter->index >= (signed) ht->size) {
+                // 如果正在 rehash 的话，那么说明 1 号哈希表也正在使用中
+                // 那么继续对 1 号哈希表进行迭代
+                if (dictIsRehashing(iter->d) && iter->table == 0) {
+                    iter->table++;
+                    iter->index = 0;
+                    ht = &iter->d->ht[1];
+                // 如果没有 rehash ，那么说明迭代已经完成
+                } else {
+                    break;
+                }
+            }
+
+            // 如果进行到这里，说明这个哈希表并未迭代完
+            // 更新节点指针，指向下个索引链表的表头节点
+            iter->entry = _dictSlotEntry(iter->d,ht,iter->index);
+        } else {
+            // 执行到这里，说明程序正在迭代某个链表
+            // 将节点指针指向链表的下个节点
+            iter->entry = iter->nextEntry;
+        }
+
+        // 如果当前节点不为空，那么也记录下该节点的下个节点
+        // 因为安全迭代器有可能会将迭代器返回的当前节点删除
+        if (iter->entry) {
+            /* We need to save the 'next' here, the iterator user
+             * may delete the entry we are returning. */
+            iter->nextEntry = dictEntryNext(iter->d,iter->entry);
+            return iter->entry;
+        }
+    }
+
+    // 迭代完毕
+    return NULL;
+}
+
+/*
+ * 从迭代器中取出最多 count 个节点保存到 des 中，返回取出的节点数量，
+ * 为 0 表示迭代完毕。
+ *
+ * 和逐个调用 dictNext 的结果相同，但取出的同时预取了节点的键，
+ * 调用者处理一批节点时，后面几个节点的键已经在加载中了。
+ *
+ * 使用安全迭代器时，可以删除本批返回的任何节点。
+ *
+ * T = O(count)
+ */
+int dictNextBatch(dictIterator *iter, dictEntry **des, int count) {
+    dictEntry *de;
+    int n = 0;
+
+    while (n < count && (de = dictNext(iter)) != NULL) {
+        dictPrefetch(de->key);
+        des[n++] = de;
+    }
+
+    return n;
+}
+
+/*
+ * 释放给定字典迭代器
+ *
+ * 不安全迭代器在这里检查迭代期间字典是否被修改过
+ *
+ * T = O(1)
+ */
+void dictReleaseIterator(dictIterator *iter)
+{
+
+    if (!(iter->index == -1 && iter->table == 0)) {
+        // 释放安全迭代器时，安全迭代器计数器减一
+        if (iter->safe)
+            iter->d->iterators--;
+        // 释放不安全迭代器时，验证指纹是否有变化
+        else
+            assert(iter->fingerprint == dictFingerprint(iter->d));
+    }
+    zfree(iter);
+}
+
+/* --------------------------- Random sampling ------------------------------ */
+
+/*
+ * 返回 rehash 时 0 号哈希表中已经迁移完毕的索引数量，
+ * 这些索引上不会有节点
+ */
+static unsigned long _dictRehashedSlots(dict *d) {
+    if (!dictIsRehashing(d)) return 0;
+    if (d->layout == DICT_LAYOUT_OPEN)
+        return (unsigned long)d->rehashidx*DICT_GROUP_SIZE;
+    return d->rehashidx;
+}
+
+/* Return a random entry from the hash table. Useful to
+ * implement randomized algorithms 
+ *
+ * 随机返回字典中任意一个节点。
+ *
+ * 可用于实现随机化算法。
+ *
+ * 如果字典为空，返回 NULL 。
+ *
+ * 链地址法先随机选出一个非空的桶，再从链表中随机选一个节点，
+ * 所以长链表中的节点被选中的概率偏低，需要更均匀的结果时使用 dictGetFairRandomKey 。
+ *
+ * T = O(N)
+ */
+dictEntry *dictGetRandomKey(dict *d)
+{
+    dictEntry *he, *orighe;
+    unsigned long h, skip;
+    int listlen, listele;
+
+    // 字典为空
+    if (dictSize(d) == 0) return NULL;
+
+    // 进行单步 rehash
+    if (dictIsRehashing(d)) _dictRehashStep(d);
+
+    // 如果正在 rehash ，那么将 1 号哈希表也作为随机查找的目标
+    if (dictIsRehashing(d)) {
+        // 0 号哈希表中已经迁移的部分不会有节点，跳过
+        skip = _dictRehashedSlots(d);
+        // T = O(N)
+        do {
+            h = skip + random() % (d->ht[0].size + d->ht[1].size - skip);
+            he = (h >= d->ht[0].size) ?
+                 _dictSlotEntry(d,&d->ht[1],h - d->ht[0].size) :
+                 _dictSlotEntry(d,&d->ht[0],h);
+        } while(he == NULL);
+    // 否则，只从 0 号哈希表中查找节点
+    } else {
+        // T = O(N)
+        do {
+            h = random() & d->ht[0].sizemask;
+            he = _dictSlotEntry(d,&d->ht[0],h);
+        } while(he == NULL);
+    }
+
+    /* Now we found a non empty bucket, but it is a linked
+     * list and we need to get a random element from the list.
+     * The only sane way to do so is counting the elements and
+     * select a random index. */
+    // 目前 he 已经指向一个非空的节点链表
+    // 程序将从这个链表随机返回一个节点
+    listlen = 0;
+    orighe = he;
+    // 计算节点数量, T = O(1)
+    while(he) {
+        he = dictEntryNext(d,he);
+        listlen++;
+    }
+    // 取模，得出随机节点的索引
+    listele = random() % listlen;
+    he = orighe;
+    // 按索引查找节点
+    // T = O(1)
+    while(listele--) he = dictEntryNext(d,he);
+
+    // 返回随机节点
+    return he;
+}
+
+/* This function samples the dictionary to return a few keys from random
+ * locations.
+ *
+ * 从字典中随机取出最多 count 个节点，保存到 des 数组中，返回取出的节点数量。
+ *
+ * 它不保证返回的节点各不相同、也不保证恰好返回 count 个节点，
+ * 但比调用 count 次 dictGetRandomKey 快得多：
+ * 从哈希表中的一个随机位置开始，连续收集相邻的桶（或槽）中的节点，
+ * 正在 rehash 时同时收集两个哈希表中对应索引上的节点，
+ * 游标超出较小的哈希表时按它的大小回绕。
+ *
+ * 连续遇到的空桶数量超过 count（至少为 5）时，跳到另一个随机位置，
+ * 以免在稀疏的哈希表上一直走空桶；
+ * 整个过程最多访问 count*10 个索引，所以耗时是有上限的。
+ *
+ * 返回的节点在字典被修改之前有效。
+ *
+ * T = O(count)
+ */
+int dictGetRandomKeys(dict *d, dictEntry **des, int count) {
+    unsigned long j; /* internal hash table id, 0 or 1. */
+    unsigned long tables; /* 1 or 2 tables? */
+    unsigned long stored = 0, maxsizemask;
+    unsigned long maxsteps;
+    unsigned long i, emptylen = 0, rehashed;
+
+    if (count <= 0) return 0;
+    if (dictSize(d) < (unsigned long)count) count = dictSize(d);
+    maxsteps = (unsigned long)count*10;
+
+    /* Try to do a rehashing work proportional to 'count'. */
+    // 进行和 count 成比例的 rehash
+    for (j = 0; j < (unsigned long)count; j++) {
+        if (dictIsRehashing(d))
+            _dictRehashStep(d);
+        else
+            break;
+    }
+
+    tables = dictIsRehashing(d) ? 2 : 1;
+    maxsizemask = d->ht[0].sizemask;
+    if (tables > 1 && maxsizemask < d->ht[1].sizemask)
+        maxsizemask = d->ht[1].sizemask;
+    rehashed = _dictRehashedSlots(d);
+
+    /* Pick a random point inside the larger table. */
+    // 在较大的哈希表中选择一个随机的起点
+    i = random() & maxsizemask;
+    while(stored < (unsigned long)count && maxsteps--) {
+        for (j = 0; j < tables; j++) {
+            // 游标和各个哈希表自己的掩码相与，
+            // 扩展时游标超出较小的哈希表的部分不会白白浪费步数
+            unsigned long idx = i & d->ht[j].sizemask;
+            dictEntry *he;
+
+            /* Invariant of the dict.c rehashing: up to the indexes already
+             * visited in ht[0] during the rehashing, there are no populated
+             * buckets, so we can skip ht[0] for indexes between 0 and idx-1. */
+            // 0 号哈希表中已经迁移的部分不会有节点
+            if (tables == 2 && j == 0 && idx < rehashed) continue;
+            he = _dictSlotEntry(d,&d->ht[j],idx);
+
+            /* Count contiguous empty buckets, and jump to other
+             * locations if they reach 'count' (with a minimum of 5). */
+            if (he == NULL) {
+                emptylen++;
+                if (emptylen >= 5 && emptylen > (unsigned long)count) {
+                    i = random() & maxsizemask;
+                    emptylen = 0;
+                }
+            } else {
+                emptylen = 0;
+                while (he) {
+                    /* Collect all the elements of the buckets found non
+                     * empty while iterating. */
+                    *des = he;
+                    des++;
+                    he = dictEntryNext(d,he);
+                    stored++;
+                    if (stored == (unsigned long)count) return stored;
+                }
+            }
+        }
+        i = (i+1) & maxsizemask;
+    }
+    return stored;
+}
+
+/*
+ * 比 dictGetRandomKey 更均匀地随机返回一个节点
+ *
+ * 先用 dictGetRandomKeys 采样 DICT_FAIR_RANDOM_SAMPLE 个节点，再从中随机选一个，
+ * 链表长度对节点被选中的概率影响小得多。
+ * 采样没有得到节点时（例如哈希表非常稀疏），退回 dictGetRandomKey 。
+ *
+ * T = O(1)
+ */
+dictEntry *dictGetFairRandomKey(dict *d) {
+    dictEntry *entries[DICT_FAIR_RANDOM_SAMPLE];
+    int count = dictGetRandomKeys(d,entries,DICT_FAIR_RANDOM_SAMPLE);
+
+    if (count == 0) return dictGetRandomKey(d);
+    return entries[random() % count];
+}
+
+/* ------------------------------- Scan ------------------------------------ */
+
+/* Function to reverse bits. Algorithm from:
+ * http://graphics.stanford.edu/~seander/bithacks.html#ReverseParallel */
+static unsigned long rev(unsigned long v) {
+    unsigned long s = 8 * sizeof(v); // bit size; must be power of 2
+    unsigned long mask = ~0;
+    while ((s >>= 1) > 0) {
+        mask ^= (mask << s);
+        v = ((v >> s) & mask) | ((v << s) & ~mask);
+    }
+    return v;
+}
+
+/*
+ * 一次遍历的状态，dictScan 逐个调用 fn ，dictScanBatch 把节点攒起来批量交给 batchfn
+ */
+typedef struct dictScanState {
+    dictScanFunction *fn;
+    dictScanBatchFunction *batchfn;
+    void *privdata;
+    dictEntry *batch[DICT_SCAN_BATCH];
+    int count;          // batch 中的节点数量
+    long emitted;       // 本次调用已经遍历的节点数量
+} dictScanState;
+
+/*
+ * 把 batch 中的节点交给回调函数
+ */
+static void _dictScanFlush(dictScanState *s) {
+    if (s->count == 0) return;
+    s->batchfn(s->privdata,s->batch,s->count);
+    s->count = 0;
+}
+
+/*
+ * 遍历到一个节点
+ */
+static void _dictScanEmit(dictScanState *s, dictEntry *de) {
+    s->emitted++;
+    if (s->fn) {
+        s->fn(s->privdata,de);
+        return;
+    }
+
+    // 回调函数通常要读取键，在攒够一批之前先预取
+    dictPrefetch(de->key);
+    s->batch[s->count++] = de;
+    if (s->count == DICT_SCAN_BATCH) _dictScanFlush(s);
+}
+
+/*
+ * 返回哈希表 ht 中参与游标计算的掩码：
+ * 链地址法为桶的掩码，开放寻址为组的掩码
+ */
+static unsigned long _dictScanMask(dict *d, dictht *ht) {
+    if (d->layout == DICT_LAYOUT_OPEN) return ht->size/DICT_GROUP_SIZE-1;
+    return ht->sizemask;
+}
+
+/*
+ * 遍历哈希表 ht 中哈希值（和掩码相与之后）等于 idx 的所有节点
+ *
+ * 开放寻址的节点不一定在自己的组中，所以要沿着组 idx 的探测序列查找，
+ * 直到遇到有空槽的组为止（和 _dictOpenLookup 的停止条件相同），
+ * 只遍历那些哈希值对应组 idx 的节点。
+ * 这样每个节点只在游标等于它的组时被遍历，和链地址法的桶一样。
+ */
+static void _dictScanBucket(dict *d, dictht *ht, unsigned long idx,
+                            dictScanState *s)
+{
+    if (d->layout == DICT_LAYOUT_OPEN) {
+        unsigned long groupmask = ht->size/DICT_GROUP_SIZE-1;
+        unsigned long group = idx, step;
+
+        for (step = 0; step <= groupmask; step++) {
+            unsigned char *ctrl = ht->ctrl + group*DICT_GROUP_SIZE;
+            unsigned int full = ~_dictGroupMatchFree(ctrl) &
+                                ((1u << DICT_GROUP_SIZE)-1);
+
+            while (full) {
+                dictEntry *de = dictOpenEntry(ht,group*DICT_GROUP_SIZE +
+                                                 __builtin_ctz(full));
+
+                if ((dictHashGroup(dictHashKey(d, de->key)) & groupmask) == idx)
+                    _dictScanEmit(s,de);
+                full &= full-1;
+            }
+            if (_dictGroupMatch(ctrl,DICT_CTRL_EMPTY)) break;
+            group = (group+step+1) & groupmask;
+        }
+    } else {
+        dictEntry *de = ht->table[idx], *next;
+
+        while (de) {
+            next = de->next;
+            _dictScanEmit(s,de);
+            de = next;
+        }
+    }
+}
+
+/*
+ * dictScan 和 dictScanBatch 的实现，遍历游标 v 指向的桶，返回下一个游标
+ */
+static unsigned long _dictScan(dict *d, unsigned long v, dictScanState *s) {
+    dictht *t0, *t1;
+    unsigned long m0, m1;
+
+    // 跳过空字典
+    if (dictSize(d) == 0) return 0;
+
+    // 迭代只有一个哈希表的字典
+    if (!dictIsRehashing(d)) {
+        t0 = &(d->ht[0]);
+        m0 = _dictScanMask(d,t0);
+
+        /* Emit entries at cursor */
+        _dictScanBucket(d,t0,v & m0,s);
+
+    // 迭代有两个哈希表的字典
+    } else {
+        // 指向两个哈希表，让 t0 指向较小的那个
+        t0 = &d->ht[0];
+        t1 = &d->ht[1];
+
+        /* Make sure t0 is the smaller and t1 is the bigger table */
+        if (t0->size > t1->size) {
+            t0 = &d->ht[1];
+            t1 = &d->ht[0];
+        }
+
+        m0 = _dictScanMask(d,t0);
+        m1 = _dictScanMask(d,t1);
+
+        /* Emit entries at cursor */
+        // 遍历小表中游标指向的桶
+        _dictScanBucket(d,t0,v & m0,s);
+
+        /* Iterate over indices in larger table that are the expansion
+         * of the index pointed to by the cursor in the smaller table */
+        // 遍历大表中由小表的这个桶扩展出来的所有桶
+        do {
+            /* Emit entries at cursor */
+            _dictScanBucket(d,t1,v & m1,s);
+
+            /* Increment bits not covered by the smaller mask */
+            v = (((v | m0) + 1) & ~m0) | (v & m0);
+
+            /* Continue while bits covered by mask difference is non-zero */
+        } while (v & (m0 ^ m1));
+    }
+
+    /* Set unmasked bits so incrementing the reversed cursor
+     * operates on the masked bits of the smaller table */
+    v |= ~m0;
+
+    /* Increment the reverse cursor */
+    // 对游标的高位进行加一
+    v = rev(v);
+    v++;
+    v = rev(v);
+
+    return v;
+}
+
+/* dictScan() is used to iterate over the elements of a dictionary.
+ *
+ * dictScan() 函数用于迭代给定字典中的元素。
+ *
+ * 迭代按以下方式执行：
+ *
+ * 1)  一开始，你使用 0 作为游标来调用函数。
+ * 2)  函数执行一步迭代操作，
+ *     并返回一个下次迭代时使用的新游标。
+ * 3)  当函数返回的游标为 0 时，迭代完成。
+ *
+ * 函数保证，在迭代从开始到结束期间，一直存在于字典的元素肯定会被迭代到，
+ * 但一个元素可能会被返回多次。
+ *
+ * 每当一个元素被返回时，回调函数 fn 就会被执行，
+ * fn 函数的第一个参数是 privdata ，而第二个参数则是字典节点 de 。
+ *
+ * 工作原理
+ *
+ * 迭代所使用的算法是由 Pieter Noordhuis 设计的，
+ * 算法的主要思路是在二进制高位上对游标进行加法计算，
+ * 也即是说，不是按正常的办法来对游标进行加法计算，
+ * 而是首先将游标的二进制位翻转（reverse）过来，
+ * 然后对翻转后的值进行加法计算，
+ * 最后再次对加法计算之后的结果进行翻转。
+ *
+ * 哈希表的大小总是 2 的某个次方，桶的索引是哈希值的低位，
+ * 按翻转之后的顺序访问桶时，哈希表扩大或缩小之后，
+ * 新表中的每个桶都只对应旧表中已经访问过的桶，或者都没有访问过的桶，
+ * 所以不需要保存任何状态，也不会漏掉元素：
+ *
+ * - 哈希表扩大时，已经访问过的旧桶扩展出来的新桶都排在游标之前；
+ * - 哈希表缩小时，新桶是几个旧桶合并而成的，其中一部分可能已经访问过，
+ *   所以元素可能会被重复返回；
+ * - 正在 rehash 时，同时访问小表中游标指向的桶，
+ *   以及大表中由这个桶扩展出来的所有桶。
+ *
+ * 开放寻址的字典以组代替桶，按节点的哈希值所属的组遍历，
+ * 保证和链地址法相同。
+ *
+ * 回调函数 fn 不能修改字典，需要删除节点时，可以先记下键，
+ * 在 dictScan 返回之后再删除。
+ *
+ * 限制
+ *
+ * 这个迭代器是完全无状态的，这是一个巨大的优势，
+ * 因为迭代可以在不使用任何额外内存的情况下进行。
+ *
+ * 这个设计的缺陷在于：
+ *
+ * 1) 函数可能会返回重复的元素，不过这个问题可以很容易在应用层解决。
+ * 2) 为了不错过任何元素，
+ *    迭代器需要返回给定桶上的所有键，
+ *    以及因为扩展哈希表而产生出来的新表，
+ *    所以迭代器必须在一次迭代中返回多个元素。
+ *
+ * T = O(1)
+ */
+unsigned long dictScan(dict *d,
+                       unsigned long v,
+                       dictScanFunction *fn,
+                       void *privdata)
+{
+    dictScanState s;
+
+    s.fn = fn;
+    s.batchfn = NULL;
+    s.privdata = privdata;
+    s.count = 0;
+    s.emitted = 0;
+    return _dictScan(d,v,&s);
+}
+
+/*
+ * dictScan 的批量版本
+ *
+ * 从游标 v 开始连续遍历，直到遍历了至少 count 个节点，或者遍历完整个字典，
+ * 节点按每批最多 DICT_SCAN_BATCH 个交给 fn ，回调前已经预取了节点的键。
+ *
+ * 和 SCAN 命令的 COUNT 参数一样，每次最多访问 count*10 个桶，
+ * 所以在稀疏的大字典上也不会阻塞太久。
+ *
+ * fn 同样不能修改字典，但可以修改节点中的键和值的指针（例如重新分配内存）。
+ *
+ * 返回下一个游标，为 0 表示遍历完成。
+ */
+unsigned long dictScanBatch(dict *d, unsigned long v, long count,
+                            dictScanBatchFunction *fn, void *privdata)
+{
+    dictScanState s;
+    long maxsteps = count*10;
+
+    s.fn = NULL;
+    s.batchfn = fn;
+    s.privdata = privdata;
+    s.count = 0;
+    s.emitted = 0;
+
+    do {
+        v = _dictScan(d,v,&s);
+    } while (v && s.emitted < count && --maxsteps > 0);
+    _dictScanFlush(&s);
+
+    return v;
+}
+
+/* ------------------------- private functions ------------------------------ */
+
+/* Expand the hash table if needed 
+ *
+ * 根据需要，初始化字典（的哈希表），或者对字典（的现有哈希表）进行扩展
+ *
+ * T = O(N)
+ */
+static int _dictExpandIfNeeded(dict *d)
+{
+    if (d->layout == DICT_LAYOUT_OPEN) {
+        // 开放寻址的哈希表不能超载，
+        // 所以不受 dict_can_resize 限制，装到 7/8 时必须扩展。
+        //
+        // 正在 rehash 时新节点都放进 1 号哈希表，有安全迭代器时 rehash 会暂停，
+        // 1 号哈希表可能在 0 号哈希表迁移完之前被装满。这时不能强制完成 rehash ：
+        // 剩下的节点可能放不进 1 号哈希表，迁移节点也会打乱安全迭代器，
+        // 所以只把 1 号哈希表重建得更大
+        if (dictIsRehashing(d)) {
+            if (d->ht[1].used+d->ht[1].deleted >= dictOpenMaxLoad(&d->ht[1]))
+                _dictOpenGrowTarget(d);
+            return DICT_OK;
+        }
+
+        if (d->ht[0].size == 0) return dictExpand(d, DICT_OPEN_MIN_SIZE);
+
+        // 已删除的槽很多时，dictExpand 会按原来的大小重建哈希表
+        if (d->ht[0].used+d->ht[0].deleted >= dictOpenMaxLoad(&d->ht[0]))
+            return dictExpand(d, d->ht[0].used*2);
+
+        return DICT_OK;
+    }
+
+    /* Incremental rehashing already in progress. Return. */
+    // 渐进式 rehash 已经在进行了，直接返回
+    if (dictIsRehashing(d)) return DICT_OK;
+
+    /* If the hash table is empty expand it to the initial size. */
+    // 如果字典（的 0 号哈希表）为空，那么创建并返回初始化大小的 0 号哈希表
+    // T = O(1)
+    if (d->ht[0].size == 0) return dictExpand(d, DICT_HT_INITIAL_SIZE);
+
+    /* If we reached the 1:1 ratio, and we are allowed to resize the hash
+     * table (global setting) or we should avoid it but the ratio between
+     * elements/buckets is over the "safe" threshold, we resize doubling
+     * the number of buckets. */
+    // 一下两个条件之一为真时，对字典进行扩展
+    // 1）字典已使用节点数和字典大小之间的比率接近 1：1
+    //    并且 dict_can_resize 为真
+    // 2）已使用节点数和字典大小之间的比率超过 dict_force_resize_ratio
+    if (d->ht[0].used >= d->ht[0].size &&
+        (__atomic_load_n(&dict_can_resize,__ATOMIC_RELAXED) ||
+         d->ht[0].used/d->ht[0].size > dict_force_resize_ratio))
+    {
+        // 新哈希表的大小至少是目前已使用节点数的两倍
+        // T = O(N)
+        return dictExpand(d, d->ht[0].used*2);
+    }
+
+    return DICT_OK;
+}
+
+/* Our hash table capability is a power of two */
+/*
+ * 计算第一个大于等于 size 的 2 的 N 次方，用作哈希表的值
+ *
+ * T = O(1)
+ */
+static unsigned long _dictNextPower(unsigned long size)
+{
+    unsigned long i = DICT_HT_INITIAL_SIZE;
+
+    if (size >= LONG_MAX) return LONG_MAX;
+    while(1) {
+        if (i >= size)
+            return i;
+        i *= 2;
+    }
+}
+
+/* Returns the index of a free slot that can be populated with
+ * a hash entry for the given 'key'.
+ * If the key already exists, -1 is returned.
+ *
+ * 返回可以将 key 插入到哈希表的索引位置
+ * 如果 key 已经存在于哈希表，那么返回 -1
+ *
+ * Note that if we are in the process of rehashing the hash table, the
+ * index is always returned in the context of the second (new) hash table. 
+ *
+ * 注意，如果字典正在进行 rehash ，那么总是返回 1 号哈希表的索引。
+ * 因为在字典进行 rehash 时，新节点总是插入到 1 号哈希表。
+ *
+ * T = O(N)
+ */
+static long _dictKeyIndex(dict *d, const void *key)
+{
+    uint64_t h;
+    unsigned long idx;
+    int table;
+    dictEntry *he;
+
+    /* Expand the hash table if needed */
+    // 单步 rehash
+    // T = O(N)
+    if (_dictExpandIfNeeded(d) == DICT_ERR)
+        return -1;
+
+    /* Compute the key hash value */
+    // 计算 key 的哈希值
+    h = dictHashKey(d, key);
+    // T = O(1)
+    for (table = 0; table <= 1; table++) {
+
+        // 计算索引值
+        idx = h & d->ht[table].sizemask;
+
+        /* Search if this slot does not already contain the given key */
+        // 查找 key 是否存在
+        // T = O(1)
+        he = d->ht[table].table[idx];
+        while(he) {
+            if (dictCompareKeys(d, key, he->key))
+                return -1;
+            he = he->next;
+        }
+
+        /* If we are in the process of rehashing the hash table, the
+         * index is always returned in the context of the second (new) hash table. */
+        // 如果运行到这里时，说明 0 号哈希表中所有节点都不包含 key
+        // 如果这时 rehahs 正在进行，那么继续对 1 号哈希表进行 rehash
+        if (!dictIsRehashing(d)) break;
+    }
+
+    // 返回索引值
+    return idx;
+}
+
+/*
+ * 清空字典上的所有哈希表节点，并重置字典属性
+ *
+ * T = O(N)
+ */
+void dictEmpty(dict *d, void(callback)(void*)) {
+
+    // 并发读的字典先发布空的哈希表，旧的哈希表等读线程离开之后再删除
+    if (d->concurrent) {
+        int table;
+
+        for (table = 0; table <= 1; table++) {
+            if (d->ht[table].size)
+                _dictRetire(d,DICT_RETIRE_HT,NULL,&d->ht[table]);
+            _dictReset(&d->ht[table]);
+        }
+        d->rehashidx = -1;
+        d->iterators = 0;
+        _dictPublishView(d);
+        return;
+    }
+
+    // 删除两个哈希表上的所有节点
+    // T = O(N)
+    _dictClear(d,&d->ht[0],callback);
+    _dictClear(d,&d->ht[1],callback);
+    // 重置属性 
+    d->rehashidx = -1;
+    d->iterators = 0;
+}
+
+/*
+ * 开启自动 rehash
+ *
+ * T = O(1)
+ */
+void dictEnableResize(void) {
+    __atomic_store_n(&dict_can_resize,1,__ATOMIC_RELAXED);
+}
+
+/*
+ * 关闭自动 rehash
+ *
+ * T = O(1)
+ */
+void dictDisableResize(void) {
+    __atomic_store_n(&dict_can_resize,0,__ATOMIC_RELAXED);
+}
@@ -9,6 +9,7 @@
  */
 
 #include <stdint.h>
+#include <stddef.h>
 
 #ifndef _DICT_H
 #define _DICT_H
@@ -20,6 +21,13 @@
 // 操作失败（或出错）
 #define DICT_ERR 1
 
+/* 字典的存储方式 */
+
+// 链地址法：每个索引上是一条节点链表
+#define DICT_LAYOUT_CHAINED 0
+// 开放寻址法：节点直接保存在槽数组中，见 dict.c 中的 Open addressing layout
+#define DICT_LAYOUT_OPEN 1
+
 /* Unused arguments generate annoying warnings... */
 // 如果字典的私有数据不使用时
 // 用这个宏来避免编译器错误
@@ -44,6 +52,26 @@ typedef struct dictEntry {
 
 } dictEntry;
 
+//
+// dictSlot 开放寻址哈希表的槽
+//
+// 开放寻址的字典不需要 next 指针，槽只保存键和值，比 dictEntry 小 8 个字节。
+// 两者前两个属性的布局相同，所以字典的接口仍然返回 dictEntry 指针，
+// 但开放寻址的字典返回的节点没有 next 属性，不能访问它，也不能整个复制。
+//
+typedef struct dictSlot {
+    // 键
+    void *key;
+
+    // 值
+    union {
+        void *val;
+        uint64_t u64;
+        int64_t s64;
+    } v;
+
+} dictSlot;
+
 
 //
 // dictType 用于操作字典类型函数
@@ -51,7 +79,7 @@ typedef struct dictEntry {
 typedef struct dictType {
     
     // 计算哈希值的函数
-    unsigned int(*hashFunction)(const void *key);
+    uint64_t (*hashFunction)(const void *key);
 
     // 复制键的函数
     void *(*keyDup)(void *privdata, const void *key);
@@ -68,6 +96,21 @@ typedef struct dictType {
     // 销毁值的函数
     void(*valDestructor)(void *privdata, void *obj);
 
+    // 以下两个函数可选，设置之后，短键会被复制到节点后面，和节点共用一块内存，
+    // 少一次内存分配，查找时也少一次缓存未命中。只用于链地址法的字典。
+    //
+    // 没有设置 keyDup 时，传给 dictAdd 的键归字典所有，
+    // 键被嵌入之后，字典会马上用 keyDestructor 释放原来的键。
+    // 嵌入的键和节点一起释放，所以 dictDeleteNoFree 之后不能再使用它。
+
+    // 返回键嵌入节点时需要的字节数，返回 0 表示不嵌入这个键，
+    // 对内容相同的键必须返回相同的结果，释放节点时也用它判断键是否是嵌入的
+    size_t (*keyEmbedLen)(const void *key);
+
+    // 将键复制到 buf 中，返回嵌入后的键，
+    // 嵌入后的键要能直接交给 hashFunction 和 keyCompare 使用
+    void *(*keyEmbed)(void *buf, const void *key);
+
 } dictType;
 
 
@@ -93,6 +136,17 @@ typedef struct dictht {
     // 该哈希表已有节点的数量
     unsigned long used;
 
+    // 以下属性只在开放寻址的字典中使用，此时 table 为 NULL
+
+    // 控制字节数组，每个槽一个字节
+    unsigned char *ctrl;
+
+    // 槽数组，节点直接保存在槽中
+    dictSlot *slots;
+
+    // 被标记为已删除的槽的数量
+    unsigned long deleted;
+
 } dictht;
 
 //
@@ -114,6 +168,15 @@ typedef struct dict {
 
     int iterators; // 目前正在运行的安全迭代器的数量
 
+    int layout;    // 存储方式 DICT_LAYOUT_*
+
+    // 以下属性只在并发读模式下使用，见 dict.c 中的 Concurrent readers
+    int concurrent;                 // 是否允许其他线程无锁地调用 dictFind
+    struct dictView *view;          // 发布给读线程的哈希表数组
+    unsigned long rehashseq;        // 迁移桶时为奇数
+    struct dictRetired *retired;    // 等待读线程离开后才能释放的内存
+    unsigned long retiredCount;     // retired 链表的长度
+
 } dict;
 
 //
@@ -146,6 +209,22 @@ typedef struct dictIterator {
 } dictIterator;
 
 typedef void (dictScanFunction)(void *privdata, const dictEntry *de);
+typedef void (dictScanBatchFunction)(void *privdata, dictEntry **des, int count);
+
+/* dictFindMany 每批同时查找的键的数量 */
+#define DICT_FIND_MANY_BATCH 16
+
+/* dictGetFairRandomKey 每次采样的节点数量 */
+#define DICT_FAIR_RANDOM_SAMPLE 15
+
+/* dictScanBatch 每次交给回调函数的最大节点数量 */
+#define DICT_SCAN_BATCH 64
+
+/* 可以同时存在的读线程数量上限，线程退出后它的槽可以被新线程使用 */
+#define DICT_MAX_READERS 256
+
+/* 已使用节点数低于哈希表大小的这个百分比时缩小哈希表 */
+#define DICT_HT_MIN_FILL 10
 
 /* This is the initial size of every hash table */
 /* 哈希表的初始大小 */
@@ -173,9 +252,14 @@ typedef void (dictScanFunction)(void *privdata, const dictEntry *de);
 #define dictSetUnsignedIntegerVal(entry, _val_) \
     do { entry->v.u64 = _val_; } while(0)
 
-// 释放给定字典节点的键
+// 查看键是否嵌入在节点中
+#define dictIsEmbeddedKey(d, key) \
+    ((d)->layout == DICT_LAYOUT_CHAINED && (d)->type->keyEmbedLen && \
+     (d)->type->keyEmbedLen(key))
+
+// 释放给定字典节点的键，嵌入的键和节点一起释放
 #define dictFreeKey(d, entry) \
-    if ((d)->type->keyDestructor) \
+    if ((d)->type->keyDestructor && !dictIsEmbeddedKey(d, (entry)->key)) \
         (d)->type->keyDestructor((d)->privdata, (entry)->key)
 
 // 设置给定字典节点的键
@@ -199,9 +283,9 @@ typedef void (dictScanFunction)(void *privdata, const dictEntry *de);
 // 返回获取给定节点的值
 #define dictGetVal(he) ((he)->v.val)
 // 返回获取给定节点的有符号整数值
-#define dictGetSignedIntegerVal(he) ((he)->.s64)
+#define dictGetSignedIntegerVal(he) ((he)->v.s64)
 // 返回给定节点的无符号整数值
-#define dictGetUnsignedIntegerVal((he)->s.u64)
+#define dictGetUnsignedIntegerVal(he) ((he)->v.u64)
 // 返回给定字典的大小
 #define dictSlots(d) ((d)->ht[0].size+(d)->ht[1].size)
 // 返回字典的已有节点数量
@@ -211,6 +295,11 @@ typedef void (dictScanFunction)(void *privdata, const dictEntry *de);
 
 /* API */
 dict *dictCreate(dictType *type, void *privDataPtr);
+dict *dictCreateOpen(dictType *type, void *privDataPtr);
+dict *dictCreateConcurrent(dictType *type, void *privDataPtr);
+void dictReadBegin(void);
+void dictReadEnd(void);
+void dictReclaim(dict *d);
 int dictExpand(dict *d, unsigned long size);
 int dictAdd(dict *d, void *key, void *val);
 dictEntry *dictAddRaw(dict *d, void *val);
@@ -220,23 +309,32 @@ int dictDelete(dict *d, const void *key);
 int dictDeleteNoFree(dict *d, const void *key);
 void dictRelease(dict *d);
 dictEntry *dictFind(dict *d, const void *key);
+int dictFindMany(dict *d, const void **keys, int n, dictEntry **out);
 void *dictFetchValue(dict *d, const void *key);
 int dictResize(dict *d);
+int dictShrinkIfNeeded(dict *d);
 dictIterator *dictGetIterator(dict *d);
 dictIterator *dictGetSafeIterator(dict *d);
 dictEntry *dictNext(dictIterator *iter);
+int dictNextBatch(dictIterator *iter, dictEntry **des, int count);
+long long dictFingerprint(dict *d);
 void dictReleaseIterator(dictIterator *iter);
 dictEntry *dictGetRandomKey(dict *d);
 int dictGetRandomKeys(dict *d, dictEntry **des, int count);
-unsigned int dictGenHashFunction(const void *key, int len);
-unsigned int dictGenCaseHashFunction(const unsigned char *buf, int len);
+dictEntry *dictGetFairRandomKey(dict *d);
+uint64_t dictGenHashFunction(const void *key, int len);
+uint64_t dictGenCaseHashFunction(const unsigned char *buf, int len);
+uint64_t dictGenFastHashFunction(const void *key, int len);
 void dictEmpty(dict *d, void(callback)(void*));
 void dictEnableResize(void);
 void dictDisableResize(void);
 int dictRehash(dict *d, int n);
 int dictRehashMilliseconds(dict *d, int ms);
-unsigned int dictGetHashFunctionSeed(void);
+void dictSetHashFunctionSeed(uint8_t *seed);
+uint8_t *dictGetHashFunctionSeed(void);
 unsigned long dictScan(dict *d, unsigned long v, dictScanFunction *fn, void *privdata);
+unsigned long dictScanBatch(dict *d, unsigned long v, long count,
+                            dictScanBatchFunction *fn, void *privdata);
 
 /* Hash table types */
 extern dictType dictTypeHeapStringCopyKey;
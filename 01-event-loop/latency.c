@@ -0,0 +1,161 @@
+/* latency.c -- 事件循环的延迟统计和卡顿检测
+ *
+ * 直方图和卡顿记录由 ae 在每个事件循环中维护（见 ae.c 中的 Latency monitoring），
+ * 这里负责：
+ *
+ *  - 记下每轮循环中最慢的命令，在卡顿发生时写进卡顿记录；
+ *  - 把主线程和所有 reactor 线程的统计生成 INFO 格式的 Latency 小节。
+ */
+
+#include "redis.h"
+
+#ifdef HAVE_BACKTRACE
+#include <execinfo.h>
+#endif
+
+/* 卡顿记录中命令名字的最大长度（包括 '\0'），
+ * 加上 "cmd=,cmd_usec=" 和最长的执行时间之后不能超过 AE_STALL_TAG_LEN */
+#define LATENCY_CMD_NAME_LEN 24
+
+/* 当前线程在某一轮循环中执行过的最慢的命令
+ *
+ * 每个 reactor 线程有自己的事件循环，所以按线程记录 */
+static __thread long long slowest_cmd_iteration = -1;
+static __thread long long slowest_cmd_duration;
+static __thread char slowest_cmd_name[LATENCY_CMD_NAME_LEN];
+
+/*
+ * 在命令执行完毕之后调用，duration 为命令的执行时间（微秒）
+ */
+void latencyTrackCommand(redisClient *c, long long duration) {
+    aeEventLoop *el = clientEventLoop(c);
+
+    if (c->argc == 0) return;
+
+    if (slowest_cmd_iteration != el->iteration ||
+        duration >= slowest_cmd_duration)
+    {
+        slowest_cmd_iteration = el->iteration;
+        slowest_cmd_duration = duration;
+        snprintf(slowest_cmd_name,sizeof(slowest_cmd_name),"%s",
+            (char*)c->argv[0]->ptr);
+    }
+}
+
+/*
+ * 卡顿处理器：把这一轮中最慢的命令写进卡顿记录
+ */
+static void latencyStallProc(aeEventLoop *el, aeStall *stall) {
+    if (slowest_cmd_iteration != el->iteration) return;
+
+    snprintf(stall->tag,sizeof(stall->tag),"cmd=%s,cmd_usec=%lld",
+        slowest_cmd_name,slowest_cmd_duration);
+}
+
+/*
+ * 为事件循环打开卡顿检测
+ */
+void latencyInitEventLoop(aeEventLoop *el) {
+    aeSetStallProc(el,server.loop_stall_threshold,latencyStallProc);
+}
+
+/*
+ * 将处理器的名字追加到 s 中，找不到符号时使用地址
+ */
+static sds latencyCatHandlerName(sds s, void *proc) {
+#ifdef HAVE_BACKTRACE
+    char **symbols = backtrace_symbols(&proc,1);
+
+    if (symbols) {
+        // 格式为 binary(symbol+offset) [address]
+        char *start = strchr(symbols[0],'(');
+        char *end = start ? strpbrk(start,"+)") : NULL;
+
+        if (start && end && end > start+1) {
+            s = sdscatlen(s,start+1,end-start-1);
+            free(symbols);
+            return s;
+        }
+        free(symbols);
+    }
+#endif
+    return sdscatprintf(s,"%p",proc);
+}
+
+/*
+ * 生成一个事件循环的统计信息，name 为事件循环的名字
+ *
+ * 其他线程的事件循环在被读取的同时可能正在更新，
+ * 所以得出的数字只是近似值
+ */
+static sds genEventLoopLatencyInfo(sds info, char *name, aeEventLoop *el) {
+    long long j, first;
+    int type;
+
+    for (type = 0; type < AE_LATENCY_TYPES; type++) {
+        aeLatencyHistogram *h = &el->latency[type];
+
+        info = sdscatprintf(info,
+            "latency_%s_%s:samples=%llu,avg=%.2f,p50=%llu,p99=%llu,p999=%llu,max=%llu\r\n",
+            name, aeLatencyTypeName(type),
+            (unsigned long long)h->samples,
+            h->samples ? (double)h->sum/h->samples : 0,
+            (unsigned long long)aeLatencyPercentile(h,50),
+            (unsigned long long)aeLatencyPercentile(h,99),
+            (unsigned long long)aeLatencyPercentile(h,99.9),
+            (unsigned long long)h->max);
+    }
+
+    info = sdscatprintf(info,
+        "busypoll_%s:budget=%lld,threshold=%d,spin_usec=%lld,spins=%lld,"
+        "sleep_usec=%lld,sleeps=%lld\r\n",
+        name, el->busyPollBudget, el->busyPollThreshold,
+        el->stat_spin_time, el->stat_spins,
+        el->stat_sleep_time, el->stat_sleeps);
+
+    info = sdscatprintf(info,"stalls_%s:count=%lld,threshold=%lld\r\n",
+        name, el->stallCount, el->stallThreshold);
+
+    // 从最近的一条记录开始输出
+    first = el->stallCount > AE_STALL_LOG_LEN ?
+            el->stallCount-AE_STALL_LOG_LEN : 0;
+    for (j = el->stallCount-1; j >= first; j--) {
+        aeStall *stall = &el->stalls[j % AE_STALL_LOG_LEN];
+
+        info = sdscatprintf(info,
+            "stall_%s_%lld:when=%lld,iteration=%lld,usec=%lld,"
+            "slowest=%s,slowest_usec=%lld,fd=%d,handler=",
+            name, el->stallCount-1-j,
+            (long long)stall->when, stall->iteration, stall->duration,
+            aeLatencyTypeName(stall->type), stall->slowest, stall->fd);
+        info = latencyCatHandlerName(info,stall->proc);
+        if (stall->tag[0]) info = sdscatprintf(info,",%s",stall->tag);
+        info = sdscatlen(info,"\r\n",2);
+    }
+    return info;
+}
+
+/*
+ * 生成 INFO 中的 Latency 小节，所有时间的单位都是微秒
+ *
+ *  latency_<loop>_<type>  每类处理器的执行时间分布，
+ *                         loop 是每轮循环除去阻塞等待之外的忙碌时间
+ *  busypoll_<loop>        忙轮询和阻塞等待分别花费的时间和次数
+ *  stalls_<loop>          卡顿次数和阈值
+ *  stall_<loop>_<n>       第 n 近的一次卡顿，以及那一轮中最慢的处理器和命令
+ *
+ * <loop> 为 main ，或者多 reactor 模式下的 reactor<id>
+ */
+sds genLatencyInfoString(sds info) {
+    int j;
+
+    info = sdscat(info,"# Latency\r\n");
+    if (server.el) info = genEventLoopLatencyInfo(info,"main",server.el);
+    for (j = 0; j < server.reactors && server.workers; j++) {
+        char name[32];
+
+        snprintf(name,sizeof(name),"reactor%d",j);
+        info = genEventLoopLatencyInfo(info,name,server.workers[j].el);
+    }
+    return info;
+}
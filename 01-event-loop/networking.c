@@ -0,0 +1,1682 @@
+/* networking.c -- 客户端的创建、销毁、命令请求的读取和解析，以及回复的发送 */
+
+#include "redis.h"
+#include <sys/uio.h>
+
+/* -----------------------------------------------------------------------------
+ * Client lifecycle
+ * -------------------------------------------------------------------------- */
+
+/*
+ * 创建一个新客户端
+ *
+ * fd 为 -1 时创建的是没有网络连接的伪客户端。
+ *
+ * 客户端属于调用线程所在的 reactor ，
+ * 它的读写事件注册在 clientEventLoop(c) 上。
+ */
+redisClient *createClient(int fd) {
+
+    // 分配空间
+    redisClient *c = zmalloc(sizeof(redisClient));
+
+    c->worker = reactorGetCurrentWorker();
+    c->remote_call = NULL;
+
+    /* passing -1 as fd it is possible to create a non connected client.
+     * This is useful since all the Redis commands needs to be executed
+     * in the context of a client. When commands are executed in other
+     * contexts (for instance a Lua script) we need a non connected client. */
+    // 当 fd 不为 -1 时，创建带网络连接的客户端
+    // 如果 fd 为 -1 ，那么创建无网络连接的伪客户端
+    if (fd != -1) {
+        // 非阻塞
+        anetNonBlock(NULL,fd);
+        // 禁用 Nagle 算法
+        anetEnableTcpNoDelay(NULL,fd);
+        // 设置 keep alive
+        if (server.tcpkeepalive)
+            anetKeepAlive(NULL,fd,server.tcpkeepalive);
+        // 绑定读事件到事件 loop （开始接收命令请求）
+        if (aeCreateFileEvent(clientEventLoop(c),fd,AE_READABLE,
+            readQueryFromClient, c) == AE_ERR)
+        {
+            close(fd);
+            zfree(c);
+            return NULL;
+        }
+    }
+
+    // 初始化各个属性
+
+    // 默认数据库，多 reactor 模式下由 reactorCall 在执行命令时设置
+    c->dictid = 0;
+    c->db = c->worker ? c->worker->db : server.db;
+    // 套接字
+    c->fd = fd;
+    // 名字
+    c->name = NULL;
+    // 回复缓冲区的偏移量
+    c->bufpos = 0;
+    // 查询缓冲区
+    c->querybuf = sdsempty();
+    // 查询缓冲区峰值
+    c->querybuf_peak = 0;
+    // 命令请求的类型
+    c->reqtype = 0;
+    // 命令参数数量
+    c->argc = 0;
+    // 命令参数
+    c->argv = NULL;
+    // 当前执行的命令和最近一次执行的命令
+    c->cmd = c->lastcmd = NULL;
+    // 查询缓冲区中未读入的命令内容数量
+    c->multibulklen = 0;
+    // 读入的参数的长度
+    c->bulklen = -1;
+    // 已发送字节数
+    c->sentlen = 0;
+    // 状态 FLAG
+    c->flags = 0;
+    // 事件优先级
+    c->priority = AE_PRIO_NORMAL;
+    // 回复链表
+    c->reply = listCreate();
+    // 回复链表的字节量
+    c->reply_bytes = 0;
+    // 回复链表的释放和复制函数
+    listSetFreeMethod(c->reply,decrRefCountVoid);
+
+    // 如果不是伪客户端，那么添加到服务器的客户端链表中
+    if (fd != -1) listAddNodeTail(clientList(c),c);
+
+    // 返回客户端
+    return c;
+}
+
+/*
+ * 释放客户端的所有命令参数
+ */
+static void freeClientArgv(redisClient *c) {
+    int j;
+
+    for (j = 0; j < c->argc; j++)
+        decrRefCount(c->argv[j]);
+    c->argc = 0;
+    c->cmd = NULL;
+}
+
+/*
+ * 如果 c 在链表 l 中，那么将它删除
+ */
+static void unlinkClientFromList(list *l, redisClient *c) {
+    listNode *ln = listSearchKey(l,c);
+
+    if (ln) listDelNode(l,ln);
+}
+
+/*
+ * 释放客户端
+ *
+ * 只能在客户端所属的线程上调用
+ */
+void freeClient(redisClient *c) {
+
+    // 异步读写操作还在使用客户端的缓冲区，先停止监听套接字，
+    // 等操作全部完成之后，由它们的完成处理器再次调用 freeClient
+    if (c->flags & (REDIS_IO_READ_INFLIGHT|REDIS_IO_WRITE_INFLIGHT)) {
+        if (c->fd != -1)
+            aeDeleteFileEvent(clientEventLoop(c),c->fd,AE_READABLE|AE_WRITABLE);
+        c->flags |= REDIS_CLOSE_AFTER_IO;
+        return;
+    }
+
+    /* If this is marked as current client unset it */
+    if (server.current_client == c) server.current_client = NULL;
+
+    // 等待转交给其他线程的命令不会再执行了
+    if (c->remote_call) zfree(c->remote_call);
+
+    /* Free the query buffer */
+    sdsfree(c->querybuf);
+    c->querybuf = NULL;
+
+    /* Close socket, unregister events, and remove list of replies and
+     * accumulated arguments. */
+    // 关闭套接字，并从事件处理器中删除该套接字的事件
+    if (c->fd != -1) {
+        aeDeleteFileEvent(clientEventLoop(c),c->fd,AE_READABLE);
+        aeDeleteFileEvent(clientEventLoop(c),c->fd,AE_WRITABLE);
+        close(c->fd);
+    }
+
+    // 清空回复缓冲区
+    listRelease(c->reply);
+
+    // 清空命令参数
+    freeClientArgv(c);
+
+    /* Remove from the list of clients */
+    // 从服务器的客户端链表中删除自身
+    if (c->fd != -1) unlinkClientFromList(clientList(c),c);
+
+    // 从等待 I/O 线程处理的链表中删除自身
+    if (c->flags & REDIS_PENDING_READ)
+        unlinkClientFromList(server.clients_pending_read,c);
+    if (c->flags & REDIS_PENDING_WRITE)
+        unlinkClientFromList(clientPendingWriteList(c),c);
+
+    /* If this client was scheduled for async freeing we need to remove it
+     * from the queue. */
+    if (c->flags & REDIS_CLOSE_ASAP)
+        unlinkClientFromList(server.clients_to_close,c);
+
+    /* Release other dynamically allocated client structure fields,
+     * and finally release the client structure itself. */
+    if (c->name) decrRefCount(c->name);
+    // 清除参数空间
+    zfree(c->argv);
+    // 释放客户端结构本身
+    zfree(c);
+}
+
+/* Schedule a client to free it at a safe time in the serverCron() function.
+ * This function is useful when we need to terminate a client but we are in
+ * a context where calling freeClient() is not possible, because the client
+ * should be valid for the continuation of the flow of the program.
+ *
+ * 异步地释放给定的客户端
+ *
+ * 可以在 I/O 线程中调用，客户端会在主线程的 beforeSleep 中被释放。
+ * reactor 线程上的客户端只会在自己的线程上被处理，所以直接释放。
+ */
+void freeClientAsync(redisClient *c) {
+    if (c->flags & REDIS_CLOSE_ASAP) return;
+
+    // 命令正在其他 reactor 线程上执行，客户端回来之后由 reactorResumeClient 释放
+    if (c->flags & REDIS_REMOTE_EXEC) {
+        c->flags |= REDIS_CLOSE_ASAP;
+        return;
+    }
+    if (c->worker) {
+        freeClient(c);
+        return;
+    }
+
+    if (server.io_threads_num > 1) pthread_mutex_lock(&server.async_free_queue_mutex);
+    c->flags |= REDIS_CLOSE_ASAP;
+    listAddNodeTail(server.clients_to_close,c);
+    if (server.io_threads_num > 1) pthread_mutex_unlock(&server.async_free_queue_mutex);
+}
+
+/*
+ * 关闭需要异步关闭的客户端
+ */
+void freeClientsInAsyncFreeQueue(void) {
+
+    // 遍历所有要关闭的客户端
+    while (listLength(server.clients_to_close)) {
+        listNode *ln = listFirst(server.clients_to_close);
+        redisClient *c = listNodeValue(ln);
+
+        c->flags &= ~REDIS_CLOSE_ASAP;
+        // 关闭客户端
+        freeClient(c);
+        // 从客户端链表中删除被关闭的客户端
+        listDelNode(server.clients_to_close,ln);
+    }
+}
+
+/* -----------------------------------------------------------------------------
+ * Accept handler
+ * -------------------------------------------------------------------------- */
+
+/*
+ * TCP 连接 accept 处理器
+ */
+void acceptTcpHandler(aeEventLoop *el, int fd, void *privdata, int mask) {
+    int cport, cfd, max = REDIS_MAX_ACCEPTS_PER_CALL;
+    char cip[REDIS_IP_STR_LEN];
+    redisClient *c;
+    REDIS_NOTUSED(el);
+    REDIS_NOTUSED(mask);
+    REDIS_NOTUSED(privdata);
+
+    while(max--) {
+        // accept 客户端连接
+        cfd = anetTcpAccept(server.neterr, fd, cip, sizeof(cip), &cport);
+        if (cfd == ANET_ERR) {
+            if (errno != EWOULDBLOCK)
+                redisLog(REDIS_WARNING,
+                    "Accepting client connection: %s", server.neterr);
+            return;
+        }
+
+        // 为客户端创建客户端状态（redisClient）
+        if ((c = createClient(cfd)) == NULL) {
+            redisLog(REDIS_WARNING,
+                "Error registering fd event for the new client: %s (fd=%d)",
+                strerror(errno),cfd);
+            close(cfd); /* May be already closed, just ignore errors */
+            continue;
+        }
+
+        /* If maxclient directive is set and this is one client more... close the
+         * connection. Note that we create the client instead to check before
+         * for this condition, since now the socket is already set in non-blocking
+         * mode and we can send an error for free using the Kernel I/O */
+        // 如果新添加的客户端令服务器的最大客户端数量达到了
+        // 那么向新客户端写入错误信息，并关闭新客户端
+        if (listLength(server.clients) > (unsigned long)server.maxclients) {
+            char *err = "-ERR max number of clients reached\r\n";
+
+            /* That's a best effort error message, don't check write errors */
+            if (write(c->fd,err,strlen(err)) == -1) {
+                /* Nothing to do, Just to avoid the warning... */
+            }
+            freeClient(c);
+        }
+    }
+}
+
+/* -----------------------------------------------------------------------------
+ * Reply API
+ * -------------------------------------------------------------------------- */
+
+/* This function is called every time we are going to transmit new data
+ * to the client.
+ *
+ * 这个函数在每次向客户端发送数据时都会被调用。
+ *
+ * If the client should receive new data (normal clients will) the function
+ * returns REDIS_OK, and make sure to install the write handler in our event
+ * loop so that when the socket is writable new data gets written.
+ *
+ * 当客户端可以接收新数据时（通常情况下都是这样），函数返回 REDIS_OK ，
+ * 并确保回复会被发送出去：
+ *
+ * 并把客户端放进所在事件循环的 clients_pending_write 链表。
+ * 在进入下一轮事件循环之前，beforeSleep 直接写出链表中所有客户端的回复
+ * （或者交给 I/O 线程写出），只有套接字写满时才安装写处理器，
+ * 这样大部分回复都不需要多等一轮 epoll 。
+ *
+ * 多次调用是安全的，客户端只会被添加一次。
+ *
+ * If the client should not receive new data, because it is a fake client
+ * or a slave, or because the setup of the write handler failed, the function
+ * returns REDIS_ERR.
+ *
+ * 当客户端不能接收新数据时（因为它是伪客户端，或者写处理器安装失败），
+ * 函数返回 REDIS_ERR 。
+ */
+int prepareClientToWrite(redisClient *c) {
+
+    // 伪客户端，不发送回复
+    if (c->fd <= 0) return REDIS_ERR; /* Fake client */
+
+    // 命令正在其他 reactor 线程上执行，回到原线程之后再安装写处理器
+    if (c->flags & REDIS_REMOTE_EXEC) return REDIS_OK;
+
+    // I/O 线程正在读取这个客户端，回到主线程之后再处理
+    if (c->flags & REDIS_PENDING_READ) return REDIS_OK;
+
+    // 已经在等待写出了
+    if (c->flags & REDIS_PENDING_WRITE) return REDIS_OK;
+    if (aeGetFileEvents(clientEventLoop(c),c->fd) & AE_WRITABLE) return REDIS_OK;
+
+    c->flags |= REDIS_PENDING_WRITE;
+    listAddNodeHead(clientPendingWriteList(c),c);
+
+    return REDIS_OK;
+}
+
+/* -----------------------------------------------------------------------------
+ * Low level functions to add more data to output buffers.
+ * -------------------------------------------------------------------------- */
+
+/*
+ * 尝试将回复添加到 c->buf 中
+ */
+int _addReplyToBuffer(redisClient *c, char *s, size_t len) {
+    size_t available = sizeof(c->buf)-c->bufpos;
+
+    // 正准备关闭客户端，无须再发送内容
+    if (c->flags & REDIS_CLOSE_AFTER_REPLY) return REDIS_OK;
+
+    /* If there already are entries in the reply list, we cannot
+     * add anything more to the static buffer. */
+    // 回复链表里已经有内容，再添加内容到 c->buf 里面就是错误了
+    if (listLength(c->reply) > 0) return REDIS_ERR;
+
+    /* Check that the buffer has enough space available for this string. */
+    // 空间必须满足
+    if (len > available) return REDIS_ERR;
+
+    // 复制内容到 c->buf 里面
+    memcpy(c->buf+c->bufpos,s,len);
+    c->bufpos+=len;
+
+    return REDIS_OK;
+}
+
+/*
+ * 将回复添加到回复链表中
+ *
+ * 链表的最后一个节点还有空间时直接追加到它的末尾，
+ * 否则创建一个新节点
+ */
+void _addReplyStringToList(redisClient *c, char *s, size_t len) {
+    robj *tail;
+
+    if (c->flags & REDIS_CLOSE_AFTER_REPLY) return;
+
+    if (listLength(c->reply) > 0) {
+        tail = listNodeValue(listLast(c->reply));
+
+        /* Append to this object when possible. */
+        // 异步写操作可能正在写出这个对象，不能让它被重新分配
+        if (!(c->flags & REDIS_IO_WRITE_INFLIGHT) &&
+            tail->encoding == REDIS_ENCODING_RAW &&
+            sdslen(tail->ptr)+len <= REDIS_REPLY_CHUNK_BYTES)
+        {
+            tail->ptr = sdscatlen(tail->ptr,s,len);
+            c->reply_bytes += len;
+            return;
+        }
+    }
+
+    // 回复链表中的对象总是 RAW 编码的，以便之后的回复可以直接追加
+    listAddNodeTail(c->reply,createRawStringObject(s,len));
+    c->reply_bytes += len;
+}
+
+/* -----------------------------------------------------------------------------
+ * Higher level functions to queue data on the client output buffer.
+ * The following functions are the ones that commands implementations will call.
+ * -------------------------------------------------------------------------- */
+
+/*
+ * 将 C 字符串中的内容复制到输出缓冲区中
+ */
+void addReplyString(redisClient *c, char *s, size_t len) {
+    if (prepareClientToWrite(c) != REDIS_OK) return;
+    if (_addReplyToBuffer(c,s,len) != REDIS_OK)
+        _addReplyStringToList(c,s,len);
+}
+
+/*
+ * 将字符串对象添加到回复中
+ */
+void addReply(redisClient *c, robj *obj) {
+    addReplyString(c,obj->ptr,sdslen(obj->ptr));
+}
+
+/*
+ * 将 SDS 中的内容复制到回复缓冲区，并释放 SDS
+ */
+void addReplySds(redisClient *c, sds s) {
+    addReplyString(c,s,sdslen(s));
+    sdsfree(s);
+}
+
+/*
+ * 返回一个错误回复
+ *
+ * 例子 -ERR unknown command 'foobar'
+ */
+void addReplyErrorLength(redisClient *c, char *s, size_t len) {
+    if (!len || s[0] != '-') addReplyString(c,"-ERR ",5);
+    addReplyString(c,s,len);
+    addReplyString(c,"\r\n",2);
+}
+
+void addReplyError(redisClient *c, char *err) {
+    addReplyErrorLength(c,err,strlen(err));
+}
+
+/*
+ * 返回一个状态回复
+ *
+ * 例子 +OK\r\n
+ */
+void addReplyStatusLength(redisClient *c, char *s, size_t len) {
+    addReplyString(c,"+",1);
+    addReplyString(c,s,len);
+    addReplyString(c,"\r\n",2);
+}
+
+void addReplyStatus(redisClient *c, char *status) {
+    addReplyStatusLength(c,status,strlen(status));
+}
+
+/*
+ * 添加一个带有前缀 prefix 的整数回复，比如 :10086\r\n 或者 *3\r\n
+ */
+static void addReplyLongLongWithPrefix(redisClient *c, long long ll, char prefix) {
+    char buf[128];
+    int len;
+
+    buf[0] = prefix;
+    len = ll2string(buf+1,sizeof(buf)-1,ll);
+    buf[len+1] = '\r';
+    buf[len+2] = '\n';
+    addReplyString(c,buf,len+3);
+}
+
+/*
+ * 返回一个整数回复
+ *
+ * 格式为 :10086\r\n
+ */
+void addReplyLongLong(redisClient *c, long long ll) {
+    addReplyLongLongWithPrefix(c,ll,':');
+}
+
+/*
+ * 返回一个 Multi Bulk 回复的长度
+ *
+ * 格式为 *5\r\n
+ */
+void addReplyMultiBulkLen(redisClient *c, long length) {
+    addReplyLongLongWithPrefix(c,length,'*');
+}
+
+/*
+ * 返回一个 C 缓冲区作为 bulk 回复
+ *
+ * 格式为 $5\r\nhello\r\n
+ */
+void addReplyBulkCBuffer(redisClient *c, void *p, size_t len) {
+    addReplyLongLongWithPrefix(c,len,'$');
+    addReplyString(c,p,len);
+    addReplyString(c,"\r\n",2);
+}
+
+/*
+ * 返回一个字符串对象作为 bulk 回复
+ */
+void addReplyBulk(redisClient *c, robj *obj) {
+    addReplyBulkCBuffer(c,obj->ptr,sdslen(obj->ptr));
+}
+
+/*
+ * 返回一个空的 bulk 回复
+ */
+void addReplyNull(redisClient *c) {
+    addReplyString(c,"$-1\r\n",5);
+}
+
+/* -----------------------------------------------------------------------------
+ * Writing replies to sockets
+ * -------------------------------------------------------------------------- */
+
+/*
+ * 从回复缓冲区和回复链表的开头删除已经写出的 nwritten 个字节
+ *
+ * 回复缓冲区中的内容总是排在回复链表之前，
+ * c->sentlen 是第一个未写完的部分（buf 或者链表的第一个节点）已经写出的字节数
+ */
+static void _clientAdvanceReplies(redisClient *c, size_t nwritten) {
+    size_t left;
+
+    if (c->bufpos > 0) {
+        left = c->bufpos-c->sentlen;
+        if (nwritten < left) {
+            c->sentlen += nwritten;
+            return;
+        }
+        nwritten -= left;
+        c->bufpos = 0;
+        c->sentlen = 0;
+    }
+
+    // 删除已经全部写出的节点（以及空节点）
+    while (listLength(c->reply)) {
+        listNode *ln = listFirst(c->reply);
+        robj *o = listNodeValue(ln);
+        size_t objlen = sdslen(o->ptr);
+
+        left = objlen-c->sentlen;
+        if (nwritten < left) {
+            c->sentlen += nwritten;
+            return;
+        }
+        nwritten -= left;
+        listDelNode(c->reply,ln);
+        c->sentlen = 0;
+        c->reply_bytes -= objlen;
+    }
+}
+
+/*
+ * 把回复缓冲区和回复链表中还没写出的内容填进 iov 数组，
+ * 最多 REDIS_IOV_PER_WRITE 个部分、大约 REDIS_MAX_WRITE_PER_EVENT 个字节
+ *
+ * 返回填入的部分数量，总字节数保存在 *iovbytes 中。
+ * 返回 0 表示只剩下空对象了。
+ */
+static int _clientPrepareIov(redisClient *c, struct iovec *iov, size_t *iovbytes) {
+    size_t offset;
+    listNode *ln;
+    int iovcnt = 0;
+
+    *iovbytes = 0;
+
+    // 先是 buf 中还没写出的部分
+    if (c->bufpos > 0) {
+        iov[iovcnt].iov_base = c->buf+c->sentlen;
+        iov[iovcnt].iov_len = c->bufpos-c->sentlen;
+        *iovbytes += iov[iovcnt].iov_len;
+        iovcnt++;
+    }
+
+    // 然后是回复链表中的节点，第一个节点可能已经写出了一部分
+    offset = c->bufpos > 0 ? 0 : c->sentlen;
+    ln = listFirst(c->reply);
+    while (ln && iovcnt < REDIS_IOV_PER_WRITE &&
+           *iovbytes < REDIS_MAX_WRITE_PER_EVENT)
+    {
+        robj *o = listNodeValue(ln);
+        size_t objlen = sdslen(o->ptr);
+
+        // 略过空对象
+        if (objlen > offset) {
+            iov[iovcnt].iov_base = ((char*)o->ptr)+offset;
+            iov[iovcnt].iov_len = objlen-offset;
+            *iovbytes += iov[iovcnt].iov_len;
+            iovcnt++;
+        }
+        offset = 0;
+        ln = listNextNode(ln);
+    }
+    return iovcnt;
+}
+
+/*
+ * 将回复缓冲区和回复链表中的内容写入到 fd 中
+ *
+ * 每次用一个 writev() 把 buf 和回复链表中的多个节点一起写出，
+ * 最多 REDIS_IOV_PER_WRITE 个部分、REDIS_MAX_WRITE_PER_EVENT 个字节。
+ *
+ * handler_installed 表示写处理器是否已经安装，
+ * 回复全部写完时需要删除写处理器。
+ *
+ * 可以在 I/O 线程中调用（此时 handler_installed 必须为 0 ），
+ * 出错时客户端会被异步释放，并返回 REDIS_ERR 。
+ */
+int writeToClient(int fd, redisClient *c, int handler_installed) {
+    struct iovec iov[REDIS_IOV_PER_WRITE];
+    ssize_t nwritten = 0, totwritten = 0;
+    size_t iovbytes;
+    int iovcnt;
+
+    // 异步写操作完成之前不能再写，剩下的回复由它的完成处理器负责
+    if (c->flags & REDIS_IO_WRITE_INFLIGHT) return REDIS_OK;
+
+    // 一直循环，直到回复缓冲区为空
+    // 或者指定条件满足为止
+    while(clientHasPendingReplies(c)) {
+        iovcnt = _clientPrepareIov(c,iov,&iovbytes);
+
+        // 只剩下空对象了，删除它们
+        if (iovcnt == 0) {
+            _clientAdvanceReplies(c,0);
+            continue;
+        }
+
+        // 写入内容到套接字
+        nwritten = writev(fd,iov,iovcnt);
+        // 出错则跳出
+        if (nwritten <= 0) break;
+        // 成功写入则更新写入计数器变量，并删除已经写完的部分
+        totwritten += nwritten;
+        _clientAdvanceReplies(c,nwritten);
+
+        // 只写出了一部分，说明套接字的发送缓冲区已经满了，
+        // 不必再尝试一次必然返回 EAGAIN 的写入
+        if ((size_t)nwritten < iovbytes) break;
+
+        /* Note that we avoid to send more than REDIS_MAX_WRITE_PER_EVENT
+         * bytes, in a single threaded server it's a good idea to serve
+         * other clients as well, even if a very large request comes from
+         * super fast link that is always able to accept data (in real world
+         * scenario think about 'KEYS *' against the loopback interface).
+         *
+         * 为了避免一个非常大的回复独占服务器，
+         * 当写入的总数量大于 REDIS_MAX_WRITE_PER_EVENT ，
+         * 临时中断写入，将处理时间让给其他客户端，
+         * 剩余的内容等下次写入就绪再继续写入
+         */
+        if (totwritten > REDIS_MAX_WRITE_PER_EVENT) break;
+    }
+
+    // 写入出错检查
+    if (nwritten == -1) {
+        if (errno == EAGAIN) {
+            nwritten = 0;
+        } else {
+            freeClientAsync(c);
+            return REDIS_ERR;
+        }
+    }
+
+    if (!clientHasPendingReplies(c)) {
+        c->sentlen = 0;
+
+        // 删除 write handler
+        if (handler_installed)
+            aeDeleteFileEvent(clientEventLoop(c),c->fd,AE_WRITABLE);
+
+        /* Close connection after entire reply has been sent. */
+        // 如果指定了写入之后关闭客户端 FLAG ，那么关闭客户端
+        if (c->flags & REDIS_CLOSE_AFTER_REPLY) {
+            freeClientAsync(c);
+            return REDIS_ERR;
+        }
+    }
+    return REDIS_OK;
+}
+
+/*
+ * 异步写操作的完成处理器，res 为写出的字节数，出错时为 -errno
+ *
+ * 还有回复没写出时（套接字写满了，或者回复超过了一次写操作的上限），
+ * 安装写处理器，由 sendReplyToClient 同步写出剩下的部分
+ */
+static void writeToClientDone(aeEventLoop *el, int fd, void *privdata, ssize_t res) {
+    redisClient *c = privdata;
+
+    c->flags &= ~REDIS_IO_WRITE_INFLIGHT;
+    if (c->flags & REDIS_CLOSE_AFTER_IO) {
+        freeClient(c);
+        return;
+    }
+
+    // reactorCall 等这次写操作完成之后才把命令转交出去，
+    // 剩下的回复等客户端回来之后再写出
+    if (c->remote_call) {
+        if (res < 0 && res != -EAGAIN) c->flags |= REDIS_CLOSE_ASAP;
+        else if (res > 0) _clientAdvanceReplies(c,res);
+        reactorSubmitDeferredCall(c);
+        return;
+    }
+
+    if (res < 0 && res != -EAGAIN) {
+        freeClientAsync(c);
+        return;
+    }
+    if (res > 0) _clientAdvanceReplies(c,res);
+
+    if (!clientHasPendingReplies(c)) {
+        c->sentlen = 0;
+        if (c->flags & REDIS_CLOSE_AFTER_REPLY) freeClientAsync(c);
+        return;
+    }
+    if (aeCreateFileEvent(el,fd,AE_WRITABLE,sendReplyToClient,c) == AE_ERR)
+        freeClientAsync(c);
+}
+
+/*
+ * 把客户端的回复作为一个异步写操作提交给事件循环，
+ * 本轮所有客户端的写操作会在下一次 aeFlushIo 中一起提交给 io_uring
+ *
+ * 写操作完成之前，已经提交的回复不会被修改或释放：
+ * 新的回复只会追加到 buf 的末尾，或者作为新的节点添加到回复链表中
+ */
+static void writeToClientAsync(redisClient *c) {
+    struct iovec iov[REDIS_IOV_PER_WRITE];
+    size_t iovbytes;
+    int iovcnt = 0;
+
+    // 上一次写操作还没完成，它的完成处理器会安装写处理器写出新的回复，
+    // 现在提交的话同一段回复会被发送两次
+    if (c->flags & REDIS_IO_WRITE_INFLIGHT) return;
+
+    // 删除开头的空对象
+    while (clientHasPendingReplies(c) &&
+           (iovcnt = _clientPrepareIov(c,iov,&iovbytes)) == 0)
+        _clientAdvanceReplies(c,0);
+
+    if (iovcnt == 0) {
+        c->sentlen = 0;
+        if (c->flags & REDIS_CLOSE_AFTER_REPLY) freeClientAsync(c);
+        return;
+    }
+
+    c->flags |= REDIS_IO_WRITE_INFLIGHT;
+    aeSubmitWritev(clientEventLoop(c),c->fd,iov,iovcnt,writeToClientDone,c);
+}
+
+/*
+ * 负责传送命令回复的写处理器
+ */
+void sendReplyToClient(aeEventLoop *el, int fd, void *privdata, int mask) {
+    REDIS_NOTUSED(el);
+    REDIS_NOTUSED(mask);
+    writeToClient(fd,privdata,1);
+}
+
+/*
+ * 检查客户端是否还有回复没有写出
+ */
+int clientHasPendingReplies(redisClient *c) {
+    return c->bufpos || listLength(c->reply);
+}
+
+/* -----------------------------------------------------------------------------
+ * Reading and parsing requests
+ * -------------------------------------------------------------------------- */
+
+/* resetClient prepare the client to process the next command
+ *
+ * 在客户端执行完命令之后执行：重置客户端以准备执行下个命令
+ */
+void resetClient(redisClient *c) {
+
+    // 释放参数
+    freeClientArgv(c);
+
+    c->reqtype = 0;
+    c->multibulklen = 0;
+    c->bulklen = -1;
+}
+
+/* Helper function. Trims query buffer to make the function that processes
+ * multi bulk requests idempotent.
+ *
+ * 出现协议错误时，设置 REDIS_CLOSE_AFTER_REPLY ，并丢弃已处理的查询缓冲区
+ */
+static void setProtocolError(redisClient *c, int pos) {
+    c->flags |= REDIS_CLOSE_AFTER_REPLY;
+    sdsrange(c->querybuf,pos,-1);
+}
+
+/*
+ * 处理内联命令，并创建参数对象
+ *
+ * 内联命令的各个参数以空格分开，并以 \r\n 结尾
+ * 例子：
+ *
+ * <arg0> <arg1> <arg...> <argN>\r\n
+ *
+ * 这些内容会被用于创建参数对象，
+ * 比如
+ *
+ * argv[0] = arg0
+ * argv[1] = arg1
+ * argv[2] = arg2
+ */
+int processInlineBuffer(redisClient *c) {
+    char *newline;
+    int argc, j;
+    sds *argv, aux;
+    size_t querylen;
+
+    /* Search for end of line */
+    newline = strchr(c->querybuf,'\n');
+
+    /* Nothing to do without a \r\n */
+    // 收到的查询内容不符合协议格式，出错
+    if (newline == NULL) {
+        if (sdslen(c->querybuf) > REDIS_INLINE_MAX_SIZE) {
+            addReplyError(c,"Protocol error: too big inline request");
+            setProtocolError(c,0);
+        }
+        return REDIS_ERR;
+    }
+
+    /* Handle the \r\n case. */
+    if (newline && newline != c->querybuf && *(newline-1) == '\r')
+        newline--;
+
+    /* Split the input buffer up to the \r\n */
+    // 根据空格，分割命令的参数
+    // 比如说 SET msg hello \r\n 将分割为
+    // argv[0] = SET
+    // argv[1] = msg
+    // argv[2] = hello
+    // argc = 3
+    querylen = newline-(c->querybuf);
+    aux = sdsnewlen(c->querybuf,querylen);
+    argv = sdssplitargs(aux,&argc);
+    sdsfree(aux);
+    if (argv == NULL) {
+        addReplyError(c,"Protocol error: unbalanced quotes in request");
+        setProtocolError(c,0);
+        return REDIS_ERR;
+    }
+
+    /* Leave data after the first line of the query in the buffer */
+    // 从缓冲区中删除已 argv 已读取的内容
+    // 剩余的内容是未读取的
+    sdsrange(c->querybuf,querylen+2,-1);
+
+    /* Setup argv array on client structure */
+    // 为客户端的参数分配空间
+    if (c->argv) zfree(c->argv);
+    c->argv = zmalloc(sizeof(robj*)*argc);
+
+    /* Create redis objects for all arguments. */
+    // 为每个参数创建一个字符串对象
+    for (c->argc = 0, j = 0; j < argc; j++) {
+        if (sdslen(argv[j])) {
+            // argv[j] 已经是 SDS 了
+            // 所以创建的字符串对象直接指向该 SDS
+            c->argv[c->argc] = createObject(REDIS_STRING,argv[j]);
+            c->argc++;
+        } else {
+            sdsfree(argv[j]);
+        }
+    }
+
+    zfree(argv);
+
+    return REDIS_OK;
+}
+
+/*
+ * 将 c->querybuf 中的协议内容转换成 c->argv 中的参数对象
+ *
+ * 比如 *3\r\n$3\r\nSET\r\n$3\r\nMSG\r\n$5\r\nHELLO\r\n
+ * 将被转换为：
+ * argv[0] = SET
+ * argv[1] = MSG
+ * argv[2] = HELLO
+ */
+int processMultibulkBuffer(redisClient *c) {
+    char *newline = NULL;
+    int pos = 0, ok;
+    long long ll;
+
+    // 读入命令的参数个数
+    // 比如 *3\r\n$3\r\nSET\r\n... 将令 c->multibulklen = 3
+    if (c->multibulklen == 0) {
+        /* The client should have been reset */
+        if (c->argc != 0) {
+            fprintf(stderr,"processMultibulkBuffer: client not reset\n");
+            abort();
+        }
+
+        /* Multi bulk length cannot be read without a \r\n */
+        // 检查缓冲区的内容第一个 "\r\n"
+        newline = strchr(c->querybuf,'\r');
+        if (newline == NULL) {
+            if (sdslen(c->querybuf) > REDIS_INLINE_MAX_SIZE) {
+                addReplyError(c,"Protocol error: too big mbulk count string");
+                setProtocolError(c,0);
+            }
+            return REDIS_ERR;
+        }
+        /* Buffer should also contain \n */
+        if (newline-(c->querybuf) > ((signed)sdslen(c->querybuf)-2))
+            return REDIS_ERR;
+
+        /* We know for sure there is a whole line since newline != NULL,
+         * so go ahead and find out the multi bulk length. */
+        // 协议的第一个字符必须是 '*'
+        // 将参数个数，也即是 * 之后， \r\n 之前的数字取出并保存到 ll 中
+        // 比如对于 *3\r\n ，那么 ll 将等于 3
+        ok = string2ll(c->querybuf+1,newline-(c->querybuf+1),&ll);
+        // 参数的数量超出限制
+        if (!ok || ll > 1024*1024) {
+            addReplyError(c,"Protocol error: invalid multibulk length");
+            setProtocolError(c,pos);
+            return REDIS_ERR;
+        }
+
+        // 参数数量之后的位置
+        // 比如对于 *3\r\n$3\r\n$SET\r\n... 来说，
+        // pos 指向 *3\r\n$3\r\n$SET\r\n...
+        //                ^
+        //                |
+        //               pos
+        pos = (newline-c->querybuf)+2;
+        // 如果 ll <= 0 ，那么这个命令是一个空白命令
+        // 那么将这段内容从查询缓冲区中删除，只保留未阅读的那部分内容
+        // 为什么参数可以是空的呢？
+        // processInputBuffer 中有注释到 "Multibulk processing could see a <= 0 length"
+        // 但并没有详细说明原因
+        if (ll <= 0) {
+            sdsrange(c->querybuf,pos,-1);
+            return REDIS_OK;
+        }
+
+        // 设置参数数量
+        c->multibulklen = ll;
+
+        /* Setup argv array on client structure */
+        // 根据参数数量，为各个参数对象分配空间
+        if (c->argv) zfree(c->argv);
+        c->argv = zmalloc(sizeof(robj*)*c->multibulklen);
+    }
+
+    // 从 c->querybuf 中读入参数，并创建各个参数对象到 c->argv
+    while(c->multibulklen) {
+
+        /* Read bulk length if unknown */
+        // 读入参数长度
+        if (c->bulklen == -1) {
+
+            // 确保 "\r\n" 存在
+            newline = strchr(c->querybuf+pos,'\r');
+            if (newline == NULL) {
+                if (sdslen(c->querybuf) > REDIS_INLINE_MAX_SIZE) {
+                    addReplyError(c,
+                        "Protocol error: too big bulk count string");
+                    setProtocolError(c,0);
+                    return REDIS_ERR;
+                }
+                break;
+            }
+            /* Buffer should also contain \n */
+            if (newline-(c->querybuf) > ((signed)sdslen(c->querybuf)-2))
+                break;
+
+            // 确保协议符合参数格式，检查其中的 $...
+            // 比如 $3\r\nSET\r\n
+            if (c->querybuf[pos] != '$') {
+                addReplyErrorLength(c,"Protocol error: expected '$'",28);
+                setProtocolError(c,pos);
+                return REDIS_ERR;
+            }
+
+            // 读取长度
+            // 比如 $3\r\nSET\r\n 将会让 ll 的值设置 3
+            ok = string2ll(c->querybuf+pos+1,newline-(c->querybuf+pos+1),&ll);
+            if (!ok || ll < 0 || ll > 512*1024*1024) {
+                addReplyError(c,"Protocol error: invalid bulk length");
+                setProtocolError(c,pos);
+                return REDIS_ERR;
+            }
+
+            // 定位到参数的开头
+            // 比如
+            // $3\r\nSET\r\n...
+            //       ^
+            //       |
+            //      pos
+            pos += newline-(c->querybuf+pos)+2;
+            // 如果参数非常长，那么做一些预备措施来优化接下来的参数复制操作
+            if (ll >= REDIS_MBULK_BIG_ARG) {
+                size_t qblen;
+
+                /* If we are going to read a large object from network
+                 * try to make it likely that it will start at c->querybuf
+                 * boundary so that we can optimize object creation
+                 * avoiding a large copy of data. */
+                sdsrange(c->querybuf,pos,-1);
+                pos = 0;
+                qblen = sdslen(c->querybuf);
+                /* Hint the sds library about the amount of bytes this string is
+                 * going to contain. */
+                if (qblen < (size_t)ll+2)
+                    c->querybuf = sdsMakeRoomFor(c->querybuf,ll+2-qblen);
+            }
+            // 参数的长度
+            c->bulklen = ll;
+        }
+
+        /* Read bulk argument */
+        // 读入参数
+        if (sdslen(c->querybuf)-pos < (unsigned)(c->bulklen+2)) {
+            // 确保内容符合协议格式
+            // 比如 $3\r\nSET\r\n 就检查 SET 之后的 \r\n
+            /* Not enough data (+2 == trailing \r\n) */
+            break;
+        } else {
+            // 为参数创建字符串对象
+            /* Optimization: if the buffer contains JUST our bulk element
+             * instead of creating a new object by *copying* the sds we
+             * just use the current sds string. */
+            if (pos == 0 &&
+                c->bulklen >= REDIS_MBULK_BIG_ARG &&
+                (signed) sdslen(c->querybuf) == c->bulklen+2)
+            {
+                c->argv[c->argc++] = createObject(REDIS_STRING,c->querybuf);
+                sdsIncrLen(c->querybuf,-2); /* remove CRLF */
+                c->querybuf = sdsempty();
+                /* Assume that if we saw a fat argument we'll see another one
+                 * likely... */
+                c->querybuf = sdsMakeRoomFor(c->querybuf,c->bulklen+2);
+                pos = 0;
+            } else {
+                c->argv[c->argc++] =
+                    createStringObject(c->querybuf+pos,c->bulklen);
+                pos += c->bulklen+2;
+            }
+
+            // 清空参数长度
+            c->bulklen = -1;
+
+            // 减少还需读入的参数个数
+            c->multibulklen--;
+        }
+    }
+
+    /* Trim to pos */
+    // 从 querybuf 中删除已被读取的内容
+    if (pos) sdsrange(c->querybuf,pos,-1);
+
+    /* We're done when c->multibulk == 0 */
+    // 如果本条命令的所有参数都已读取完，那么返回
+    if (c->multibulklen == 0) return REDIS_OK;
+
+    /* Still not read to process the command */
+    // 如果还有参数未读取完，那么就协议内容有错
+    return REDIS_ERR;
+}
+
+/*
+ * 在客户端的主线程上执行已经解析好的命令，执行成功之后重置客户端
+ */
+static void processCommandAndResetClient(redisClient *c) {
+    long long start;
+    int retval;
+
+    if (c->argc == 0) {
+        /* Multibulk processing could see a <= 0 length. */
+        resetClient(c);
+    } else {
+        // 执行命令，并记下本轮循环中最慢的命令，以便卡顿时报告
+        start = aeMonotonicMicroseconds();
+        retval = processCommand(c);
+        latencyTrackCommand(c,aeMonotonicMicroseconds()-start);
+
+        /* Only reset the client when the command was executed. */
+        // 重置客户端
+        // 命令被转交给其他 reactor 线程时，那个线程还在使用 argv ，
+        // 等客户端回来之后由 reactorResumeClient 重置
+        if (retval == REDIS_OK && !(c->flags & REDIS_REMOTE_EXEC))
+            resetClient(c);
+    }
+}
+
+// 处理客户端输入的命令内容
+//
+// 在 I/O 线程中调用时（客户端带有 REDIS_PENDING_READ 标志），
+// 只解析出第一条完整的命令就返回，并打开 REDIS_PENDING_COMMAND 标志，
+// 命令由主线程执行，剩下的输入也由主线程继续处理。
+//
+// 命令被转交给其他 reactor 线程执行时（ REDIS_REMOTE_EXEC ），也立即返回，
+// 剩下的输入由 reactorResumeClient 在客户端回来之后继续处理。
+void processInputBuffer(redisClient *c) {
+
+    /* Keep processing while there is something in the input buffer */
+    // 尽可能地处理查询缓冲区中的内容
+    // 如果读取出现 short read ，那么可能会有内容滞留在读取缓冲区里面
+    // 这些滞留内容也许不能完整构成一个符合协议的命令，
+    // 需要等待下次读事件的就绪
+    while(sdslen(c->querybuf)) {
+
+        /* REDIS_CLOSE_AFTER_REPLY closes the connection once the reply is
+         * written to the client. Make sure to not let the reply grow after
+         * this flag has been set (i.e. don't process more commands). */
+        // 客户端已经设置了关闭 FLAG ，没有必要处理命令了
+        if (c->flags & (REDIS_CLOSE_AFTER_REPLY|REDIS_CLOSE_ASAP)) break;
+
+        // 上一条命令还在其他 reactor 线程上执行，客户端暂时不归这个线程所有
+        if (c->flags & REDIS_REMOTE_EXEC) break;
+
+        // 异步读操作正在往 querybuf 的末尾写入，不能移动其中的内容，
+        // 剩下的命令等读操作完成之后再处理
+        if (c->flags & REDIS_IO_READ_INFLIGHT) break;
+
+        /* Determine request type when unknown. */
+        // 判断请求的类型
+        // 两种类型的区别可以在 Redis 的通讯协议上查到：
+        // http://redis.readthedocs.org/en/latest/topic/protocol.html
+        // 简单来说，多条查询是一般客户端发送来的，
+        // 而内联查询则是 TELNET 发送来的
+        if (!c->reqtype) {
+            if (c->querybuf[0] == '*') {
+                // 多条查询
+                c->reqtype = REDIS_REQ_MULTIBULK;
+            } else {
+                // 内联查询
+                c->reqtype = REDIS_REQ_INLINE;
+            }
+        }
+
+        // 将缓冲区中的内容转换成命令，以及命令参数
+        if (c->reqtype == REDIS_REQ_INLINE) {
+            if (processInlineBuffer(c) != REDIS_OK) break;
+        } else if (c->reqtype == REDIS_REQ_MULTIBULK) {
+            if (processMultibulkBuffer(c) != REDIS_OK) break;
+        } else {
+            fprintf(stderr,"Unknown request type\n");
+            abort();
+        }
+
+        // I/O 线程只负责解析，命令留给主线程执行
+        if (c->flags & REDIS_PENDING_READ) {
+            c->flags |= REDIS_PENDING_COMMAND;
+            break;
+        }
+
+        processCommandAndResetClient(c);
+    }
+}
+
+/*
+ * 在使用 I/O 线程读取时，将客户端的读取推迟到 beforeSleep 中进行
+ *
+ * 推迟成功返回 1 ，否则返回 0 ，由调用者立即读取
+ */
+static int postponeClientRead(redisClient *c) {
+    if (server.io_threads_active &&
+        server.io_threads_do_reads &&
+        c->worker == NULL &&
+        !(c->flags & (REDIS_PENDING_READ|REDIS_CLOSE_ASAP)))
+    {
+        c->flags |= REDIS_PENDING_READ;
+        listAddNodeHead(server.clients_pending_read,c);
+        return 1;
+    }
+    return 0;
+}
+
+/*
+ * 设置客户端套接字在事件循环中的优先级
+ *
+ * 比如管理连接和健康检查可以设置为 AE_PRIO_ADMIN ，
+ * 这样即使有大量客户端在发送流水线请求，它们的命令也能在每一轮循环中最先执行
+ */
+void setClientPriority(redisClient *c, int priority) {
+    c->priority = priority;
+    if (c->fd != -1)
+        aeSetFileEventPriority(clientEventLoop(c),c->fd,priority);
+}
+
+/*
+ * 根据读取的结果自动调整一般客户端的优先级
+ *
+ * 一次读满了读入长度，说明套接字里还有更多的数据，客户端正在大批量地发送请求，
+ * 将它降为 AE_PRIO_BULK ，每轮循环中这类客户端的事件数量受
+ * server.bulk_events_per_loop 限制；读不满时恢复为 AE_PRIO_NORMAL 。
+ *
+ * 用 setClientPriority 设置了其他优先级的客户端不受影响
+ */
+static void updateClientPriority(redisClient *c, int full) {
+    if (full && c->priority == AE_PRIO_NORMAL)
+        setClientPriority(c,AE_PRIO_BULK);
+    else if (!full && c->priority == AE_PRIO_BULK)
+        setClientPriority(c,AE_PRIO_NORMAL);
+}
+
+/*
+ * 计算下一次读取客户端时最多读入的长度
+ */
+static int clientReadLength(redisClient *c) {
+    // 读入长度（默认为 16 MB）
+    int readlen = REDIS_IOBUF_LEN;
+
+    /* If this is a multi bulk request, and we are processing a bulk reply
+     * that is large enough, try to maximize the probability that the query
+     * buffer contains exactly the SDS string representing the object, even
+     * at the risk of requiring more read(2) calls. This way the function
+     * processMultiBulkBuffer() can avoid copying buffers to create the
+     * Redis Object representing the argument. */
+    if (c->reqtype == REDIS_REQ_MULTIBULK && c->multibulklen && c->bulklen != -1
+        && c->bulklen >= REDIS_MBULK_BIG_ARG)
+    {
+        int remaining = (unsigned)(c->bulklen+2)-sdslen(c->querybuf);
+
+        if (remaining < readlen) readlen = remaining;
+    }
+    return readlen;
+}
+
+/*
+ * 处理一次读取的结果，nread 为读入的字节数，出错时为 -errno
+ *
+ * 读入的内容已经在 querybuf 的末尾，更新 querybuf 的长度之后处理其中的命令
+ */
+static void readQueryFromClientResult(redisClient *c, ssize_t nread, int readlen) {
+    // 读入出错
+    if (nread < 0) {
+        // 在 EAGAIN 时没有读入任何内容
+        if (nread != -EAGAIN) freeClientAsync(c);
+        return;
+    // 遇到 EOF
+    } else if (nread == 0) {
+        freeClientAsync(c);
+        return;
+    }
+
+    // 根据内容，更新查询缓冲区（SDS） free 和 len 属性
+    // 并将 '\0' 正确地放到内容的最后
+    sdsIncrLen(c->querybuf,nread);
+    updateClientPriority(c,nread == readlen);
+
+    // 查询缓冲区长度超出服务器最大缓冲区长度
+    // 清空缓冲区并释放客户端
+    if (sdslen(c->querybuf) > server.client_max_querybuf_len) {
+        freeClientAsync(c);
+        return;
+    }
+
+    // 从查询缓存重读取内容，创建参数，并执行命令
+    // 函数会执行到缓存中的所有内容都被处理完为止
+    processInputBuffer(c);
+}
+
+/*
+ * 异步读操作的完成处理器，res 为读入的字节数，出错时为 -errno
+ *
+ * 操作执行期间客户端的状态没有变化，所以重新计算出的读入长度和提交时相同
+ */
+static void readQueryFromClientDone(aeEventLoop *el, int fd, void *privdata, ssize_t res) {
+    redisClient *c = privdata;
+    REDIS_NOTUSED(el);
+    REDIS_NOTUSED(fd);
+
+    c->flags &= ~REDIS_IO_READ_INFLIGHT;
+    if (c->flags & REDIS_CLOSE_AFTER_IO) {
+        freeClient(c);
+        return;
+    }
+    readQueryFromClientResult(c,res,clientReadLength(c));
+}
+
+/*
+ * 读取客户端的查询缓冲区内容
+ *
+ * 事件循环使用 io_uring 时，读操作被提交给事件循环，
+ * 和本轮其他客户端的读写一起通过一次 io_uring_enter 执行，
+ * 读入的内容由 readQueryFromClientDone 处理。
+ * el 为 NULL （在 I/O 线程中调用）时总是同步读取。
+ */
+void readQueryFromClient(aeEventLoop *el, int fd, void *privdata, int mask) {
+    redisClient *c = (redisClient*) privdata;
+    ssize_t nread;
+    int readlen;
+    size_t qblen;
+    REDIS_NOTUSED(mask);
+
+    // 上一次的异步读操作还没有完成
+    if (c->flags & REDIS_IO_READ_INFLIGHT) return;
+
+    // 交给 I/O 线程读取
+    if (postponeClientRead(c)) return;
+
+    readlen = clientReadLength(c);
+
+    // 获取查询缓冲区当前内容的长度
+    // 如果读取出现 short read ，那么可能会有内容滞留在读取缓冲区里面
+    // 这些滞留内容也许不能完整构成一个符合协议的命令，
+    qblen = sdslen(c->querybuf);
+    // 如果有需要，更新缓冲区内容长度的峰值（peak）
+    if (c->querybuf_peak < qblen) c->querybuf_peak = qblen;
+    // 为查询缓冲区分配空间
+    c->querybuf = sdsMakeRoomFor(c->querybuf, readlen);
+
+    // 异步读取，完成之前 querybuf 不能被修改
+    if (el && el->iodata) {
+        c->flags |= REDIS_IO_READ_INFLIGHT;
+        aeSubmitRead(el,fd,c->querybuf+qblen,readlen,readQueryFromClientDone,c);
+        return;
+    }
+
+    // 读入内容到查询缓存
+    nread = read(fd, c->querybuf+qblen, readlen);
+    if (nread == -1) nread = -errno;
+    readQueryFromClientResult(c,nread,readlen);
+}
+
+/* -----------------------------------------------------------------------------
+ * Threaded I/O
+ *
+ * 命令总是在主线程上执行，I/O 线程只负责：
+ *
+ *  - 从套接字读取数据到 querybuf ，并把 REDIS_REQ_MULTIBULK 协议解析成 argv ；
+ *  - 把 buf 和 reply 中的回复写回套接字。
+ *
+ * 读事件就绪时 readQueryFromClient 只把客户端放进 server.clients_pending_read ，
+ * 有回复时 prepareClientToWrite 把客户端放进 server.clients_pending_write ，
+ * 主线程在 beforeSleep 中把这两个链表成批地平均分给所有 I/O 线程（主线程也算一个），
+ * 等待它们全部完成之后再继续。
+ *
+ * I/O 线程在没有任务时会先自旋一段时间，然后阻塞在各自的互斥锁上；
+ * 等待写出的客户端很少时，主线程会持有这些锁，让 I/O 线程停下来，
+ * 自己完成所有读写。
+ * -------------------------------------------------------------------------- */
+
+#define IO_THREADS_OP_READ 0
+#define IO_THREADS_OP_WRITE 1
+
+static pthread_t io_threads[REDIS_IO_THREADS_MAX_NUM];
+static pthread_mutex_t io_threads_mutex[REDIS_IO_THREADS_MAX_NUM];
+// 每个线程等待处理的客户端数量，由主线程设置，线程处理完毕之后清零
+static unsigned long io_threads_pending[REDIS_IO_THREADS_MAX_NUM];
+// 当前这一批任务是读还是写
+static int io_threads_op;
+// 分配给每个线程的客户端
+static list *io_threads_list[REDIS_IO_THREADS_MAX_NUM];
+
+static unsigned long getIOPendingCount(int i) {
+    return __atomic_load_n(&io_threads_pending[i],__ATOMIC_ACQUIRE);
+}
+
+static void setIOPendingCount(int i, unsigned long count) {
+    __atomic_store_n(&io_threads_pending[i],count,__ATOMIC_RELEASE);
+}
+
+/*
+ * 清空链表中的所有节点
+ */
+static void listEmptyNodes(list *l) {
+    while (listLength(l)) listDelNode(l,listFirst(l));
+}
+
+/*
+ * 处理分配给线程 id 的所有客户端
+ */
+static void processIOThreadList(int id) {
+    listIter li;
+    listNode *ln;
+
+    listRewind(io_threads_list[id],&li);
+    while((ln = listNext(&li))) {
+        redisClient *c = listNodeValue(ln);
+
+        if (io_threads_op == IO_THREADS_OP_WRITE) {
+            writeToClient(c->fd,c,0);
+        } else {
+            readQueryFromClient(NULL,c->fd,c,0);
+        }
+    }
+    listEmptyNodes(io_threads_list[id]);
+}
+
+/*
+ * I/O 线程的入口
+ */
+static void *IOThreadMain(void *myid) {
+    /* The ID is the thread number (from 0 to server.io_threads_num-1), and is
+     * used by the thread to just manipulate a single sub-array of clients. */
+    long id = (unsigned long)myid;
+
+    while(1) {
+        int j;
+
+        /* Wait for start */
+        // 先自旋等待任务，避免每一批任务都要经过互斥锁唤醒
+        for (j = 0; j < 1000000; j++) {
+            if (getIOPendingCount(id) != 0) break;
+        }
+
+        /* Give the main thread a chance to stop this thread. */
+        if (getIOPendingCount(id) == 0) {
+            pthread_mutex_lock(&io_threads_mutex[id]);
+            pthread_mutex_unlock(&io_threads_mutex[id]);
+            continue;
+        }
+
+        /* Process: note that the main thread will never touch our list
+         * before we drop the pending count to 0. */
+        processIOThreadList(id);
+        setIOPendingCount(id, 0);
+    }
+    return NULL;
+}
+
+/*
+ * 创建 I/O 线程
+ *
+ * 线程创建之后处于停止状态，等到有足够的客户端等待写出时才会被启动
+ */
+void initThreadedIO(void) {
+    int i;
+
+    server.io_threads_active = 0; /* We start with threads not active. */
+    pthread_mutex_init(&server.async_free_queue_mutex,NULL);
+
+    /* Don't spawn any thread if the user selected a single thread:
+     * we'll handle I/O directly from the main thread. */
+    if (server.io_threads_num <= 1) return;
+
+    // 多 reactor 模式下，客户端由各自的 reactor 线程处理，不使用 I/O 线程
+    if (server.reactors > 0) {
+        redisLog(REDIS_WARNING,"Threaded I/O is not used in multi-reactor mode.");
+        server.io_threads_num = 1;
+        return;
+    }
+
+    if (server.io_threads_num > REDIS_IO_THREADS_MAX_NUM) {
+        redisLog(REDIS_WARNING,"Fatal: too many I/O threads configured. "
+                               "The maximum number is %d.", REDIS_IO_THREADS_MAX_NUM);
+        exit(1);
+    }
+
+    // I/O 线程会分配和释放内存
+    zmalloc_enable_thread_safeness();
+
+    /* Spawn and initialize the I/O threads. */
+    for (i = 0; i < server.io_threads_num; i++) {
+        /* Things we do for all the threads including the main thread. */
+        io_threads_list[i] = listCreate();
+        if (i == 0) continue; /* Thread 0 is the main thread. */
+
+        /* Things we do only for the additional threads. */
+        pthread_mutex_init(&io_threads_mutex[i],NULL);
+        setIOPendingCount(i, 0);
+        pthread_mutex_lock(&io_threads_mutex[i]); /* Thread will be stopped. */
+        if (pthread_create(&io_threads[i],NULL,IOThreadMain,(void*)(long)i) != 0) {
+            redisLog(REDIS_WARNING,"Fatal: Can't initialize IO thread.");
+            exit(1);
+        }
+    }
+}
+
+/*
+ * 启动 I/O 线程
+ */
+static void startThreadedIO(void) {
+    int j;
+
+    for (j = 1; j < server.io_threads_num; j++)
+        pthread_mutex_unlock(&io_threads_mutex[j]);
+    server.io_threads_active = 1;
+}
+
+/*
+ * 停止 I/O 线程
+ */
+static void stopThreadedIO(void) {
+    int j;
+
+    /* We may have still clients with pending reads when this function
+     * is called: handle them before stopping the threads. */
+    handleClientsWithPendingReadsUsingThreads();
+    for (j = 1; j < server.io_threads_num; j++)
+        pthread_mutex_lock(&io_threads_mutex[j]);
+    server.io_threads_active = 0;
+}
+
+/* This function checks if there are not enough pending clients to justify
+ * taking the I/O threads active: in that case I/O threads are stopped if
+ * currently active.
+ *
+ * The function returns 0 if the I/O threading should be used becuase there
+ * are enough active threads, otherwise 1 is returned and the I/O threads
+ * could be possibly stopped (if already active) as a side effect.
+ *
+ * 等待写出的客户端少于线程数的两倍时，由主线程自己处理，并停止 I/O 线程
+ */
+static int stopThreadedIOIfNeeded(void) {
+    unsigned long pending = listLength(server.clients_pending_write);
+
+    /* Return ASAP if IO threads are disabled (single threaded mode). */
+    if (server.io_threads_num == 1) return 1;
+
+    if (pending < (unsigned long)server.io_threads_num*2) {
+        if (server.io_threads_active) stopThreadedIO();
+        return 1;
+    } else {
+        return 0;
+    }
+}
+
+/*
+ * 将链表 l 中的客户端平均分配给所有 I/O 线程，并等待它们处理完毕
+ */
+static void dispatchToIOThreads(list *l, int op) {
+    listIter li;
+    listNode *ln;
+    int item_id = 0, j;
+
+    /* Distribute the clients across N different lists. */
+    listRewind(l,&li);
+    while((ln = listNext(&li))) {
+        redisClient *c = listNodeValue(ln);
+        int target_id = item_id % server.io_threads_num;
+
+        listAddNodeTail(io_threads_list[target_id],c);
+        item_id++;
+    }
+
+    /* Give the start condition to the waiting threads, by setting the
+     * start condition atomic var. */
+    io_threads_op = op;
+    for (j = 1; j < server.io_threads_num; j++) {
+        unsigned long count = listLength(io_threads_list[j]);
+        setIOPendingCount(j, count);
+    }
+
+    /* Also use the main thread to process a slice of clients. */
+    processIOThreadList(0);
+
+    /* Wait for all the other threads to end their work. */
+    while(1) {
+        unsigned long pending = 0;
+
+        for (j = 1; j < server.io_threads_num; j++)
+            pending += getIOPendingCount(j);
+        if (pending == 0) break;
+    }
+}
+
+/*
+ * 在 beforeSleep 中调用：写出链表 pending 中所有客户端的回复
+ *
+ * 不使用 I/O 线程时由主线程调用，多 reactor 模式下由各个 reactor 线程
+ * 对自己的链表调用。一次没能写完的客户端，安装写处理器，等套接字可写时继续写出。
+ */
+int handleClientsWithPendingWrites(list *pending) {
+    int processed = listLength(pending);
+
+    while (listLength(pending)) {
+        listNode *ln = listFirst(pending);
+        redisClient *c = listNodeValue(ln);
+
+        c->flags &= ~REDIS_PENDING_WRITE;
+        listDelNode(pending,ln);
+
+        // 已经在异步释放队列中了
+        if (c->flags & REDIS_CLOSE_ASAP) continue;
+
+        // 事件循环使用 io_uring 时，所有客户端的写操作在下一次 aeFlushIo 中一起提交，
+        // 写不完的部分由完成处理器安装写处理器
+        if (clientEventLoop(c)->iodata) {
+            writeToClientAsync(c);
+            continue;
+        }
+
+        /* Try to write buffers to the client socket. */
+        if (writeToClient(c->fd,c,0) == REDIS_ERR) continue;
+
+        /* If after the synchronous writes above we still have data to
+         * output to the client, we need to install the writable handler. */
+        if (clientHasPendingReplies(c) &&
+            aeCreateFileEvent(clientEventLoop(c),c->fd,AE_WRITABLE,
+                sendReplyToClient,c) == AE_ERR)
+        {
+            freeClientAsync(c);
+        }
+    }
+    return processed;
+}
+
+/*
+ * 在 beforeSleep 中调用：用 I/O 线程写出所有等待写出的客户端
+ *
+ * 一次没能写完的客户端，安装写处理器，等套接字可写时由主线程继续写出
+ */
+int handleClientsWithPendingWritesUsingThreads(void) {
+    int processed = listLength(server.clients_pending_write);
+
+    if (processed == 0) return 0; /* Return ASAP if there are no clients. */
+
+    /* If I/O threads are disabled or we have few clients to serve, don't
+     * use I/O threads, but the boring synchronous code. */
+    if (server.io_threads_num == 1 || stopThreadedIOIfNeeded())
+        return handleClientsWithPendingWrites(server.clients_pending_write);
+
+    /* Start threads if needed. */
+    if (!server.io_threads_active) startThreadedIO();
+
+    dispatchToIOThreads(server.clients_pending_write,IO_THREADS_OP_WRITE);
+
+    /* Run the list of clients again to install the write handler where
+     * needed. */
+    while (listLength(server.clients_pending_write)) {
+        listNode *ln = listFirst(server.clients_pending_write);
+        redisClient *c = listNodeValue(ln);
+
+        c->flags &= ~REDIS_PENDING_WRITE;
+        listDelNode(server.clients_pending_write,ln);
+
+        // 写出时出错的客户端已经在异步释放队列中了
+        if (c->flags & REDIS_CLOSE_ASAP) continue;
+
+        /* Install the write handler if there are pending writes in some
+         * of the clients. */
+        if (clientHasPendingReplies(c) &&
+            aeCreateFileEvent(server.el,c->fd,AE_WRITABLE,
+                sendReplyToClient,c) == AE_ERR)
+        {
+            freeClientAsync(c);
+        }
+    }
+    server.stat_io_writes_processed += processed;
+    return processed;
+}
+
+/*
+ * 在 beforeSleep 中调用：用 I/O 线程读取并解析所有等待读取的客户端，
+ * 然后在主线程上执行解析出来的命令
+ */
+int handleClientsWithPendingReadsUsingThreads(void) {
+    int processed = listLength(server.clients_pending_read);
+
+    if (!server.io_threads_active || !server.io_threads_do_reads) return 0;
+    if (processed == 0) return 0;
+
+    dispatchToIOThreads(server.clients_pending_read,IO_THREADS_OP_READ);
+
+    /* Run the list of clients again to process the new buffers. */
+    while(listLength(server.clients_pending_read)) {
+        listNode *ln = listFirst(server.clients_pending_read);
+        redisClient *c = listNodeValue(ln);
+
+        c->flags &= ~REDIS_PENDING_READ;
+        listDelNode(server.clients_pending_read,ln);
+
+        // 读取时出错的客户端已经在异步释放队列中了
+        if (c->flags & REDIS_CLOSE_ASAP) continue;
+
+        // 执行 I/O 线程解析出来的命令
+        if (c->flags & REDIS_PENDING_COMMAND) {
+            c->flags &= ~REDIS_PENDING_COMMAND;
+            processCommandAndResetClient(c);
+        }
+
+        // 查询缓冲区中剩下的命令由主线程解析和执行
+        processInputBuffer(c);
+
+        // I/O 线程在解析出错时添加的回复
+        if (clientHasPendingReplies(c)) prepareClientToWrite(c);
+    }
+    server.stat_io_reads_processed += processed;
+    return processed;
+}
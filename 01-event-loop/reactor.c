@@ -0,0 +1,604 @@
+/* Multi-reactor mode.
+ *
+ * 默认情况下服务器只有一个事件循环 server.el ，所有客户端都在主线程上处理。
+ *
+ * 打开多 reactor 模式（server.reactors > 0）之后：
+ *
+ *  - 启动 server.reactors 个线程，每个线程拥有自己的 aeEventLoop ，
+ *    并且可以绑定到一个 CPU 核上；
+ *
+ *  - 每个线程都在 server.port 上创建自己的 SO_REUSEPORT 监听套接字，
+ *    由内核把新连接分散到各个线程，线程各自 accept ，互不加锁；
+ *
+ *  - 每个线程有自己的客户端链表，客户端的读写都只在它所属的线程上进行；
+ *
+ *  - 键空间按槽（crc16(key) & 16383）划分，每个线程负责一段连续的槽，
+ *    并拥有这些槽所对应的 redisDb 数组。命令的键不属于当前线程时，
+ *    命令会通过 mailbox 转交给负责的线程执行，执行完毕后再交还原线程发送回复。
+ *
+ * 线程之间唯一的通信方式是 reactorSubmit() ：
+ * 把任务放进目标线程的 mailbox ，再通过管道唤醒目标线程的事件循环。
+ */
+
+#include "redis.h"
+
+#include <sched.h>
+#include <fcntl.h>
+
+/* 当前线程所属的 reactor ，主线程和单线程模式下为 NULL */
+static __thread redisWorker *current_worker = NULL;
+
+/*
+ * mailbox 中的一个任务
+ */
+typedef struct reactorTask {
+
+    reactorTaskProc *proc;   // 在目标线程上执行的函数
+
+    void *privdata;          // 传给 proc 的参数
+
+} reactorTask;
+
+/* ----------------------------- Hash slots --------------------------------- */
+
+/* We have 16384 hash slots. The hash slot of a given key is obtained
+ * as the least significant 14 bits of the crc16 of the key.
+ *
+ * However if the key contains the {...} pattern, only the part between
+ * { and } is hashed. This may be useful in the future to force certain
+ * keys to be in the same node (assuming no resharding is in progress).
+ *
+ * 计算给定键的槽号
+ *
+ * 如果键中带有 {...} ，那么只对 { 和 } 之间的部分进行哈希，
+ * 这样就可以让多个键落在同一个线程上，从而在一个命令里一起操作。
+ */
+unsigned int keyHashSlot(char *key, int keylen) {
+    int s, e; /* start-end indexes of { and } */
+
+    for (s = 0; s < keylen; s++)
+        if (key[s] == '{') break;
+
+    /* No '{' ? Hash the whole key. This is the base case. */
+    if (s == keylen) return crc16(key,keylen) & (REDIS_CLUSTER_SLOTS-1);
+
+    /* '{' found? Check if we have the corresponding '}'. */
+    for (e = s+1; e < keylen; e++)
+        if (key[e] == '}') break;
+
+    /* No '}' or nothing betweeen {} ? Hash the whole key. */
+    if (e == keylen || e == s+1) return crc16(key,keylen) & (REDIS_CLUSTER_SLOTS-1);
+
+    /* If we are here there is both a { and a } on its right. Hash
+     * what is in the middle between { and }. */
+    return crc16(key+s+1,e-s-1) & (REDIS_CLUSTER_SLOTS-1);
+}
+
+/*
+ * 返回负责给定槽的 reactor 线程
+ *
+ * 槽被平均地切分成 server.reactors 段连续的区间
+ */
+redisWorker *reactorWorkerForSlot(unsigned int slot) {
+    return server.workers + (slot * server.reactors / REDIS_CLUSTER_SLOTS);
+}
+
+/*
+ * 返回当前线程所属的 reactor ，不在 reactor 线程中时返回 NULL
+ */
+redisWorker *reactorGetCurrentWorker(void) {
+    return current_worker;
+}
+
+/* ------------------------------- Mailbox ---------------------------------- */
+
+/*
+ * 将任务提交到 reactor 线程 w 上执行
+ *
+ * 任务会在 w 的事件循环下一次处理文件事件时被执行，
+ * 同一个线程提交给 w 的任务按提交的顺序执行。
+ *
+ * 可以在任意线程上调用。
+ */
+int reactorSubmit(redisWorker *w, reactorTaskProc *proc, void *privdata) {
+    reactorTask *task = zmalloc(sizeof(*task));
+    int wakeup;
+
+    task->proc = proc;
+    task->privdata = privdata;
+
+    pthread_mutex_lock(&w->mailbox_mutex);
+    // mailbox 原本为空时才需要唤醒，否则唤醒信号已经在路上了
+    wakeup = listLength(w->mailbox) == 0;
+    listAddNodeTail(w->mailbox,task);
+    pthread_mutex_unlock(&w->mailbox_mutex);
+
+    if (wakeup && write(w->notify_pipe[1],"x",1) == -1 && errno != EAGAIN) {
+        redisLog(REDIS_WARNING,"Can't wake up reactor %d: %s",
+            w->id, strerror(errno));
+        return REDIS_ERR;
+    }
+    return REDIS_OK;
+}
+
+/*
+ * mailbox 管道的读处理器
+ *
+ * 一次取出 mailbox 中的所有任务，然后在不持有锁的情况下逐个执行
+ */
+static void reactorMailboxHandler(aeEventLoop *el, int fd, void *privdata, int mask) {
+    redisWorker *w = privdata;
+    char buf[64];
+    list *tasks;
+    listNode *ln;
+    REDIS_NOTUSED(el);
+    REDIS_NOTUSED(mask);
+
+    // 清空管道中的唤醒信号
+    while (read(fd,buf,sizeof(buf)) > 0);
+
+    pthread_mutex_lock(&w->mailbox_mutex);
+    tasks = w->mailbox;
+    w->mailbox = listCreate();
+    pthread_mutex_unlock(&w->mailbox_mutex);
+
+    while ((ln = listFirst(tasks)) != NULL) {
+        reactorTask *task = listNodeValue(ln);
+
+        listDelNode(tasks,ln);
+        task->proc(w,task->privdata);
+        zfree(task);
+    }
+    listRelease(tasks);
+}
+
+/* --------------------------- Command routing ------------------------------ */
+
+/*
+ * 在负责的线程上执行完命令之后，回到客户端所属的线程：
+ * 重置客户端，恢复读事件，继续处理查询缓冲区中流水线的其他命令，
+ * 如果有回复的话放进待写出链表，由 beforesleep 写出
+ */
+static void reactorResumeClient(redisWorker *w, void *privdata) {
+    redisClient *c = privdata;
+
+    c->flags &= ~REDIS_REMOTE_EXEC;
+
+    // 命令在其他线程上执行期间，客户端被 freeClientAsync 要求关闭
+    if (c->flags & REDIS_CLOSE_ASAP) {
+        c->flags &= ~REDIS_CLOSE_ASAP;
+        freeClient(c);
+        return;
+    }
+
+    resetClient(c);
+    if (aeCreateFileEvent(w->el,c->fd,AE_READABLE,
+        readQueryFromClient,c) == AE_ERR)
+    {
+        freeClient(c);
+        return;
+    }
+    // 重新注册读事件之后优先级恢复成了默认值
+    aeSetFileEventPriority(w->el,c->fd,c->priority);
+
+    // reactorCall 删除了写事件，还没写出的回复会由 prepareClientToWrite
+    // 重新放进待写出链表
+
+    // 已经读入的命令不会再触发读事件，要在这里处理
+    if (sdslen(c->querybuf)) processInputBuffer(c);
+
+    // 下一条命令又被转交出去了，回复等客户端再次回来之后一起写出
+    if (c->flags & REDIS_REMOTE_EXEC) return;
+    if (c->bufpos || listLength(c->reply)) prepareClientToWrite(c);
+}
+
+/*
+ * 转交给其他线程执行的命令
+ */
+typedef struct reactorRemoteCall {
+
+    redisClient *c;            // 发送命令的客户端
+
+    redisCommandProc *proc;    // 要执行的命令实现
+
+    redisWorker *owner;        // 负责执行命令的线程
+
+} reactorRemoteCall;
+
+/*
+ * 在负责命令键的线程上执行命令
+ */
+static void reactorExecuteRemote(redisWorker *w, void *privdata) {
+    reactorRemoteCall *rc = privdata;
+    redisClient *c = rc->c;
+
+    c->db = w->db+c->dictid;
+    rc->proc(c);
+    zfree(rc);
+
+    // 交还客户端所属的线程
+    reactorSubmit(c->worker,reactorResumeClient,c);
+}
+
+/*
+ * 把 reactorCall 推迟的命令转交给负责的线程，
+ * 在客户端的异步写操作完成时由 writeToClientDone 调用
+ */
+void reactorSubmitDeferredCall(redisClient *c) {
+    reactorRemoteCall *rc = c->remote_call;
+
+    c->remote_call = NULL;
+    reactorSubmit(rc->owner,reactorExecuteRemote,rc);
+}
+
+/*
+ * 计算命令的所有键所属的 reactor 线程
+ *
+ * 命令没有键时返回客户端所在的线程，
+ * 键分属不同线程时返回 NULL 。
+ */
+static redisWorker *reactorGetCommandOwner(redisClient *c) {
+    struct redisCommand *cmd = c->cmd;
+    redisWorker *owner = NULL;
+    int *keys = NULL, numkeys = 0, j;
+
+    if (cmd->getkeys_proc) {
+        keys = cmd->getkeys_proc(cmd,c->argv,c->argc,&numkeys);
+    } else if (cmd->firstkey) {
+        int last = cmd->lastkey;
+
+        if (last < 0) last = c->argc+last;
+        keys = zmalloc(sizeof(int)*((last - cmd->firstkey)+1));
+        for (j = cmd->firstkey; j <= last; j += cmd->keystep)
+            keys[numkeys++] = j;
+    }
+
+    for (j = 0; j < numkeys; j++) {
+        robj *key = c->argv[keys[j]];
+        redisWorker *w = reactorWorkerForSlot(
+            keyHashSlot(key->ptr,sdslen(key->ptr)));
+
+        if (owner == NULL) {
+            owner = w;
+        } else if (owner != w) {
+            owner = NULL;
+            break;
+        }
+    }
+    // 没有键的命令
+    if (numkeys == 0) owner = c->worker;
+    zfree(keys);
+    return owner;
+}
+
+/*
+ * 多 reactor 模式下执行客户端的当前命令 c->cmd
+ *
+ * 命令的键属于当前线程时直接执行 proc ；
+ * 否则暂停读取客户端的输入，把命令转交给负责的线程，
+ * 执行完毕后客户端会被交还回来，并恢复读取。
+ *
+ * 多个键分属不同线程的命令无法执行，返回 REDIS_ERR 并回复错误。
+ */
+int reactorCall(redisClient *c, redisCommandProc *proc) {
+    redisWorker *owner = reactorGetCommandOwner(c);
+    reactorRemoteCall *rc;
+
+    if (owner == NULL) {
+        addReplyError(c,"CROSSSLOT Keys in request don't hash to the same reactor");
+        return REDIS_ERR;
+    }
+
+    // 在当前线程上执行
+    if (owner == c->worker) {
+        c->db = owner->db+c->dictid;
+        proc(c);
+        return REDIS_OK;
+    }
+
+    // 转交给负责的线程执行，在客户端回来之前不再读写它的套接字，
+    // 负责的线程会往回复缓冲区中添加内容，不能和本线程的写处理器同时使用它们
+    aeDeleteFileEvent(c->worker->el,c->fd,AE_READABLE|AE_WRITABLE);
+
+    // 之前的命令的回复还在等待写出的话，把客户端从待写出链表中取出，
+    // 否则 beforesleep 会在负责的线程使用客户端的同时修改它，
+    // 客户端回来之后 reactorResumeClient 会重新把它放进链表
+    if (c->flags & REDIS_PENDING_WRITE) {
+        listNode *ln = listSearchKey(c->worker->clients_pending_write,c);
+
+        if (ln) listDelNode(c->worker->clients_pending_write,ln);
+        c->flags &= ~REDIS_PENDING_WRITE;
+    }
+    c->flags |= REDIS_REMOTE_EXEC;
+    c->worker->stat_remote_calls++;
+
+    rc = zmalloc(sizeof(*rc));
+    rc->c = c;
+    rc->proc = proc;
+    rc->owner = owner;
+
+    // 异步写操作还在使用回复缓冲区，等它完成之后再转交，见 writeToClientDone
+    if (c->flags & REDIS_IO_WRITE_INFLIGHT) {
+        c->remote_call = rc;
+        return REDIS_OK;
+    }
+    return reactorSubmit(owner,reactorExecuteRemote,rc);
+}
+
+/* ------------------------------ Networking -------------------------------- */
+
+/*
+ * reactor 线程的 TCP 连接 accept 处理器
+ */
+static void reactorAcceptHandler(aeEventLoop *el, int fd, void *privdata, int mask) {
+    int cport, cfd, max = REDIS_MAX_ACCEPTS_PER_CALL;
+    char cip[REDIS_IP_STR_LEN];
+    redisWorker *w = privdata;
+    redisClient *c;
+    REDIS_NOTUSED(el);
+    REDIS_NOTUSED(mask);
+
+    while(max--) {
+        // accept 客户端连接
+        cfd = anetTcpAccept(w->neterr, fd, cip, sizeof(cip), &cport);
+        if (cfd == ANET_ERR) {
+            if (errno != EWOULDBLOCK)
+                redisLog(REDIS_WARNING,
+                    "Reactor %d accepting client connection: %s",
+                    w->id, w->neterr);
+            return;
+        }
+
+        // 每个线程最多只接受 maxclients 平均分下来的连接数
+        if (listLength(w->clients) >= (unsigned long)
+            (server.maxclients / server.reactors))
+        {
+            char *err = "-ERR max number of clients reached\r\n";
+
+            /* That's a best effort error message, don't check write errors */
+            if (write(cfd,err,strlen(err)) == -1) {
+                /* Nothing to do, Just to avoid the warning... */
+            }
+            close(cfd);
+            continue;
+        }
+
+        // 在当前线程上创建客户端，客户端会加入 w->clients
+        // 并在 w->el 上注册读事件
+        if ((c = createClient(cfd)) == NULL) {
+            redisLog(REDIS_WARNING,
+                "Error registering fd event for the new client: %s (fd=%d)",
+                strerror(errno),cfd);
+            close(cfd); /* May be already closed, just ignore errors */
+            continue;
+        }
+        w->stat_numconnections++;
+    }
+}
+
+/*
+ * 为线程 w 创建 SO_REUSEPORT 监听套接字，
+ * 并为它们注册 accept 处理器
+ */
+static int reactorListen(redisWorker *w) {
+    int j, count = server.bindaddr_count ? server.bindaddr_count : 1;
+
+    for (j = 0; j < count; j++) {
+        char *addr = server.bindaddr_count ? server.bindaddr[j] : NULL;
+        int fd;
+
+        fd = anetTcpReusePortServer(w->neterr,server.port,addr,
+            server.tcp_backlog);
+        if (fd == ANET_ERR) {
+            redisLog(REDIS_WARNING,
+                "Reactor %d creating server TCP listening socket %s:%d: %s",
+                w->id, addr ? addr : "*", server.port, w->neterr);
+            return REDIS_ERR;
+        }
+        anetNonBlock(NULL,fd);
+        w->ipfd[w->ipfd_count++] = fd;
+
+        if (aeCreateFileEvent(w->el,fd,AE_READABLE,
+            reactorAcceptHandler,w) == AE_ERR)
+        {
+            redisLog(REDIS_WARNING,"Unrecoverable error creating reactor "
+                "file event.");
+            return REDIS_ERR;
+        }
+    }
+    return REDIS_OK;
+}
+
+/* ------------------------------- Threads ---------------------------------- */
+
+/*
+ * 将当前线程绑定到给定的 CPU 上
+ */
+static void reactorSetCpuAffinity(redisWorker *w) {
+#ifdef __linux__
+    cpu_set_t cpuset;
+
+    CPU_ZERO(&cpuset);
+    CPU_SET(w->cpu,&cpuset);
+    if (pthread_setaffinity_np(pthread_self(),sizeof(cpuset),&cpuset) != 0)
+        redisLog(REDIS_WARNING,"Can't bind reactor %d to CPU %d",
+            w->id, w->cpu);
+#else
+    REDIS_NOTUSED(w);
+#endif
+}
+
+/*
+ * reactor 线程每次处理事件之前执行：写出本轮产生的回复
+ */
+static void reactorBeforeSleep(aeEventLoop *el) {
+    REDIS_NOTUSED(el);
+
+    handleClientsWithPendingWrites(current_worker->clients_pending_write);
+}
+
+/*
+ * reactor 线程的时间事件，每秒执行 server.hz 次：
+ * 对线程负责的键空间分片进行主动 rehash
+ */
+static int reactorCron(aeEventLoop *el, long long id, void *clientData) {
+    redisWorker *w = clientData;
+    REDIS_NOTUSED(el);
+    REDIS_NOTUSED(id);
+
+    databasesCron(w->db);
+
+    return 1000/server.hz;
+}
+
+/*
+ * reactor 线程的入口
+ */
+static void *reactorMain(void *arg) {
+    redisWorker *w = arg;
+
+    current_worker = w;
+    if (w->cpu != -1) reactorSetCpuAffinity(w);
+
+    redisLog(REDIS_VERBOSE,"Reactor %d started, serving slots %u-%u",
+        w->id, w->slot_start, w->slot_end-1);
+    aeMain(w->el);
+    return NULL;
+}
+
+/*
+ * 初始化 reactor 线程 w 的状态：事件循环、mailbox 、监听套接字和键空间分片
+ */
+static int reactorInitWorker(redisWorker *w, int id, int ncpu) {
+    w->id = id;
+    w->cpu = server.reactor_cpu_affinity ? id % ncpu : -1;
+    w->ipfd_count = 0;
+    w->stat_numconnections = 0;
+    w->stat_remote_calls = 0;
+    w->clients = listCreate();
+    w->clients_pending_write = listCreate();
+    w->slot_start = (unsigned int)
+        (((long long)id*REDIS_CLUSTER_SLOTS + server.reactors-1) / server.reactors);
+    w->slot_end = (unsigned int)
+        (((long long)(id+1)*REDIS_CLUSTER_SLOTS + server.reactors-1) / server.reactors);
+
+    // 描述符的编号是整个进程共享的，所以每个线程的事件槽都要能容纳 maxclients 个连接，
+    // 文件事件表按段分配，只有真正用到的段才占用内存
+    w->el = aeCreateEventLoop(server.maxclients+REDIS_EVENTLOOP_FDSET_INCR);
+    if (w->el == NULL) return REDIS_ERR;
+    latencyInitEventLoop(w->el);
+    aeSetBeforeSleepProc(w->el,reactorBeforeSleep);
+    aeSetBusyPoll(w->el,server.busy_poll_budget,server.busy_poll_threshold);
+    aeSetPriorityBudget(w->el,AE_PRIO_BULK,server.bulk_events_per_loop);
+
+    // 创建 mailbox
+    pthread_mutex_init(&w->mailbox_mutex,NULL);
+    w->mailbox = listCreate();
+    if (pipe(w->notify_pipe) == -1) {
+        redisLog(REDIS_WARNING,"Can't create reactor %d notify pipe: %s",
+            id, strerror(errno));
+        return REDIS_ERR;
+    }
+    anetNonBlock(NULL,w->notify_pipe[0]);
+    anetNonBlock(NULL,w->notify_pipe[1]);
+    if (aeCreateFileEvent(w->el,w->notify_pipe[0],AE_READABLE,
+        reactorMailboxHandler,w) == AE_ERR) return REDIS_ERR;
+    // 转交过来的命令和回复不能排在大批量客户端后面
+    aeSetFileEventPriority(w->el,w->notify_pipe[0],AE_PRIO_ADMIN);
+
+    // 创建监听套接字
+    if (reactorListen(w) == REDIS_ERR) return REDIS_ERR;
+
+    // 创建线程负责的那部分键空间
+    w->db = createDatabases();
+    if (aeCreateTimeEvent(w->el,1,reactorCron,w,NULL) == AE_ERR)
+        return REDIS_ERR;
+    return REDIS_OK;
+}
+
+/*
+ * 启动所有 reactor 线程
+ *
+ * 多 reactor 模式下，主线程的 server.el 不再监听 server.port ，
+ * 客户端全部由 reactor 线程接受和处理。
+ */
+int reactorStart(void) {
+    int j, ncpu;
+
+    if (server.reactors <= 0) return REDIS_OK;
+    if (server.reactors > REDIS_MAX_REACTORS)
+        server.reactors = REDIS_MAX_REACTORS;
+
+    // 多个线程会同时分配内存
+    zmalloc_enable_thread_safeness();
+
+    ncpu = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    if (ncpu <= 0) ncpu = 1;
+
+    server.workers = zcalloc(sizeof(redisWorker)*server.reactors);
+    for (j = 0; j < server.reactors; j++) {
+        if (reactorInitWorker(server.workers+j,j,ncpu) == REDIS_ERR)
+            return REDIS_ERR;
+    }
+
+    // 所有线程都初始化完毕之后再启动，
+    // 这样任何线程开始工作时都能看到完整的 server.workers
+    for (j = 0; j < server.reactors; j++) {
+        redisWorker *w = server.workers+j;
+
+        if (pthread_create(&w->thread,NULL,reactorMain,w) != 0) {
+            redisLog(REDIS_WARNING,"Can't create reactor %d thread", j);
+            return REDIS_ERR;
+        }
+    }
+    redisLog(REDIS_NOTICE,"Multi-reactor mode: %d reactors on port %d",
+        server.reactors, server.port);
+    return REDIS_OK;
+}
+
+/*
+ * 让 reactor 线程停止事件循环
+ */
+static void reactorStopProc(redisWorker *w, void *privdata) {
+    REDIS_NOTUSED(privdata);
+    aeStop(w->el);
+}
+
+/*
+ * 停止所有 reactor 线程，并等待它们退出
+ */
+void reactorStop(void) {
+    int j;
+
+    for (j = 0; j < server.reactors; j++)
+        reactorSubmit(server.workers+j,reactorStopProc,NULL);
+    for (j = 0; j < server.reactors; j++)
+        pthread_join(server.workers[j].thread,NULL);
+}
+
+/*
+ * 调整事件循环大小的任务
+ */
+static void reactorResizeProc(redisWorker *w, void *privdata) {
+    int setsize = (int)(long)privdata;
+
+    if (aeResizeSetSize(w->el,setsize) == AE_ERR)
+        redisLog(REDIS_WARNING,
+            "Reactor %d can't resize its event loop to %d: fd %d is in use",
+            w->id, setsize, w->el->maxfd);
+}
+
+/*
+ * 调整所有 reactor 线程的事件循环大小
+ *
+ * 调整由各个线程在自己的事件循环中完成，函数返回时还不一定已经生效
+ */
+int reactorResizeSetSize(int setsize) {
+    int j;
+
+    for (j = 0; j < server.reactors; j++) {
+        if (reactorSubmit(server.workers+j,reactorResizeProc,
+            (void*)(long)setsize) == REDIS_ERR) return REDIS_ERR;
+    }
+    return REDIS_OK;
+}
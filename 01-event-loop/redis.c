@@ -5,39 +5,886 @@
 	> Created Time: 2019年07月23日 星期二 21时31分20秒
  ************************************************************************/
 
-#include<stdio.h>
+#include "redis.h"
 
+#include <stdarg.h>
+#include <sys/time.h>
 
+/*================================= Globals ================================= */
 
+/* Global vars */
+struct redisServer server; /* server global state */
 
+/* Our command table.
+ *
+ * 命令表
+ *
+ * Every entry is composed of the following fields:
+ *
+ * 表中的每个项都由以下域组成：
+ *
+ * name: a string representing the command name.
+ *       命令的名字
+ *
+ * function: pointer to the C function implementing the command.
+ *           一个指向命令的实现函数的指针
+ *
+ * arity: number of arguments, it is possible to use -N to say >= N
+ *        参数的数量。可以用 -N 表示 >= N
+ *
+ * sflags: command flags as string. See below for a table of flags.
+ *         字符串形式的 FLAG ，用来计算以下的真实 FLAG
+ *
+ * flags: flags as bitmask. Computed by Redis using the 'sflags' field.
+ *        位掩码形式的 FLAG ，根据 sflags 的字符串计算得出
+ *
+ * get_keys_proc: an optional function to get key arguments from a command.
+ *                This is only used when the following three fields are not
+ *                enough to specify what arguments are keys.
+ *                一个可选的函数，用于从命令中取出 key 参数，仅在以下三个参数都不足以表示 key 参数时使用
+ *
+ * first_key_index: first argument that is a key
+ *                  第一个 key 参数的位置
+ *
+ * last_key_index: last argument that is a key
+ *                 最后一个 key 参数的位置
+ *
+ * key_step: step to get all the keys from first to last argument. For instance
+ *           in MSET the step is two since arguments are key,val,key,val,...
+ *           从 first 参数和 last 参数之间，所有 key 的步数（step）
+ *           比如说， MSET 命令的格式为 MSET key value [key value ...]
+ *           它的 step 就为 2
+ *
+ * microseconds: microseconds of total execution time for this command.
+ *               执行这个命令耗费的总微秒数
+ *
+ * calls: total number of calls of this command.
+ *        命令被执行的总次数
+ *
+ * The flags, microseconds and calls fields are computed by Redis and should
+ * always be set to zero.
+ *
+ * microseconds 和 call 由 Redis 计算，总是初始化为 0 。
+ *
+ * Command flags are expressed using strings where every character represents
+ * a flag. Later the populateCommandTable() function will take care of
+ * populating the real 'flags' field using this characters.
+ *
+ * 命令的 FLAG 首先由 SFLAG 域设置，之后 populateCommandTable() 函数从 sflags 属性中计算出真正的 FLAG 到 flags 属性中。
+ *
+ * This is the meaning of the flags:
+ *
+ * 以下是各个 FLAG 的意义：
+ *
+ * w: write command (may modify the key space).
+ *    写入命令，可能会修改 key space
+ *
+ * r: read command  (will never modify the key space).
+ *    读命令，不修改 key space
+ *
+ * m: may increase memory usage once called. Don't allow if out of memory.
+ *    可能会占用大量内存的命令，调用时对内存占用进行检查
+ *
+ * a: admin command, like SAVE or SHUTDOWN.
+ *    管理用途的命令，比如 SAVE 和 SHUTDOWN
+ *
+ * R: random command. Command is not deterministic, that is, the same command
+ *    with the same arguments, with the same key space, may have different
+ *    results. For instance SPOP and RANDOMKEY are two random commands.
+ *    随机命令。
+ *    命令是非确定性的：对于同样的命令，同样的参数，同样的键，结果可能不同。
+ *    比如 SPOP 和 RANDOMKEY 就是这样的例子。
+ *
+ * 其他 FLAG 的命令这里还没有实现，解析时忽略。
+ */
+struct redisCommand redisCommandTable[] = {
+    {"get",getCommand,2,"r",0,NULL,1,1,1,0,0},
+    {"set",setCommand,3,"wm",0,NULL,1,1,1,0,0},
+    {"del",delCommand,-2,"w",0,NULL,1,-1,1,0,0},
+    {"exists",existsCommand,2,"r",0,NULL,1,1,1,0,0},
+    {"select",selectCommand,2,"r",0,NULL,0,0,0,0,0},
+    {"ping",pingCommand,-1,"r",0,NULL,0,0,0,0,0},
+    {"echo",echoCommand,2,"r",0,NULL,0,0,0,0,0},
+    {"info",infoCommand,-1,"r",0,NULL,0,0,0,0,0}
+};
 
+/*============================ Utility functions ============================ */
 
+/*
+ * 打印日志
+ *
+ * 低于 server.verbosity 的日志会被忽略。
+ * 可以在 reactor 线程和 I/O 线程中调用，一条日志用一次 fprintf 写出，
+ * 不同线程的日志不会交错在一行中。
+ */
+void redisLog(int level, const char *fmt, ...) {
+    const char *c = ".-*#";
+    char msg[REDIS_MAX_LOGMSG_LEN];
+    char buf[64];
+    struct timeval tv;
+    struct tm tm;
+    va_list ap;
+    int off;
 
+    if (level < server.verbosity) return;
 
+    va_start(ap, fmt);
+    vsnprintf(msg, sizeof(msg), fmt, ap);
+    va_end(ap);
 
+    gettimeofday(&tv,NULL);
+    localtime_r(&tv.tv_sec,&tm);
+    off = strftime(buf,sizeof(buf),"%d %b %H:%M:%S.",&tm);
+    snprintf(buf+off,sizeof(buf)-off,"%03d",(int)tv.tv_usec/1000);
+    fprintf(stdout,"%d:M %s %c %s\n",(int)getpid(),buf,c[level],msg);
+    fflush(stdout);
+}
+
+/*====================== Hash table type implementation  ==================== */
+
+/* This is a hash table type that uses the SDS dynamic strings library as
+ * keys and radis objects as values (objects can hold SDS strings,
+ * lists, sets). */
+
+uint64_t dictSdsHash(const void *key) {
+    return dictGenHashFunction((unsigned char*)key, sdslen((char*)key));
+}
+
+uint64_t dictSdsCaseHash(const void *key) {
+    return dictGenCaseHashFunction((unsigned char*)key, sdslen((char*)key));
+}
+
+int dictSdsKeyCompare(void *privdata, const void *key1,
+        const void *key2)
+{
+    int l1,l2;
+    DICT_NOTUSED(privdata);
+
+    l1 = sdslen((sds)key1);
+    l2 = sdslen((sds)key2);
+    if (l1 != l2) return 0;
+    return memcmp(key1, key2, l1) == 0;
+}
+
+/* A case insensitive version used for the command lookup table and other
+ * places where case insensitive non binary-safe comparison is needed. */
+int dictSdsKeyCaseCompare(void *privdata, const void *key1,
+        const void *key2)
+{
+    DICT_NOTUSED(privdata);
+
+    return strcasecmp(key1, key2) == 0;
+}
+
+void dictSdsDestructor(void *privdata, void *val)
+{
+    DICT_NOTUSED(privdata);
+
+    sdsfree(val);
+}
+
+void dictRedisObjectDestructor(void *privdata, void *val)
+{
+    DICT_NOTUSED(privdata);
+
+    if (val == NULL) return; /* Values of swapped out keys as set to NULL */
+    decrRefCount(val);
+}
+
+/*
+ * 短的 sds 键嵌入到字典节点中，返回嵌入需要的字节数
+ *
+ * 嵌入的键是一个完整的 sds （ free 为 0 ），可以直接交给 dictSdsHash 等函数，
+ * 但它和节点共用一块内存，不能被 sdsfree 释放，也不能被修改长度
+ */
+size_t dictSdsEmbedLen(const void *key) {
+    size_t len = sdslen((sds)key);
+
+    if (len > REDIS_DICT_EMBED_KEY_SIZE_LIMIT) return 0;
+    return sizeof(struct sdshdr)+len+1;
+}
+
+/*
+ * 将 sds 键复制到 buf 中，返回嵌入的 sds
+ */
+void *dictSdsEmbed(void *buf, const void *key) {
+    struct sdshdr *sh = buf;
+    size_t len = sdslen((sds)key);
+
+    sh->len = len;
+    sh->free = 0;
+    memcpy(sh->buf,key,len+1);
+    return sh->buf;
+}
+
+/* Db->dict, keys are sds strings, vals are Redis objects.
+ *
+ * 单线程模式和多 reactor 模式的键空间都使用开放寻址法，
+ * 键值对直接保存在槽中，键是单独分配的 sds ，不嵌入 */
+dictType dbDictType = {
+    dictSdsHash,                /* hash function */
+    NULL,                       /* key dup */
+    NULL,                       /* val dup */
+    dictSdsKeyCompare,          /* key compare */
+    dictSdsDestructor,          /* key destructor */
+    dictRedisObjectDestructor,  /* val destructor */
+    NULL,                       /* key embed len */
+    NULL                        /* key embed */
+};
+
+/* Command table. sds string -> command struct pointer.
+ *
+ * 命令表使用链地址法，命令名很短，直接嵌入在节点中 */
+dictType commandTableDictType = {
+    dictSdsCaseHash,           /* hash function */
+    NULL,                      /* key dup */
+    NULL,                      /* val dup */
+    dictSdsKeyCaseCompare,     /* key compare */
+    dictSdsDestructor,         /* key destructor */
+    NULL,                      /* val destructor */
+    dictSdsEmbedLen,           /* key embed len */
+    dictSdsEmbed               /* key embed */
+};
+
+/* Db->expires
+ *
+ * 键和 db->dict 中的键是同一个 sds ，所以不能嵌入 */
+dictType keyptrDictType = {
+    dictSdsHash,               /* hash function */
+    NULL,                      /* key dup */
+    NULL,                      /* val dup */
+    dictSdsKeyCompare,         /* key compare */
+    NULL,                      /* key destructor */
+    NULL,                      /* val destructor */
+    NULL,                      /* key embed len */
+    NULL                       /* key embed */
+};
 
+/* Our hash table implementation performs rehashing incrementally while
+ * we write/read from the hash table. Still if the server is idle, the hash
+ * table will use two tables for a long time. So we try to use 1 millisecond
+ * of CPU time at every call of this function to perform some rehahsing.
+ *
+ * 虽然服务器在对数据库执行读取/写入命令时会对数据库进行渐进式 rehash ，
+ * 但如果服务器长期没有执行命令的话，数据库字典的 rehash 就可能一直没办法完成，
+ * 为了防止出现这种情况，我们需要对数据库执行主动 rehash 。
+ *
+ * 函数在执行了主动 rehash 时返回 1 ，否则返回 0 。
+ */
+static int incrementallyRehash(redisDb *db) {
 
+    /* Keys dictionary */
+    if (dictIsRehashing(db->dict)) {
+        dictRehashMilliseconds(db->dict,1);
+        return 1; /* already used our millisecond for this loop... */
+    }
 
+    /* Expires */
+    if (dictIsRehashing(db->expires)) {
+        dictRehashMilliseconds(db->expires,1);
+        return 1; /* already used our millisecond for this loop... */
+    }
 
+    return 0;
+}
+
+/* If the percentage of used slots in the HT reaches DICT_HT_MIN_FILL
+ * we resize the hash table to save memory.
+ *
+ * 对数据库的键空间和过期字典进行检查，
+ * 使用率低于 DICT_HT_MIN_FILL% 时缩小字典。
+ *
+ * 删除键时字典会自己检查，这里处理的是删除时因为有子进程而没能缩小的字典。
+ */
+static void tryResizeHashTables(redisDb *db) {
+    dictShrinkIfNeeded(db->dict);
+    dictShrinkIfNeeded(db->expires);
+}
+
+/*
+ * 创建 server.dbnum 个空数据库，返回数据库数组
+ *
+ * 单线程模式下的 server.db 和多 reactor 模式下每个线程的键空间分片都由它创建。
+ * 键空间使用开放寻址的字典，查找一个键通常只需访问一个组。
+ */
+redisDb *createDatabases(void) {
+    redisDb *db = zmalloc(sizeof(redisDb)*server.dbnum);
+    int j;
+
+    for (j = 0; j < server.dbnum; j++) {
+        db[j].dict = dictCreateOpen(&dbDictType,NULL);
+        db[j].expires = dictCreate(&keyptrDictType,NULL);
+        db[j].blocking_keys = NULL;
+        db[j].ready_keys = NULL;
+        db[j].id = j;
+    }
+    return db;
+}
+
+/* This function handles 'background' operations we are required to do
+ * incrementally in Redis databases, such as active key expiring, resizing,
+ * rehashing.
+ *
+ * 对数据库执行删除过期键，调整大小，主动和渐进式 rehash ，以及碎片整理
+ *
+ * db 为 server.db ，或者多 reactor 模式下某个线程负责的键空间分片，
+ * 每个线程只对自己的分片调用这个函数。
+ * 每次调用最多花费 1 毫秒在 rehash 上。
+ */
+void databasesCron(redisDb *db) {
+    /* Perform hash tables rehashing if needed, but only if there are no
+     * other processes saving the DB on disk. Otherwise rehashing is bad
+     * as will cause a lot of copy-on-write of memory pages. */
+    // 在没有子进程执行保存操作时，对数据库字典进行缩小和 rehash ，
+    // 否则 rehash 会让子进程和父进程之间产生大量写时复制
+    if (!hasActiveChildProcess()) {
+        /* We use global counters so if we stop the computation at a given
+         * DB we'll be able to start from the successive in the next
+         * cron loop iteration. */
+        // 每个线程有自己的键空间分片，所以计数器也是每个线程一个
+        static __thread unsigned int resize_db = 0;
+        static __thread unsigned int rehash_db = 0;
+        int dbs_per_call = REDIS_DBCRON_DBS_PER_CALL;
+        int j;
+
+        /* Don't test more DBs than we have. */
+        if (dbs_per_call > server.dbnum) dbs_per_call = server.dbnum;
+
+        /* Resize */
+        // 缩小使用率过低的字典
+        for (j = 0; j < dbs_per_call; j++) {
+            tryResizeHashTables(&db[resize_db % server.dbnum]);
+            resize_db++;
+        }
+
+        /* Rehash */
+        // 对字典进行渐进式 rehash
+        if (server.activerehashing) {
+            for (j = 0; j < dbs_per_call; j++) {
+                int work_done = incrementallyRehash(&db[rehash_db % server.dbnum]);
+
+                rehash_db++;
+                if (work_done) {
+                    /* If the function did some work, stop here, we'll do
+                     * more at the next cron loop. */
+                    break;
+                }
+            }
+        }
+
+        /* Defrag */
+        // 碎片率过高时，渐进地重新分配键空间中的键和值
+        activeDefragCycle(db);
+    }
+}
 
+/*
+ * 有子进程在保存数据时返回 1 ，否则返回 0
+ */
+int hasActiveChildProcess(void) {
+    return server.child_pid != -1;
+}
+
+/* This function is called once a background process of some kind terminates,
+ * as we want to avoid resizing the hash tables when there is a child in order
+ * to play well with copy-on-write (otherwise when a resize happens lots of
+ * memory pages are copied). The goal of this function is to update the ability
+ * for dict.c to resize the hash tables accordingly to the fact we have o not
+ * running childs.
+ *
+ * 有子进程时禁止字典扩展和缩小（使用率过高的字典仍然会强制扩展），
+ * 没有子进程时恢复。创建子进程之后、子进程退出之后都应该调用这个函数，
+ * serverCron 每次执行时也会调用，作为兜底。
+ */
+void updateDictResizePolicy(void) {
+    if (!hasActiveChildProcess())
+        dictEnableResize();
+    else
+        dictDisableResize();
+}
+
+/* This is our timer interrupt, called server.hz times per second.
+ *
+ * 这是 Redis 的时间中断器，每秒调用 server.hz 次。
+ */
+int serverCron(struct aeEventLoop *eventLoop, long long id, void *clientData) {
+    REDIS_NOTUSED(eventLoop);
+    REDIS_NOTUSED(id);
+    REDIS_NOTUSED(clientData);
+
+    // 根据是否有子进程，允许或禁止字典调整大小
+    updateDictResizePolicy();
+
+    /* Sample the process memory stats, so that everything else running
+     * in the cron (defrag, INFO, ...) can read them without parsing /proc. */
+    // 采样 RSS 和私有脏页，其他地方只读取缓存中的值
+    run_with_period(REDIS_RSS_SAMPLE_PERIOD) zmalloc_sample_rss();
+    run_with_period(REDIS_PRIVATE_DIRTY_SAMPLE_PERIOD) zmalloc_sample_private_dirty();
+
+    /* Handle background operations on Redis databases. */
+    // 对数据库执行各种操作
+    databasesCron(server.db);
 
+    server.cronloops++;
+    return 1000/server.hz;
+}
+
+/* This function gets called every time Redis is entering the
+ * main loop of the event driven library, that is, before to sleep
+ * for ready file descriptors.
+ *
+ * 每次处理事件之前执行
+ */
+void beforeSleep(struct aeEventLoop *eventLoop) {
+    REDIS_NOTUSED(eventLoop);
 
+    /* Handle reads and writes using I/O threads. */
+    // 读取并执行 I/O 线程收到的命令请求，
+    // 然后将这些命令以及本轮其他命令产生的回复直接写出（或者交给 I/O 线程写出），
+    // 只有写不完的客户端才需要安装写处理器
+    handleClientsWithPendingReadsUsingThreads();
+    handleClientsWithPendingWritesUsingThreads();
+
+    /* Close clients that need to be closed asynchronous */
+    freeClientsInAsyncFreeQueue();
+}
 
+/*============================ Commands lookup and execution ===================== */
 
+/* Populates the Redis Command Table starting from the hard coded list
+ * we have on top of redis.c file.
+ *
+ * 根据 redis.c 文件顶部的命令列表，创建命令表
+ *
+ * 命令表创建之后只会被读取，多 reactor 模式下所有线程共享同一个命令表，
+ * 所以这里要等 rehash 完成，之后的查找就不会修改字典了。
+ */
+void populateCommandTable(void) {
+    int j;
 
+    // 命令的数量
+    int numcommands = sizeof(redisCommandTable)/sizeof(struct redisCommand);
 
+    for (j = 0; j < numcommands; j++) {
 
+        // 指定命令
+        struct redisCommand *c = redisCommandTable+j;
 
+        // 取出字符串 FLAG
+        char *f = c->sflags;
 
+        int retval;
 
+        // 根据字符串 FLAG 生成实际 FLAG
+        while(*f != '\0') {
+            switch(*f) {
+            case 'w': c->flags |= REDIS_CMD_WRITE; break;
+            case 'r': c->flags |= REDIS_CMD_READONLY; break;
+            case 'm': c->flags |= REDIS_CMD_DENYOOM; break;
+            case 'a': c->flags |= REDIS_CMD_ADMIN; break;
+            case 'R': c->flags |= REDIS_CMD_RANDOM; break;
+            default: break;
+            }
+            f++;
+        }
 
+        // 将命令关联到命令表，短的命令名嵌入在字典节点中
+        retval = dictAdd(server.commands, sdsnew(c->name), c);
+        REDIS_NOTUSED(retval);
+    }
+    while (dictIsRehashing(server.commands)) dictRehash(server.commands,100);
+}
+
+/*
+ * 根据给定命令名字（SDS），查找命令
+ */
+struct redisCommand *lookupCommand(sds name) {
+    return dictFetchValue(server.commands, name);
+}
 
+/* Call() is the core of Redis execution of a command
+ *
+ * 调用命令的实现函数，执行命令
+ *
+ * 多 reactor 模式下由 reactorCall 交给负责命令键的线程执行，
+ * 这时统计的耗时不包括在其他线程上执行的时间。
+ * 多个线程会同时更新命令的统计，所以使用原子操作。
+ */
+void call(redisClient *c, int flags) {
+    long long start, duration;
 
+    start = aeMonotonicMicroseconds();
+    if (c->worker)
+        reactorCall(c,c->cmd->proc);
+    else
+        c->cmd->proc(c);
+    duration = aeMonotonicMicroseconds()-start;
+
+    if (flags & REDIS_CALL_STATS) {
+        __atomic_add_fetch(&c->cmd->microseconds,duration,__ATOMIC_RELAXED);
+        __atomic_add_fetch(&c->cmd->calls,1,__ATOMIC_RELAXED);
+    }
+}
+
+/* If this function gets called we already read a whole
+ * command, arguments are in the client argv/argc fields.
+ * processCommand() execute the command or prepare the
+ * server for a bulk read from the client.
+ *
+ * 这个函数执行时，我们已经读入了一个完整的命令到客户端，
+ * 这个函数负责执行这个命令，
+ * 或者服务器准备从客户端中进行一次读取。
+ *
+ * If 1 is returned the client is still alive and valid and
+ * other operations can be performed by the caller. Otherwise
+ * if 0 is returned the client was destroyed (i.e. after QUIT).
+ *
+ * 如果这个函数返回 REDIS_OK ，那么客户端依然存在，
+ * 调用者可以继续执行其他操作。
+ * 否则，如果这个函数返回 REDIS_ERR ，那么客户端会在回复之后被关闭（比如执行 QUIT 之后）。
+ */
+int processCommand(redisClient *c) {
+    /* The QUIT command is handled separately. Normal command procs will
+     * go through checking for replication and QUIT will cause trouble
+     * when FORCE_REPLICATION is enabled and would be implemented in
+     * a regular command proc. */
+    // 特别处理 quit 命令
+    if (!strcasecmp(c->argv[0]->ptr,"quit")) {
+        addReplyStatus(c,"OK");
+        c->flags |= REDIS_CLOSE_AFTER_REPLY;
+        return REDIS_ERR;
+    }
+
+    /* Now lookup the command and check ASAP about trivial error conditions
+     * such as wrong arity, bad command name and so forth. */
+    // 查找命令，并进行命令合法性检查，以及命令参数个数检查
+    c->cmd = c->lastcmd = lookupCommand(c->argv[0]->ptr);
+    if (!c->cmd) {
+        // 没找到指定的命令
+        addReplySds(c,sdscatprintf(sdsempty(),
+            "-ERR unknown command '%s'\r\n",
+            (char*)c->argv[0]->ptr));
+        return REDIS_OK;
+    } else if ((c->cmd->arity > 0 && c->cmd->arity != c->argc) ||
+               (c->argc < -c->cmd->arity)) {
+        // 参数个数错误
+        addReplySds(c,sdscatprintf(sdsempty(),
+            "-ERR wrong number of arguments for '%s' command\r\n",
+            c->cmd->name));
+        return REDIS_OK;
+    }
+
+    /* Exec the command */
+    // 执行命令
+    call(c,REDIS_CALL_FULL);
+
+    return REDIS_OK;
+}
+
+/*
+ * 将服务器的各个配置选项设为默认值
+ */
+void initServerConfig(void) {
+
+    // 服务器状态
+
+    server.configfile = NULL;
+    // 设置默认服务器频率
+    server.hz = REDIS_DEFAULT_HZ;
+    server.port = REDIS_SERVERPORT;
+    server.tcp_backlog = REDIS_TCP_BACKLOG;
+    server.bindaddr_count = 0;
+    server.ipfd_count = 0;
+    server.dbnum = REDIS_DEFAULT_DBNUM;
+    server.verbosity = REDIS_DEFAULT_VERBOSITY;
+    server.tcpkeepalive = REDIS_DEFAULT_TCP_KEEPALIVE;
+    server.activerehashing = REDIS_DEFAULT_ACTIVE_REHASHING;
+    server.child_pid = -1;
+    server.shutdown_asap = 0;
+
+    // 碎片整理
+    server.active_defrag = REDIS_DEFAULT_ACTIVE_DEFRAG;
+    server.active_defrag_threshold = REDIS_DEFAULT_ACTIVE_DEFRAG_THRESHOLD;
+    server.active_defrag_ignore_bytes = REDIS_DEFAULT_ACTIVE_DEFRAG_IGNORE_BYTES;
+    server.active_defrag_cycle = REDIS_DEFAULT_ACTIVE_DEFRAG_CYCLE;
+
+    // 客户端
+    server.maxclients = REDIS_MAX_CLIENTS;
+    server.client_max_querybuf_len = REDIS_MAX_QUERYBUF_LEN;
+
+    // 事件循环
+    server.loop_stall_threshold = REDIS_DEFAULT_LOOP_STALL_THRESHOLD;
+    server.busy_poll_budget = REDIS_DEFAULT_BUSY_POLL_BUDGET;
+    server.busy_poll_threshold = REDIS_DEFAULT_BUSY_POLL_THRESHOLD;
+    server.bulk_events_per_loop = REDIS_DEFAULT_BULK_EVENTS_PER_LOOP;
+
+    // 多 reactor 和 I/O 线程
+    server.reactors = REDIS_DEFAULT_REACTORS;
+    server.reactor_cpu_affinity = REDIS_DEFAULT_REACTOR_CPU_AFFINITY;
+    server.workers = NULL;
+    server.io_threads_num = REDIS_DEFAULT_IO_THREADS_NUM;
+    server.io_threads_do_reads = REDIS_DEFAULT_IO_THREADS_DO_READS;
+}
+
+/* Initialize a set of file descriptors to listen to the specified 'port'
+ * binding the addresses specified in the Redis server configuration.
+ *
+ * The listening file descriptors are stored in the integer array 'fds'
+ * and their number is set in '*count'.
+ *
+ * 为配置中的每个地址创建监听套接字，保存到 fds 中，数量保存到 *count 中。
+ * 没有配置地址时监听 0.0.0.0 。
+ *
+ * On success the function returns REDIS_OK.
+ *
+ * On error the function returns REDIS_ERR. */
+int listenToPort(int port, int *fds, int *count) {
+    int j;
+
+    /* Force binding of 0.0.0.0 if no bind address is specified, always
+     * entering the loop if j == 0. */
+    if (server.bindaddr_count == 0) server.bindaddr[0] = NULL;
+    for (j = 0; j < server.bindaddr_count || j == 0; j++) {
+        if (server.bindaddr[j] == NULL) {
+            fds[*count] = anetTcpServer(server.neterr,port,NULL,
+                server.tcp_backlog);
+        } else if (strchr(server.bindaddr[j],':')) {
+            /* Bind IPv6 address. */
+            fds[*count] = anetTcp6Server(server.neterr,port,server.bindaddr[j],
+                server.tcp_backlog);
+        } else {
+            /* Bind IPv4 address. */
+            fds[*count] = anetTcpServer(server.neterr,port,server.bindaddr[j],
+                server.tcp_backlog);
+        }
+        if (fds[*count] == ANET_ERR) {
+            redisLog(REDIS_WARNING,
+                "Creating Server TCP listening socket %s:%d: %s",
+                server.bindaddr[j] ? server.bindaddr[j] : "*",
+                port, server.neterr);
+            return REDIS_ERR;
+        }
+        anetNonBlock(NULL,fds[*count]);
+        (*count)++;
+    }
+    return REDIS_OK;
+}
+
+/*
+ * 根据 initServerConfig 设置的选项，创建服务器的数据结构、事件循环和监听套接字，
+ * 并注册 serverCron 。多 reactor 模式下 reactor 线程在这里启动，
+ * 每个线程在 reactorInitWorker 中注册自己的 reactorCron 。
+ */
+void initServer(void) {
+    int j;
+
+    // 设置信号处理函数
+    signal(SIGHUP, SIG_IGN);
+    signal(SIGPIPE, SIG_IGN);
+
+    // 初始化并创建数据结构
+    server.current_client = NULL;
+    server.clients = listCreate();
+    server.clients_to_close = listCreate();
+    server.clients_pending_read = listCreate();
+    server.clients_pending_write = listCreate();
+
+    // 创建事件处理器
+    server.el = aeCreateEventLoop(server.maxclients+REDIS_EVENTLOOP_FDSET_INCR);
+
+    // 创建数据库
+    server.db = createDatabases();
+
+    // 创建命令表，reactor 线程启动之前就要准备好
+    server.commands = dictCreate(&commandTableDictType,NULL);
+    server.orig_commands = NULL;
+    populateCommandTable();
+
+    /* Open the TCP listening socket for the user commands. */
+    // 打开 TCP 监听端口，用于等待客户端的命令请求
+    // 多 reactor 模式下由 reactor 线程各自监听
+    if (server.reactors == 0 && server.port != 0 &&
+        listenToPort(server.port,server.ipfd,&server.ipfd_count) == REDIS_ERR)
+        exit(1);
+
+#ifndef HAVE_DEFRAG
+    // 只有 jemalloc 能告诉我们哪些内存块值得移动，见 defrag.c
+    if (server.active_defrag) {
+        redisLog(REDIS_WARNING,
+            "Active defragmentation requires jemalloc 5.2 or newer, disabling it.");
+        server.active_defrag = 0;
+    }
+#endif
+
+    // 初始化服务器统计信息
+    server.cronloops = 0;
+    server.stat_active_defrag_running = 0;
+    server.stat_active_defrag_hits = 0;
+    server.stat_active_defrag_misses = 0;
+    server.stat_io_reads_processed = 0;
+    server.stat_io_writes_processed = 0;
+
+    /* Create the serverCron() time event, that's our main way to process
+     * background operations. */
+    // 为 serverCron() 创建时间事件
+    if (aeCreateTimeEvent(server.el, 1, serverCron, NULL, NULL) == AE_ERR) {
+        redisLog(REDIS_WARNING, "Can't create the serverCron time event.");
+        exit(1);
+    }
+
+    /* Create an event handler for accepting new connections in TCP */
+    // 为 TCP 连接关联连接应答（accept）处理器
+    // 用于接受并应答客户端的 connect() 调用
+    for (j = 0; j < server.ipfd_count; j++) {
+        if (aeCreateFileEvent(server.el, server.ipfd[j], AE_READABLE,
+            acceptTcpHandler,NULL) == AE_ERR)
+            {
+                redisLog(REDIS_WARNING,
+                    "Unrecoverable error creating server.ipfd file event.");
+                exit(1);
+            }
+    }
+
+    // 事件循环的卡顿检测、忙轮询和优先级预算
+    latencyInitEventLoop(server.el);
+    aeSetBusyPoll(server.el,server.busy_poll_budget,server.busy_poll_threshold);
+    aeSetPriorityBudget(server.el,AE_PRIO_BULK,server.bulk_events_per_loop);
+
+    // 创建 I/O 线程，启动 reactor 线程
+    initThreadedIO();
+    if (reactorStart() == REDIS_ERR) exit(1);
+}
+
+/* Change the max number of clients at runtime. The event loops are
+ * resized so that the file descriptors of the new clients fit.
+ *
+ * 在运行期间调整最大客户端数量，比如在流量突增的时候
+ *
+ * 事件循环的文件事件表是按段分配的，扩大时不会复制或移动已有的文件事件，
+ * 所以不会造成延迟尖峰。缩小时，如果已经有大于新 setsize 的描述符在使用，
+ * 那么返回 REDIS_ERR 。
+ */
+int updateMaxClients(int maxclients) {
+    int setsize = maxclients+REDIS_EVENTLOOP_FDSET_INCR;
+
+    if (aeResizeSetSize(server.el,setsize) == AE_ERR) {
+        redisLog(REDIS_WARNING,
+            "The event loop can't be resized to %d: fd %d is in use",
+            setsize, server.el->maxfd);
+        return REDIS_ERR;
+    }
+    if (server.reactors && reactorResizeSetSize(setsize) == REDIS_ERR)
+        return REDIS_ERR;
+    server.maxclients = maxclients;
+    return REDIS_OK;
+}
+
+/*
+ * 生成 INFO 格式的 Memory 小节
+ *
+ * 除了已分配内存的总量、RSS 、私有脏页、碎片率和碎片整理的统计，还列出每种使用内存池的对象正在使用的内存，
+ * 以及内存池已经向分配器申请的内存，两者之差是内存池中空闲对象占用的内存。
+ */
+sds genMemoryInfoString(sds info) {
+    size_t rss = zmalloc_get_rss();
+    int j;
+
+    info = sdscatprintf(info,
+        "# Memory\r\n"
+        "used_memory:%zu\r\n"
+        "used_memory_rss:%zu\r\n"
+        "used_memory_private_dirty:%zu\r\n"
+        "mem_fragmentation_ratio:%.2f\r\n"
+        "mem_allocator:%s\r\n"
+        "active_defrag_running:%d\r\n"
+        "active_defrag_hits:%lld\r\n"
+        "active_defrag_misses:%lld\r\n",
+        zmalloc_used_memory(),
+        rss,
+        zmalloc_get_private_dirty(),
+        zmalloc_get_fragmentation_ratio(rss),
+        ZMALLOC_LIB,
+        __atomic_load_n(&server.stat_active_defrag_running,__ATOMIC_RELAXED),
+        __atomic_load_n(&server.stat_active_defrag_hits,__ATOMIC_RELAXED),
+        __atomic_load_n(&server.stat_active_defrag_misses,__ATOMIC_RELAXED));
+    for (j = 0; j < ZPOOL_TYPES; j++) {
+        size_t used, allocated;
+
+        zpoolGetStats(j,&used,&allocated);
+        info = sdscatprintf(info,"mem_pool_%s:used=%zu,allocated=%zu\r\n",
+            zpoolName(j),used,allocated);
+    }
+    return info;
+}
+
+/*============================ Redis commands ============================ */
+
+void pingCommand(redisClient *c) {
+    /* The command takes zero or one arguments. */
+    if (c->argc > 2) {
+        addReplyError(c,"wrong number of arguments for 'ping' command");
+        return;
+    }
+
+    if (c->argc == 1)
+        addReplyStatus(c,"PONG");
+    else
+        addReplyBulk(c,c->argv[1]);
+}
+
+void echoCommand(redisClient *c) {
+    addReplyBulk(c,c->argv[1]);
+}
+
+/*
+ * INFO [section]
+ *
+ * 目前只有 memory 和 latency 两个小节，不给出参数时返回全部小节
+ */
+void infoCommand(redisClient *c) {
+    char *section = c->argc == 2 ? c->argv[1]->ptr : "default";
+    int all = !strcasecmp(section,"default") || !strcasecmp(section,"all");
+    sds info = sdsempty();
+
+    if (c->argc > 2) {
+        addReplyError(c,"syntax error");
+        sdsfree(info);
+        return;
+    }
+
+    if (all || !strcasecmp(section,"memory"))
+        info = genMemoryInfoString(info);
+    if (all || !strcasecmp(section,"latency")) {
+        if (sdslen(info)) info = sdscat(info,"\r\n");
+        info = genLatencyInfoString(info);
+    }
+
+    addReplySds(c,sdscatprintf(sdsempty(),"$%lu\r\n",
+        (unsigned long)sdslen(info)));
+    addReplySds(c,info);
+    addReplyString(c,"\r\n",2);
+}
 
 int main(int argc, char **argv) {
-    //initServerConfig();
-    //initServer();
+    uint8_t hashseed[16];
+    REDIS_NOTUSED(argc);
+    REDIS_NOTUSED(argv);
+
+    // 每次启动使用不同的哈希密钥，让外部无法预先构造碰撞的键
+    getRandomBytes(hashseed,sizeof(hashseed));
+    dictSetHashFunctionSeed(hashseed);
+
+    // 初始化服务器配置
+    initServerConfig();
+
+    // 创建并初始化服务器数据结构
+    initServer();
+
     // 运行事件处理器， 一直到服务器关闭为止
-    //aeMain(server.el);
+    aeSetBeforeSleepProc(server.el,beforeSleep);
+    aeMain(server.el);
+
+    // 服务器关闭，停止事件处理器
+    aeDeleteEventLoop(server.el);
     return 0;
 }
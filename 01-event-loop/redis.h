@@ -2,6 +2,7 @@
 #define _REDIS_H
 
 #include "fmacros.h"
+#include "config.h"
 #include "dict.h"
 #include "adlist.h"
 #include <stdio.h>
@@ -20,10 +21,12 @@
 #include "ae.h"
 #include "sds.h"
 #include "zmalloc.h"
+#include "zpool.h"
+#include "util.h"
 
 /* Error codes */
-#define REDIS_OK
-#define REDIS_ERR
+#define REDIS_OK                0
+#define REDIS_ERR               -1
 
 /* Objects encoding. Some kind of objects like String and Hashes can be
  * internally represented in multiple ways. The 'encoding' field of the object 
@@ -46,6 +49,9 @@
 #define REDIS_MIN_RESERVED_FDS 32
 #define REDIS_EVENTLOOP_FDSET_INCR (REDIS_MIN_RESERVED_FDS+96)
 #define REDIS_MAX_CLIENTS 10000  /* 最大所支持的用户数目 */
+#define REDIS_MAX_WRITE_PER_EVENT (1024*64)  /* 每次写事件最多写出的字节数 */
+#define REDIS_IOV_PER_WRITE 64   /* 每次 writev() 最多写出的回复部分数量 */
+#define REDIS_MAX_QUERYBUF_LEN  (1024*1024*1024) /* 1GB max query buffer. */
 
 /* Static server configuration */
 #define REDIS_DEFAULT_HZ       10
@@ -55,6 +61,76 @@
 #define REDIS_IP_STR_LEN INET6_ADDRSTRLEN
 #define REDIS_DEFAULT_DBNUM    16
 #define REDIS_DEFAULT_TCP_KEEPALIVE 0
+#define REDIS_MAX_ACCEPTS_PER_CALL 1000    /* 每次调用 accept 处理器最多接受的连接数 */
+
+/* Event loop latency monitoring */
+#define REDIS_DEFAULT_LOOP_STALL_THRESHOLD 10000  /* 一轮循环忙碌 10 毫秒以上算作卡顿，单位为微秒 */
+
+/* Adaptive busy polling */
+#define REDIS_DEFAULT_BUSY_POLL_BUDGET 0       /* 微秒，0 表示不忙轮询 */
+#define REDIS_DEFAULT_BUSY_POLL_THRESHOLD 32   /* 一轮就绪这么多事件时开始忙轮询 */
+
+/* Active rehashing */
+#define REDIS_DEFAULT_ACTIVE_REHASHING 1
+#define REDIS_DBCRON_DBS_PER_CALL 16   /* 每次 databasesCron 最多检查多少个数据库 */
+
+/* Memory stats sampling */
+#define REDIS_RSS_SAMPLE_PERIOD 100            /* 每 100 毫秒采样一次 RSS */
+#define REDIS_PRIVATE_DIRTY_SAMPLE_PERIOD 1000 /* 每秒采样一次私有脏页 */
+
+/* Active defragmentation */
+#define REDIS_DEFAULT_ACTIVE_DEFRAG 0                 /* 默认不主动整理碎片 */
+#define REDIS_DEFAULT_ACTIVE_DEFRAG_THRESHOLD 10      /* 碎片率超过 110% 时开始整理 */
+#define REDIS_DEFAULT_ACTIVE_DEFRAG_IGNORE_BYTES (100<<20) /* 碎片少于 100MB 时不整理 */
+#define REDIS_DEFAULT_ACTIVE_DEFRAG_CYCLE 5           /* 整理时最多使用 5% 的 CPU 时间 */
+#define REDIS_ACTIVE_DEFRAG_MIN_GAIN 1                /* 一次整理让碎片率下降不到 1 个百分点算作无效 */
+#define REDIS_ACTIVE_DEFRAG_COOLDOWN 10000            /* 无效整理之后等待 10 秒再检查，连续无效时加倍 */
+#define REDIS_ACTIVE_DEFRAG_COOLDOWN_MAX 600000       /* 最多等待 10 分钟 */
+
+/* Event priorities */
+#define REDIS_DEFAULT_BULK_EVENTS_PER_LOOP 64  /* 每轮循环最多处理多少个大批量客户端的事件，0 表示不限制 */
+
+/* Multi-reactor mode */
+#define REDIS_DEFAULT_REACTORS 0            /* 0 表示不开启多 reactor 模式 */
+#define REDIS_MAX_REACTORS 128
+#define REDIS_DEFAULT_REACTOR_CPU_AFFINITY 1
+#define REDIS_CLUSTER_SLOTS 16384           /* 键空间按槽划分，槽号为 crc16(key) & 16383 */
+
+/* Threaded I/O */
+#define REDIS_DEFAULT_IO_THREADS_NUM 1      /* 1 表示不使用 I/O 线程，由主线程读写 */
+#define REDIS_DEFAULT_IO_THREADS_DO_READS 0 /* 默认 I/O 线程只负责写出回复 */
+#define REDIS_IO_THREADS_MAX_NUM 128
+
+/* Client flags */
+// 命令被转交给其他 reactor 线程执行，执行期间客户端所在的事件循环不能被修改，
+// 回复会在命令执行完毕、客户端回到原线程之后再安装写处理器
+#define REDIS_REMOTE_EXEC (1<<0)
+#define REDIS_CLOSE_AFTER_REPLY (1<<1) /* Close after writing entire reply. */
+#define REDIS_CLOSE_ASAP (1<<2)      /* Close this client ASAP */
+#define REDIS_PENDING_READ (1<<3)    /* 在 clients_pending_read 中，等待 I/O 线程读取 */
+#define REDIS_PENDING_COMMAND (1<<4) /* I/O 线程已经解析出命令，等待主线程执行 */
+#define REDIS_PENDING_WRITE (1<<5)   /* 在 clients_pending_write 中，等待写出回复 */
+#define REDIS_IO_READ_INFLIGHT (1<<6)  /* 异步读操作还在使用 querybuf */
+#define REDIS_IO_WRITE_INFLIGHT (1<<7) /* 异步写操作还在使用 buf 和 reply */
+#define REDIS_CLOSE_AFTER_IO (1<<8)    /* 异步读写操作全部完成之后释放客户端 */
+
+/* Anti-warning macro... */
+#define REDIS_NOTUSED(V) ((void) V)
+
+/* Using the following macro you can run code inside serverCron() with the
+ * specified period, specified in milliseconds.
+ * The actual resolution depends on server.hz.
+ *
+ * 每隔 _ms_ 毫秒执行一次后面的语句，精度取决于 server.hz */
+#define run_with_period(_ms_) if ((_ms_ <= 1000/server.hz) || !(server.cronloops%((_ms_)/(1000/server.hz))))
+
+/* Log levels */
+#define REDIS_DEBUG 0
+#define REDIS_VERBOSE 1
+#define REDIS_NOTICE 2
+#define REDIS_WARNING 3
+#define REDIS_DEFAULT_VERBOSITY REDIS_NOTICE
+#define REDIS_MAX_LOGMSG_LEN    1024 /* Default maximum length of syslog messages */
 
 /* Client request types */
 #define REDIS_REQ_INLINE    1
@@ -65,6 +141,12 @@
 #define REDIS_ENCODING_INT 1     /* Encoded as integer */
 #define REDIS_ENCODING_EMBSTR 8  /* Embedded sds string encodig */
 
+/* 长度不超过这个值的字符串使用 EMBSTR 编码 */
+#define REDIS_ENCODING_EMBSTR_SIZE_LIMIT 39
+
+/* 长度不超过这个值的 sds 键嵌入到字典节点中，见 dictSdsEmbedLen */
+#define REDIS_DICT_EMBED_KEY_SIZE_LIMIT 39
+
 /* 命令标志 */
 #define REDIS_CMD_WRITE 1               /* 'w' flag */
 #define REDIS_CMD_READONLY 2            /* 'r' flag */
@@ -127,6 +209,10 @@ typedef struct redisDb {
 typedef struct redisClient {
      int fd;   //套接字描述符
 
+     struct redisWorker *worker;  // 客户端所属的 reactor 线程，单线程模式下为 NULL
+
+     void *remote_call;  // 等异步写操作完成之后才转交给其他 reactor 线程的命令
+
      redisDb *db;   // 当前正在使用的数据库
 
      int dictid;    // 当前正在使用的数据库的 id (号码)
@@ -143,7 +229,7 @@ typedef struct redisClient {
 
      struct redisCommand *cmd, *lastcmd;    // 记录被客户端执行的命令
 
-     int reqtype  // 请求的类型，是内联命令还是多条命令
+     int reqtype;  // 请求的类型，是内联命令还是多条命令
 
      int multibulklen;  // 剩余未读取的命令内容数量
 
@@ -155,9 +241,58 @@ typedef struct redisClient {
 
      int bufpos;    // 回复偏移量
 
+     size_t sentlen;   // 当前正在发送的回复（buf 或 reply 的第一个节点）已经发送的字节数
+
+     int flags;     // 客户端状态标志 REDIS_REMOTE_EXEC ...
+
+     int priority;  // 客户端套接字在事件循环中的优先级 AE_PRIO_*
+
      char buf[REDIS_REPLY_CHUNK_BYTES];
 } redisClient;
 
+/* Task executed on a reactor thread, see reactorSubmit() */
+struct redisWorker;
+typedef void reactorTaskProc(struct redisWorker *w, void *privdata);
+
+/*
+ * 多 reactor 模式下的一个工作线程
+ *
+ * 每个线程拥有自己的事件循环、自己的 SO_REUSEPORT 监听套接字和自己的客户端链表，
+ * 键空间按槽划分给各个线程，线程只访问自己负责的那部分数据库
+ */
+typedef struct redisWorker {
+
+    int id;                  // 线程编号，从 0 开始
+
+    pthread_t thread;        // 线程 id
+
+    int cpu;                 // 绑定的 CPU 号， -1 表示不绑定
+
+    aeEventLoop *el;         // 线程自己的事件循环
+
+    int ipfd[REDIS_BINDADDR_MAX];  // 线程自己的 tcp 监听描述符
+    int ipfd_count;
+
+    list *clients;           // 连接到这个线程的客户端
+
+    list *clients_pending_write;  // 有回复等待写出的客户端，在 beforesleep 中写出
+
+    redisDb *db;             // 线程负责的键空间分片，共有 server.dbnum 个数据库
+
+    unsigned int slot_start, slot_end;  // 负责的槽范围 [slot_start, slot_end)
+
+    /* Mailbox: tasks submitted by other threads */
+    pthread_mutex_t mailbox_mutex;  // 保护 mailbox
+    list *mailbox;           // 其他线程提交过来、等待执行的任务
+    int notify_pipe[2];      // 有新任务时写 notify_pipe[1] 来唤醒事件循环
+
+    long long stat_numconnections;  // 已接受的连接数量
+    long long stat_remote_calls;    // 转交给其他线程执行的命令数量
+
+    char neterr[ANET_ERR_LEN];      // 用于记录网络错误
+
+} redisWorker;
+
 
 
 struct redisServer {
@@ -167,6 +302,10 @@ struct redisServer {
 
     int hz;                // serverCron()  每秒调用的次数
 
+    int verbosity;         // 日志的级别，低于这个级别的日志不会被打印
+
+    int cronloops;         // serverCron() 已经执行的次数
+
     redisDb *db;           // 一个数组，保存着服务器中所有的数据库
 
     dict *commands;        // 命令表 （受到 rename 配置选项的作用）
@@ -179,7 +318,7 @@ struct redisServer {
 
     int port;
     int tcp_backlog;
-    int *bindaddr[REDIS_BINDADDR_MAX]; // ip 地址
+    char *bindaddr[REDIS_BINDADDR_MAX]; // ip 地址
     int bindaddr_count;    // 地址的数量
 
     int ipfd[REDIS_BINDADDR_MAX];    // tcp 描述符
@@ -195,9 +334,49 @@ struct redisServer {
     int tcpkeepalive;        // 是否开启 SO_KEEPALIVE 选项
     int dbnum;               //  数据库的总数目
 
+    int activerehashing;     // 是否在 serverCron 中主动 rehash 数据库字典
+
+    pid_t child_pid;         // 正在保存数据的子进程的 ID ，没有子进程时为 -1
+
+    /* Active defragmentation */
+    int active_defrag;                  // 是否在 serverCron 中主动整理内存碎片
+    int active_defrag_threshold;        // 碎片率超过 100% 多少个百分点时开始整理
+    long long active_defrag_ignore_bytes;  // 碎片（ RSS 减去 used_memory ）少于这个值时不整理
+    int active_defrag_cycle;            // 整理时每个线程最多使用的 CPU 时间百分比
+    int stat_active_defrag_running;     // 正在整理的线程数量
+    long long stat_active_defrag_hits;     // 被重新分配的内存块数量
+    long long stat_active_defrag_misses;   // 检查过但不能移动的内存块数量
+
     /* Limits */
     int maxclients;             //max number of simultaneous clients
-    
+
+    /* Latency monitor */
+    long long loop_stall_threshold;  // 事件循环卡顿的阈值（微秒），为 0 时不检测卡顿
+
+    /* Adaptive busy polling */
+    long long busy_poll_budget;   // 负载高时忙轮询的时长（微秒），为 0 时总是阻塞等待
+    int busy_poll_threshold;      // 一轮就绪的事件达到多少个时开始忙轮询
+
+    /* Event priorities */
+    int bulk_events_per_loop;     // 每轮循环最多处理多少个 AE_PRIO_BULK 客户端的事件，0 表示不限制
+
+    /* Multi-reactor mode */
+    int reactors;               // reactor 线程数量，为 0 时只使用 el 单线程处理
+    int reactor_cpu_affinity;   // 是否将每个 reactor 线程绑定到一个 CPU 核上
+    redisWorker *workers;       // reactor 线程数组
+
+    /* Threaded I/O */
+    int io_threads_num;         // I/O 线程数量（包括主线程），为 1 时不使用 I/O 线程
+    int io_threads_do_reads;    // I/O 线程是否也负责读取和解析命令请求
+    int io_threads_active;      // I/O 线程当前是否在运行
+    list *clients_pending_read;   // 等待 I/O 线程读取的客户端
+    list *clients_pending_write;  // 有回复等待写出的客户端
+    pthread_mutex_t async_free_queue_mutex;  // I/O 线程访问 clients_to_close 时使用
+    size_t client_max_querybuf_len;  // 查询缓冲区的最大长度
+
+    long long stat_io_reads_processed;   // 经过 I/O 线程读取的客户端数量
+    long long stat_io_writes_processed;  // 经过 I/O 线程写出的客户端数量
+
 };
 
 
@@ -239,7 +418,126 @@ struct redisCommand {
 
 
 
+/*-----------------------------------------------------------------------------
+ * Extern declarations
+ *----------------------------------------------------------------------------*/
+
+extern struct redisServer server;
+extern dictType dbDictType;
+extern dictType keyptrDictType;
+extern dictType commandTableDictType;
+
+/* 客户端所属的事件循环和客户端链表：多 reactor 模式下属于客户端所在的线程 */
+#define clientEventLoop(c) ((c)->worker ? (c)->worker->el : server.el)
+#define clientList(c) ((c)->worker ? (c)->worker->clients : server.clients)
+#define clientPendingWriteList(c) \
+    ((c)->worker ? (c)->worker->clients_pending_write : server.clients_pending_write)
+
 /* api */
+void populateCommandTable(void);
+struct redisCommand *lookupCommand(sds name);
+void call(redisClient *c, int flags);
 int processCommand(redisClient *c);
+int updateMaxClients(int maxclients);
+int serverCron(struct aeEventLoop *eventLoop, long long id, void *clientData);
+uint64_t dictSdsHash(const void *key);
+uint64_t dictSdsCaseHash(const void *key);
+int dictSdsKeyCompare(void *privdata, const void *key1, const void *key2);
+int dictSdsKeyCaseCompare(void *privdata, const void *key1, const void *key2);
+void dictSdsDestructor(void *privdata, void *val);
+size_t dictSdsEmbedLen(const void *key);
+void *dictSdsEmbed(void *buf, const void *key);
+redisDb *createDatabases(void);
+void databasesCron(redisDb *db);
+int hasActiveChildProcess(void);
+void updateDictResizePolicy(void);
+void redisLog(int level, const char *fmt, ...);
+
+/* networking.c -- Networking and Client related operations */
+// 创建客户端时，客户端属于调用线程所在的 reactor （reactorGetCurrentWorker()）
+redisClient *createClient(int fd);
+void freeClient(redisClient *c);
+void freeClientAsync(redisClient *c);
+void freeClientsInAsyncFreeQueue(void);
+void resetClient(redisClient *c);
+void setClientPriority(redisClient *c, int priority);
+void acceptTcpHandler(aeEventLoop *el, int fd, void *privdata, int mask);
+void readQueryFromClient(aeEventLoop *el, int fd, void *privdata, int mask);
+void sendReplyToClient(aeEventLoop *el, int fd, void *privdata, int mask);
+int writeToClient(int fd, redisClient *c, int handler_installed);
+int clientHasPendingReplies(redisClient *c);
+void processInputBuffer(redisClient *c);
+int processInlineBuffer(redisClient *c);
+int processMultibulkBuffer(redisClient *c);
+int prepareClientToWrite(redisClient *c);
+void addReply(redisClient *c, robj *obj);
+void addReplySds(redisClient *c, sds s);
+void addReplyString(redisClient *c, char *s, size_t len);
+void addReplyError(redisClient *c, char *err);
+void addReplyErrorLength(redisClient *c, char *s, size_t len);
+void addReplyStatus(redisClient *c, char *status);
+void addReplyStatusLength(redisClient *c, char *s, size_t len);
+void addReplyLongLong(redisClient *c, long long ll);
+void addReplyMultiBulkLen(redisClient *c, long length);
+void addReplyBulk(redisClient *c, robj *obj);
+void addReplyBulkCBuffer(redisClient *c, void *p, size_t len);
+void addReplyNull(redisClient *c);
+
+/* Threaded I/O */
+void initThreadedIO(void);
+int handleClientsWithPendingReadsUsingThreads(void);
+int handleClientsWithPendingWritesUsingThreads(void);
+int handleClientsWithPendingWrites(list *pending);
+
+/* latency.c -- Event loop latency histograms and stall detector */
+void latencyInitEventLoop(aeEventLoop *el);
+void latencyTrackCommand(redisClient *c, long long duration);
+sds genLatencyInfoString(sds info);
+sds genMemoryInfoString(sds info);
+
+/* defrag.c -- Active defragmentation */
+void activeDefragCycle(redisDb *db);
+
+/* Redis object implementation */
+robj *createObject(int type, void *ptr);
+robj *createRawStringObject(char *ptr, size_t len);
+robj *createEmbeddedStringObject(char *ptr, size_t len);
+robj *createStringObject(char *ptr, size_t len);
+void incrRefCount(robj *o);
+void decrRefCount(robj *o);
+void decrRefCountVoid(void *o);
+
+/* reactor.c -- Multi-reactor mode */
+int reactorStart(void);
+void reactorStop(void);
+redisWorker *reactorGetCurrentWorker(void);
+redisWorker *reactorWorkerForSlot(unsigned int slot);
+int reactorSubmit(redisWorker *w, reactorTaskProc *proc, void *privdata);
+int reactorCall(redisClient *c, redisCommandProc *proc);
+void reactorSubmitDeferredCall(redisClient *c);
+int reactorResizeSetSize(int setsize);
+
+/* db.c -- Keyspace access API */
+robj *lookupKey(redisDb *db, robj *key);
+robj *lookupKeyRead(redisDb *db, robj *key);
+robj *lookupKeyWrite(redisDb *db, robj *key);
+void dbAdd(redisDb *db, robj *key, robj *val);
+void dbOverwrite(redisDb *db, robj *key, robj *val);
+void setKey(redisDb *db, robj *key, robj *val);
+int dbDelete(redisDb *db, robj *key);
+
+/* Commands prototypes */
+void pingCommand(redisClient *c);
+void echoCommand(redisClient *c);
+void infoCommand(redisClient *c);
+void selectCommand(redisClient *c);
+void existsCommand(redisClient *c);
+void delCommand(redisClient *c);
+void getCommand(redisClient *c);
+void setCommand(redisClient *c);
+
+/* Hash slots */
+unsigned int keyHashSlot(char *key, int keylen);
+uint16_t crc16(const char *buf, int len);
 
 #endif
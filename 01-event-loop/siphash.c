@@ -0,0 +1,152 @@
+/* siphash.c -- SipHash-1-3 ，字典默认使用的带密钥的哈希函数
+ *
+ * SipHash 由 Jean-Philippe Aumasson 和 Daniel J. Bernstein 设计，
+ * 在不知道 16 字节密钥的情况下，无法构造出大量哈希值相同的键，
+ * 所以可以防止通过哈希碰撞让字典退化成链表的拒绝服务攻击。
+ *
+ * 这里使用的是 SipHash-1-3 ：每 8 个字节做 1 轮压缩，最后做 3 轮收尾，
+ * 比 SipHash-2-4 快很多，对哈希表来说安全性已经足够。
+ *
+ * 另外提供一个不区分大小写的版本，它和先把输入转换成小写再调用 siphash()
+ * 的结果相同，但转换是以 8 个字节为单位、用 SWAR 方式在一个 64 位整数里完成的，
+ * 不需要逐个字节调用 tolower 。
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+/* 从 p 读入 8 个字节，按小端序转换为 64 位整数 */
+#if defined(__x86_64__) || defined(__i386__) || \
+    (defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+static inline uint64_t U8TO64_LE(const uint8_t *p) {
+    uint64_t v;
+
+    memcpy(&v,p,sizeof(v));
+    return v;
+}
+#else
+static inline uint64_t U8TO64_LE(const uint8_t *p) {
+    return (uint64_t)p[0] | ((uint64_t)p[1] << 8) |
+           ((uint64_t)p[2] << 16) | ((uint64_t)p[3] << 24) |
+           ((uint64_t)p[4] << 32) | ((uint64_t)p[5] << 40) |
+           ((uint64_t)p[6] << 48) | ((uint64_t)p[7] << 56);
+}
+#endif
+
+#define ROTL(x, b) (uint64_t)(((x) << (b)) | ((x) >> (64 - (b))))
+
+#define SIPROUND                                                               \
+    do {                                                                       \
+        v0 += v1;                                                              \
+        v1 = ROTL(v1, 13);                                                     \
+        v1 ^= v0;                                                              \
+        v0 = ROTL(v0, 32);                                                     \
+        v2 += v3;                                                              \
+        v3 = ROTL(v3, 16);                                                     \
+        v3 ^= v2;                                                              \
+        v0 += v3;                                                              \
+        v3 = ROTL(v3, 21);                                                     \
+        v3 ^= v0;                                                              \
+        v2 += v1;                                                              \
+        v1 = ROTL(v1, 17);                                                     \
+        v1 ^= v2;                                                              \
+        v2 = ROTL(v2, 32);                                                     \
+    } while (0)
+
+/*
+ * 将 64 位整数 x 中的 8 个字节分别转换为小写
+ *
+ * 只转换 'A' 到 'Z' ，其他字节保持不变，和 C locale 下的 tolower 相同。
+ * 每个字节的低 7 位加上常数之后，最高位就表示这个字节是否大于等于某个值，
+ * 加法不会向相邻的字节进位。
+ */
+static inline uint64_t siptolower(uint64_t x) {
+    uint64_t heptets = x & 0x7f7f7f7f7f7f7f7fULL;
+    // 字节 >= 'A' 时最高位为 1
+    uint64_t ge_a = heptets + 0x3f3f3f3f3f3f3f3fULL;
+    // 字节 > 'Z' 时最高位为 1
+    uint64_t gt_z = heptets + 0x2525252525252525ULL;
+    // 只处理 ASCII 字符
+    uint64_t upper = (ge_a ^ gt_z) & ~x & 0x8080808080808080ULL;
+
+    return x | (upper >> 2);
+}
+
+/*
+ * 计算 in 的 SipHash-1-3 值，k 为 16 字节的密钥
+ *
+ * nocase 为真时，计算 in 转换为小写之后的哈希值
+ */
+static inline uint64_t siphash_generic(const uint8_t *in, const size_t inlen,
+                                       const uint8_t *k, int nocase)
+{
+    uint64_t v0 = 0x736f6d6570736575ULL;
+    uint64_t v1 = 0x646f72616e646f6dULL;
+    uint64_t v2 = 0x6c7967656e657261ULL;
+    uint64_t v3 = 0x7465646279746573ULL;
+    uint64_t k0 = U8TO64_LE(k);
+    uint64_t k1 = U8TO64_LE(k + 8);
+    uint64_t m, t = 0;
+    const uint8_t *end = in + inlen - (inlen % sizeof(uint64_t));
+    const int left = inlen & 7;
+    uint64_t b = ((uint64_t)inlen) << 56;
+
+    v3 ^= k1;
+    v2 ^= k0;
+    v1 ^= k1;
+    v0 ^= k0;
+
+    // 每次压缩 8 个字节
+    for (; in != end; in += 8) {
+        m = U8TO64_LE(in);
+        if (nocase) m = siptolower(m);
+        v3 ^= m;
+
+        SIPROUND;
+
+        v0 ^= m;
+    }
+
+    // 剩下不足 8 个字节的部分，和输入的长度一起组成最后一个字
+    switch (left) {
+    case 7: t |= ((uint64_t)in[6]) << 48; /* fall-thru */
+    case 6: t |= ((uint64_t)in[5]) << 40; /* fall-thru */
+    case 5: t |= ((uint64_t)in[4]) << 32; /* fall-thru */
+    case 4: t |= ((uint64_t)in[3]) << 24; /* fall-thru */
+    case 3: t |= ((uint64_t)in[2]) << 16; /* fall-thru */
+    case 2: t |= ((uint64_t)in[1]) << 8; /* fall-thru */
+    case 1: t |= ((uint64_t)in[0]); break;
+    case 0: break;
+    }
+    if (nocase) t = siptolower(t);
+    b |= t;
+
+    v3 ^= b;
+
+    SIPROUND;
+
+    v0 ^= b;
+    v2 ^= 0xff;
+
+    SIPROUND;
+    SIPROUND;
+    SIPROUND;
+
+    b = v0 ^ v1 ^ v2 ^ v3;
+    return b;
+}
+
+/*
+ * 计算 in 的 SipHash-1-3 值，k 为 16 字节的密钥
+ */
+uint64_t siphash(const uint8_t *in, const size_t inlen, const uint8_t *k) {
+    return siphash_generic(in,inlen,k,0);
+}
+
+/*
+ * 不区分大小写的 SipHash-1-3
+ */
+uint64_t siphash_nocase(const uint8_t *in, const size_t inlen, const uint8_t *k) {
+    return siphash_generic(in,inlen,k,1);
+}
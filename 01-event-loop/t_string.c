@@ -0,0 +1,40 @@
+/* t_string.c -- 字符串键的命令
+ *
+ * 只实现了最基本的 GET 和 SET ，用来在单线程、I/O 线程和多 reactor 模式下
+ * 端到端地执行带键的命令。
+ */
+
+#include "redis.h"
+
+/*-----------------------------------------------------------------------------
+ * String Commands
+ *----------------------------------------------------------------------------*/
+
+/*
+ * SET key value
+ *
+ * 将键 key 关联到值 value ，键已经存在时覆盖旧值
+ */
+void setCommand(redisClient *c) {
+    setKey(c->db,c->argv[1],c->argv[2]);
+    addReplyStatus(c,"OK");
+}
+
+/*
+ * GET key
+ *
+ * 返回键 key 的值，键不存在时返回空回复
+ */
+void getCommand(redisClient *c) {
+    robj *o = lookupKeyRead(c->db,c->argv[1]);
+
+    if (o == NULL) {
+        addReplyNull(c);
+        return;
+    }
+    if (o->type != REDIS_STRING) {
+        addReplyError(c,"WRONGTYPE Operation against a key holding the wrong kind of value");
+        return;
+    }
+    addReplyBulk(c,o);
+}
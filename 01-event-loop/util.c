@@ -0,0 +1,137 @@
+/* util.c -- 字符串和整数之间的转换等工具函数 */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include "util.h"
+
+/* Convert a long long into a string. Returns the number of
+ * characters needed to represent the number, that can be shorter if passed
+ * buffer length is not enough to store the whole number.
+ *
+ * 将 long long 值 value 转换为字符串，保存到 s 中，
+ * 返回字符串的长度。
+ */
+int ll2string(char *s, size_t len, long long value) {
+    char buf[32], *p;
+    unsigned long long v;
+    size_t l;
+
+    if (len == 0) return 0;
+    v = (value < 0) ? -value : value;
+    p = buf+31; /* point to the last character */
+    do {
+        *p-- = '0'+(v%10);
+        v /= 10;
+    } while(v);
+    if (value < 0) *p-- = '-';
+    p++;
+    l = 32-(p-buf);
+    if (l+1 > len) l = len-1; /* Make sure it fits, including the nul term */
+    memcpy(s,p,l);
+    s[l] = '\0';
+    return l;
+}
+
+/* Convert a string into a long long. Returns 1 if the string could be parsed
+ * into a (non-overflowing) long long, 0 otherwise. The value will be set to
+ * the parsed value when appropriate.
+ *
+ * 将字符串 s 转换为 long long 值，保存到 value 中，
+ * 转换成功返回 1 ，字符串不是合法的整数或者溢出时返回 0 。
+ */
+int string2ll(const char *s, size_t slen, long long *value) {
+    const char *p = s;
+    size_t plen = 0;
+    int negative = 0;
+    unsigned long long v;
+
+    if (plen == slen)
+        return 0;
+
+    /* Special case: first and only digit is 0. */
+    if (slen == 1 && p[0] == '0') {
+        if (value != NULL) *value = 0;
+        return 1;
+    }
+
+    if (p[0] == '-') {
+        negative = 1;
+        p++; plen++;
+
+        /* Abort on only a negative sign. */
+        if (plen == slen)
+            return 0;
+    }
+
+    /* First digit should be 1-9, otherwise the string should just be 0. */
+    if (p[0] >= '1' && p[0] <= '9') {
+        v = p[0]-'0';
+        p++; plen++;
+    } else if (p[0] == '0' && slen == 1) {
+        *value = 0;
+        return 1;
+    } else {
+        return 0;
+    }
+
+    while (plen < slen && p[0] >= '0' && p[0] <= '9') {
+        if (v > (ULLONG_MAX / 10)) /* Overflow. */
+            return 0;
+        v *= 10;
+
+        if (v > (ULLONG_MAX - (p[0]-'0'))) /* Overflow. */
+            return 0;
+        v += p[0]-'0';
+
+        p++; plen++;
+    }
+
+    /* Return if not all bytes were used. */
+    if (plen < slen)
+        return 0;
+
+    if (negative) {
+        if (v > ((unsigned long long)(-(LLONG_MIN+1))+1)) /* Overflow. */
+            return 0;
+        if (value != NULL) *value = -v;
+    } else {
+        if (v > LLONG_MAX) /* Overflow. */
+            return 0;
+        if (value != NULL) *value = v;
+    }
+    return 1;
+}
+
+/* Get random bytes, attempts to get them from /dev/urandom. If it is not
+ * available, a weaker seed is used, built from the current time and the
+ * process id.
+ *
+ * 生成 len 个随机字节，优先从 /dev/urandom 读取，
+ * 读取失败时使用由当前时间和进程 id 生成的较弱的随机数
+ */
+void getRandomBytes(unsigned char *p, size_t len) {
+    FILE *fp = fopen("/dev/urandom","r");
+
+    if (fp == NULL || fread(p,len,1,fp) != 1) {
+        struct timeval tv;
+        unsigned long long x;
+        size_t j;
+
+        gettimeofday(&tv,NULL);
+        x = ((unsigned long long)tv.tv_sec*1000000+tv.tv_usec) ^
+            ((unsigned long long)getpid() << 32);
+        for (j = 0; j < len; j++) {
+            // xorshift64*
+            x ^= x >> 12;
+            x ^= x << 25;
+            x ^= x >> 27;
+            p[j] = (unsigned char)((x*0x2545F4914F6CDD1DULL) >> 56);
+        }
+    }
+    if (fp) fclose(fp);
+}
@@ -0,0 +1,8 @@
+#ifndef __REDIS_UTIL_H
+#define __REDIS_UTIL_H
+
+int ll2string(char *s, size_t len, long long value);
+int string2ll(const char *s, size_t slen, long long *value);
+void getRandomBytes(unsigned char *p, size_t len);
+
+#endif
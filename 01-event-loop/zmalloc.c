@@ -5,7 +5,7 @@
 
 /* This function provide us access to the original libc free(). This is useful
  * for instance to free results obtained by backtrace_symbols(). We need
- * to define this function before including zmalloc.h that may shadow the 
+ * to define this function before including zmalloc.h that may shadow the
  * free implementation if we use jemalloc or another non standard allocator. */
  // 总结；不要覆盖这些函数, 引入zmalloc就覆盖了
 void zlibc_free(void *ptr) {
@@ -13,91 +13,460 @@ void zlibc_free(void *ptr) {
  }
 #include <string.h>
 #include <pthread.h>
+#include <time.h>
+#include "config.h"
 #include "zmalloc.h"
 
+// 分配器能查询内存块的大小时，不需要在内存块前面记录大小
+#ifdef HAVE_MALLOC_SIZE
+#define PREFIX_SIZE (0)
+#else
+#if defined(__sun) || defined(__sparc) || defined(__sparc__)
+#define PREFIX_SIZE (sizeof(long long))
+#else
 #define PREFIX_SIZE (sizeof(size_t))
+#endif
+#endif
 
  /* Explicitly override malloc/free etc when using tcmalloc. */
+#if defined(USE_TCMALLOC)
+#define malloc(size) tc_malloc(size)
+#define calloc(count,size) tc_calloc(count,size)
+#define realloc(ptr,size) tc_realloc(ptr,size)
+#define free(ptr) tc_free(ptr)
+#elif defined(USE_JEMALLOC)
+#define malloc(size) je_malloc(size)
+#define calloc(count,size) je_calloc(count,size)
+#define realloc(ptr,size) je_realloc(ptr,size)
+#define free(ptr) je_free(ptr)
+#endif
+
+/*
+ * 已分配内存的统计
+ *
+ * 每个线程有自己的计数器，独占一个缓存行，
+ * 分配和释放内存时只更新当前线程的计数器，不需要加锁，也不会和其他线程争用缓存行。
+ * 计数器只由所属的线程写入，所以用普通的读写（relaxed 原子操作）就可以更新，
+ * 不需要带 lock 前缀的指令。
+ *
+ * 一个线程释放另一个线程分配的内存时，它的计数器会变成负数，
+ * 所以单个计数器没有意义，zmalloc_used_memory() 把所有计数器加起来才是总量。
+ *
+ * 线程数量超过 ZMALLOC_MAX_THREADS-1 时，多出来的线程共用最后一个计数器，
+ * 这个计数器用原子加法更新。
+ */
+#define ZMALLOC_MAX_THREADS 256
+
+typedef struct zmallocCounter {
+    long long used;
+    char pad[64-sizeof(long long)];
+} zmallocCounter;
+
+static zmallocCounter used_memory[ZMALLOC_MAX_THREADS];
+// 已经分配出去的计数器数量
+static int used_memory_threads = 0;
+// 当前线程使用的计数器
+static __thread zmallocCounter *used_memory_counter = NULL;
+
+/*
+ * 为当前线程分配计数器
+ */
+static zmallocCounter *zmalloc_thread_counter(void) {
+    int slot = __atomic_fetch_add(&used_memory_threads,1,__ATOMIC_RELAXED);
+
+    if (slot >= ZMALLOC_MAX_THREADS-1) slot = ZMALLOC_MAX_THREADS-1;
+    used_memory_counter = &used_memory[slot];
+    return used_memory_counter;
+}
 
-#define update_zmalloc_stat_add(__n) do { \
-    pthread_mutex_lock(&used_memory_mutex); \
-    used_memory += (__n); \
-    pthread_mutex_unlock(&used_memory_mutex); \
-} while(0)
-
-#define update_zmalloc_stat_sub(__n) do { \
-    pthread_mutex_lock(&used_memory_mutex); \
-    used_memory -= (__n); \
-    pthread_mutex_unlock(&used_memory_mutex); \
-} while(0)
-
+/*
+ * 将 delta 加到当前线程的计数器上
+ */
+static inline void update_zmalloc_stat(long long delta) {
+    zmallocCounter *c = used_memory_counter;
+
+    if (c == NULL) c = zmalloc_thread_counter();
+    if (c == &used_memory[ZMALLOC_MAX_THREADS-1]) {
+        __atomic_add_fetch(&c->used,delta,__ATOMIC_RELAXED);
+    } else {
+        __atomic_store_n(&c->used,
+            __atomic_load_n(&c->used,__ATOMIC_RELAXED)+delta,__ATOMIC_RELAXED);
+    }
+}
 
 #define update_zmalloc_stat_alloc(__n) do { \
     size_t _n = (__n); \
     if (_n&(sizeof(long)-1)) _n += sizeof(long)-(_n&(sizeof(long)-1)); \
-    if (zmalloc_thread_safe) { \
-        update_zmalloc_stat_add(_n); \
-    } else { \
-        used_memory -= _n; \
-    } \
+    update_zmalloc_stat((long long)_n); \
 } while(0)
 
-//#define update_zmalloc_stat_free(__n) do { \
-//    size_t _n = (__n); \
-
-
-
-
-
-
-
-
-
-
-
+#define update_zmalloc_stat_free(__n) do { \
+    size_t _n = (__n); \
+    if (_n&(sizeof(long)-1)) _n += sizeof(long)-(_n&(sizeof(long)-1)); \
+    update_zmalloc_stat(-(long long)_n); \
+} while(0)
 
 static void zmalloc_default_oom(size_t size) {
-    fprintf(stderr, "zmalloc: Out of memory trying to allocate %zu bytes\n", 
+    fprintf(stderr, "zmalloc: Out of memory trying to allocate %zu bytes\n",
         size);
     fflush(stderr);
     abort();
 }
 
-
-
-
-
-
 static void (*zmalloc_oom_handler)(size_t) = zmalloc_default_oom;
 
+void *zmalloc(size_t size) {
+    void *ptr = malloc(size+PREFIX_SIZE);
 
+    if (!ptr) zmalloc_oom_handler(size);
+#ifdef HAVE_MALLOC_SIZE
+    update_zmalloc_stat_alloc(zmalloc_size(ptr));
+    return ptr;
+#else
+    *((size_t*)ptr) = size;
+    update_zmalloc_stat_alloc(size+PREFIX_SIZE);
+    return (char*)ptr+PREFIX_SIZE;
+#endif
+}
 
+void *zcalloc(size_t size) {
+    void *ptr = calloc(1, size+PREFIX_SIZE);
 
+    if (!ptr) zmalloc_oom_handler(size);
+#ifdef HAVE_MALLOC_SIZE
+    update_zmalloc_stat_alloc(zmalloc_size(ptr));
+    return ptr;
+#else
+    *((size_t*)ptr) = size; // 居然要记录下内存块的大小
+    update_zmalloc_stat_alloc(size+PREFIX_SIZE);
+    return (char*)ptr+PREFIX_SIZE;
+#endif
+}
 
+void *zrealloc(void *ptr, size_t size) {
+#ifndef HAVE_MALLOC_SIZE
+    void *realptr;
+#endif
+    size_t oldsize;
+    void *newptr;
+
+    if (ptr == NULL) return zmalloc(size);
+#ifdef HAVE_MALLOC_SIZE
+    oldsize = zmalloc_size(ptr);
+    newptr = realloc(ptr,size);
+    if (!newptr) zmalloc_oom_handler(size);
+
+    update_zmalloc_stat_free(oldsize);
+    update_zmalloc_stat_alloc(zmalloc_size(newptr));
+    return newptr;
+#else
+    realptr = (char*)ptr-PREFIX_SIZE;
+    oldsize = *((size_t*)realptr);
+    newptr = realloc(realptr,size+PREFIX_SIZE);
+    if (!newptr) zmalloc_oom_handler(size);
+
+    *((size_t*)newptr) = size;
+    update_zmalloc_stat_free(oldsize);
+    update_zmalloc_stat_alloc(size);
+    return (char*)newptr+PREFIX_SIZE;
+#endif
+}
 
+/* Provide zmalloc_size() for systems where this function is not provided by
+ * malloc itself, given that in that case we store a header with this
+ * information as the first bytes of every allocation. */
+#ifndef HAVE_MALLOC_SIZE
+size_t zmalloc_size(void *ptr) {
+    void *realptr = (char*)ptr-PREFIX_SIZE;
+    size_t size = *((size_t*)realptr);
+    /* Assume at least that all the allocations are padded at sizeof(long) by
+     * the underlying allocator. */
+    if (size&(sizeof(long)-1)) size += sizeof(long)-(size&(sizeof(long)-1));
+    return size+PREFIX_SIZE;
+}
+#endif
+
+void zfree(void *ptr) {
+#ifndef HAVE_MALLOC_SIZE
+    void *realptr;
+    size_t oldsize;
+#endif
+
+    if (ptr == NULL) return;
+#ifdef HAVE_MALLOC_SIZE
+    update_zmalloc_stat_free(zmalloc_size(ptr));
+    free(ptr);
+#else
+    realptr = (char*)ptr-PREFIX_SIZE;
+    oldsize = *((size_t*)realptr);
+    update_zmalloc_stat_free(oldsize+PREFIX_SIZE);
+    free(realptr);
+#endif
+}
 
+#ifdef HAVE_DEFRAG
+/*
+ * 碎片整理使用的分配和释放函数，绕过 jemalloc 的线程缓存（tcache）
+ *
+ * 经过线程缓存的话，新的内存块很可能就是刚刚释放的同样大小的那一块，
+ * 内存块实际上没有被移动。使用 jemalloc 时 HAVE_MALLOC_SIZE 总是有定义，
+ * 内存块前面没有记录大小的前缀。
+ */
+void *zmalloc_no_tcache(size_t size) {
+    void *ptr = je_mallocx(size,MALLOCX_TCACHE_NONE);
 
+    if (!ptr) zmalloc_oom_handler(size);
+    update_zmalloc_stat_alloc(zmalloc_size(ptr));
+    return ptr;
+}
 
+void zfree_no_tcache(void *ptr) {
+    if (ptr == NULL) return;
+    update_zmalloc_stat_free(zmalloc_size(ptr));
+    je_dallocx(ptr,MALLOCX_TCACHE_NONE);
+}
 
+/*
+ * 检查是否值得把内存块 ptr 移动到新的位置，值得时返回 1
+ *
+ * 用 experimental.utilization.query 查询 ptr 所在的 slab ，满足以下条件才移动：
+ *
+ *  - ptr 在 slab 中（大块内存单独占用页面，移动它不会减少碎片），
+ *    并且 slab 没有满（满的 slab 移走一块也不能释放）；
+ *  - ptr 不在 bin 当前用来分配的 slab 中，新的内存块会从那里分配；
+ *  - slab 的使用率低于同一个 bin 中所有 slab 的平均使用率，
+ *    这样内存块会从稀疏的 slab 移到较满的 slab ，稀疏的 slab 最终被搬空、释放。
+ *
+ * jemalloc 编译时没有开启统计（ --enable-stats ）的话，bin 的统计总是 0 ，
+ * 这时不移动任何内存块。
+ */
+int zmalloc_defrag_hint(void *ptr) {
+    struct {
+        size_t nfree;        // ptr 所在 slab 的空闲区域数量
+        size_t nregs;        // 这个 slab 的区域总数
+        size_t size;         // 每个区域的大小
+        size_t bin_nfree;    // 同一个 bin 中所有 slab 的空闲区域数量
+        size_t bin_nregs;    // 同一个 bin 中所有 slab 的区域总数
+        void *slabcur_addr;  // bin 当前用来分配的 slab 的地址
+    } u;
+    size_t len = sizeof(u);
+    char *cur;
+
+    if (je_mallctl("experimental.utilization.query",&u,&len,&ptr,sizeof(ptr)))
+        return 0;
+
+    if (u.nregs <= 1 || u.nfree == 0) return 0;
+
+    cur = u.slabcur_addr;
+    if (cur && (char*)ptr >= cur && (char*)ptr < cur+u.nregs*u.size) return 0;
+
+    return u.nfree*u.bin_nregs > u.bin_nfree*u.nregs;
+}
+#endif
 
-void *zcalloc(size_t size) {
-    void *ptr = calloc(1, size+PREFIX_SIZE);
+char *zstrdup(const char *s) {
+    size_t l = strlen(s)+1;
+    char *p = zmalloc(l);
 
-    if (!ptr) zmalloc_oom_handler(size);
+    memcpy(p,s,l);
+    return p;
+}
 
-    *((size_t*)ptr) = size; // 居然要记录下内存块的大小
-    update_zmalloc_stat_alloc(size+PREFIX_SIZE);
-    return (char*)ptr+PREFIX_SIZE;
+/*
+ * 返回已分配内存的总量
+ *
+ * 把所有线程的计数器加起来。其他线程可能同时在分配和释放内存，
+ * 所以结果只是某个时刻附近的近似值，对内存统计和 maxmemory 检查来说已经足够。
+ */
+size_t zmalloc_used_memory(void) {
+    int threads = __atomic_load_n(&used_memory_threads,__ATOMIC_RELAXED);
+    long long um = 0;
+    int j;
+
+    if (threads > ZMALLOC_MAX_THREADS) threads = ZMALLOC_MAX_THREADS;
+    for (j = 0; j < threads; j++)
+        um += __atomic_load_n(&used_memory[j].used,__ATOMIC_RELAXED);
+
+    return um > 0 ? (size_t)um : 0;
 }
 
+/*
+ * 计数器总是线程安全的，保留这个函数只是为了兼容原来的调用
+ */
+void zmalloc_enable_thread_safeness(void) {
+}
 
+void zmalloc_set_oom_handler(void (*oom_handler)(size_t)) {
+    zmalloc_oom_handler = oom_handler;
+}
 
+/*
+ * 进程内存统计：RSS 和私有脏页
+ *
+ * 这两个值要从 /proc 中的文本文件解析，不适合在每次用到时读取，
+ * 特别是 smaps 需要内核遍历进程的所有内存映射。
+ * 所以由 serverCron 定期调用 zmalloc_sample_rss() 和 zmalloc_sample_private_dirty()
+ * 采样，结果保存在缓存中，zmalloc_get_rss() 和 zmalloc_get_private_dirty()
+ * 通常只读取缓存，任何线程都可以在每次 cron 中调用它们。
+ *
+ * 缓存还没有被采样过，或者超过 ZMALLOC_RSS_MAX_AGE / ZMALLOC_PRIVATE_DIRTY_MAX_AGE
+ * 毫秒没有被采样时（比如主线程的事件循环卡住了，只有 reactor 线程还在运行），
+ * 读取时会先重新采样一次。
+ */
+#define ZMALLOC_STAT_UNKNOWN ((size_t)-1)
+
+static size_t cached_rss = 0;
+static size_t cached_private_dirty = 0;
+// 最近一次采样的时间（单调时钟，毫秒），为 0 表示还没有采样过
+static long long cached_rss_time = 0;
+static long long cached_private_dirty_time = 0;
+
+/*
+ * 返回单调时钟的当前时间，单位为毫秒
+ */
+static long long zmalloc_mstime(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return (long long)ts.tv_sec*1000 + ts.tv_nsec/1000000 + 1;
+}
 
+#if defined(HAVE_PROC_STAT) || defined(HAVE_PROC_SMAPS)
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#endif
+
+#if defined(HAVE_PROC_STAT)
+/*
+ * 读取进程的常驻内存大小（字节）
+ *
+ * /proc/self/statm 只有一行，第二个字段是常驻内存的页数
+ */
+static size_t zmalloc_read_rss(void) {
+    static long page = 0;
+    char buf[256];
+    ssize_t nread;
+    int fd;
+    char *p;
+
+    if (page == 0) page = sysconf(_SC_PAGESIZE);
+
+    if ((fd = open("/proc/self/statm",O_RDONLY)) == -1) return 0;
+    nread = read(fd,buf,sizeof(buf)-1);
+    close(fd);
+    if (nread <= 0) return 0;
+    buf[nread] = '\0';
+
+    if ((p = strchr(buf,' ')) == NULL) return 0;
+    return (size_t)strtoull(p+1,NULL,10)*page;
+}
+#else
+static size_t zmalloc_read_rss(void) {
+    /* If we can't get the RSS in an OS-specific way for this system just
+     * return the memory usage we estimated in zmalloc()..
+     *
+     * Fragmentation will appear to be always 1 (no fragmentation)
+     * of course... */
+    return zmalloc_used_memory();
+}
+#endif
+
+#if defined(HAVE_PROC_SMAPS)
+/*
+ * 把 filename 中所有 field 行的值（ kB ）加起来，返回字节数
+ *
+ * 文件不存在时返回 ZMALLOC_STAT_UNKNOWN
+ */
+static size_t zmalloc_read_smaps_field(const char *filename, const char *field) {
+    size_t flen = strlen(field), bytes = 0;
+    char line[1024];
+    FILE *fp;
+
+    if ((fp = fopen(filename,"r")) == NULL) return ZMALLOC_STAT_UNKNOWN;
+    while (fgets(line,sizeof(line),fp) != NULL) {
+        if (strncmp(line,field,flen) == 0) {
+            char *p = strchr(line,'k');
+
+            if (p) {
+                *p = '\0';
+                bytes += strtoull(line+flen,NULL,10)*1024;
+            }
+        }
+    }
+    fclose(fp);
+    return bytes;
+}
 
+/*
+ * 读取进程私有的脏页的大小（字节），也就是 fork 之后被复制了的内存
+ *
+ * /proc/self/smaps_rollup （ Linux 4.14+ ）已经把所有映射的统计加在一起，
+ * 只有几行，没有这个文件时才遍历 /proc/self/smaps 。
+ */
+static size_t zmalloc_read_private_dirty(void) {
+    size_t bytes;
+
+    bytes = zmalloc_read_smaps_field("/proc/self/smaps_rollup","Private_Dirty:");
+    if (bytes == ZMALLOC_STAT_UNKNOWN)
+        bytes = zmalloc_read_smaps_field("/proc/self/smaps","Private_Dirty:");
+    return bytes == ZMALLOC_STAT_UNKNOWN ? 0 : bytes;
+}
+#else
+static size_t zmalloc_read_private_dirty(void) {
+    return 0;
+}
+#endif
+
+/*
+ * 重新采样 RSS ，保存到缓存中
+ */
+void zmalloc_sample_rss(void) {
+    __atomic_store_n(&cached_rss,zmalloc_read_rss(),__ATOMIC_RELAXED);
+    __atomic_store_n(&cached_rss_time,zmalloc_mstime(),__ATOMIC_RELEASE);
+}
 
+/*
+ * 重新采样私有脏页的大小，保存到缓存中
+ */
+void zmalloc_sample_private_dirty(void) {
+    __atomic_store_n(&cached_private_dirty,zmalloc_read_private_dirty(),
+        __ATOMIC_RELAXED);
+    __atomic_store_n(&cached_private_dirty_time,zmalloc_mstime(),
+        __ATOMIC_RELEASE);
+}
 
+/*
+ * 返回最近一次采样的 RSS （字节），缓存过期时先重新采样
+ */
+size_t zmalloc_get_rss(void) {
+    long long t = __atomic_load_n(&cached_rss_time,__ATOMIC_ACQUIRE);
 
+    if (t == 0 || zmalloc_mstime()-t > ZMALLOC_RSS_MAX_AGE)
+        zmalloc_sample_rss();
+    return __atomic_load_n(&cached_rss,__ATOMIC_RELAXED);
+}
 
+/*
+ * 返回最近一次采样的私有脏页的大小（字节），缓存过期时先重新采样
+ */
+size_t zmalloc_get_private_dirty(void) {
+    long long t = __atomic_load_n(&cached_private_dirty_time,__ATOMIC_ACQUIRE);
 
+    if (t == 0 || zmalloc_mstime()-t > ZMALLOC_PRIVATE_DIRTY_MAX_AGE)
+        zmalloc_sample_private_dirty();
+    return __atomic_load_n(&cached_private_dirty,__ATOMIC_RELAXED);
+}
 
+/* Fragmentation = RSS / allocated-bytes
+ *
+ * 碎片率，rss 由调用者通过 zmalloc_get_rss() 取得。
+ * 还没有分配内存时返回 1 ，表示没有碎片
+ */
+float zmalloc_get_fragmentation_ratio(size_t rss) {
+    size_t used = zmalloc_used_memory();
 
+    if (used == 0) return 1;
+    return (float)rss/used;
+}
@@ -3,14 +3,68 @@
 #ifndef _ZMALLOC_H
 #define _ZMALLOC_H
 
+// 定义 size_t ，同时让 __GLIBC__ 等宏在下面的判断之前生效
+#include <stdlib.h>
+
 /* Double expansion needed for stringification of macro values. */
 #define __xstr(s) __str(s)
 #define __str(s) #s
 
+/*
+ * 编译时用 USE_TCMALLOC 或 USE_JEMALLOC 选择内存分配器，默认使用 libc 的 malloc 。
+ *
+ * 分配器能查询内存块的实际大小时定义 HAVE_MALLOC_SIZE ，
+ * zmalloc_size 直接使用分配器的查询函数，
+ * 否则每个内存块前面要多分配 PREFIX_SIZE 个字节记录它的大小。
+ */
+#if defined(USE_TCMALLOC)
+#define ZMALLOC_LIB ("tcmalloc-" __xstr(TC_VERSION_MAJOR) "." __xstr(TC_VERSION_MINOR))
+#include <google/tcmalloc.h>
+#if (TC_VERSION_MAJOR == 1 && TC_VERSION_MINOR >= 6) || (TC_VERSION_MAJOR > 1)
+#define HAVE_MALLOC_SIZE 1
+#define zmalloc_size(p) tc_malloc_size(p)
+#else
+#error "Newer version of tcmalloc required"
+#endif
+
+#elif defined(USE_JEMALLOC)
+#define ZMALLOC_LIB ("jemalloc-" __xstr(JEMALLOC_VERSION_MAJOR) "." __xstr(JEMALLOC_VERSION_MINOR) "." __xstr(JEMALLOC_VERSION_BUGFIX))
+#include <jemalloc/jemalloc.h>
+#if (JEMALLOC_VERSION_MAJOR == 2 && JEMALLOC_VERSION_MINOR >= 1) || (JEMALLOC_VERSION_MAJOR > 2)
+#define HAVE_MALLOC_SIZE 1
+#define zmalloc_size(p) je_malloc_usable_size(p)
+#else
+#error "Newer version of jemalloc required"
+#endif
+
+#elif defined(__APPLE__)
+#include <malloc/malloc.h>
+#define HAVE_MALLOC_SIZE 1
+#define zmalloc_size(p) malloc_size(p)
+
+#elif defined(__GLIBC__)
+#include <malloc.h>
+#define HAVE_MALLOC_SIZE 1
+#define zmalloc_size(p) malloc_usable_size(p)
+#endif
+
 #ifndef ZMALLOC_LIB
 #define ZMALLOC_LIB "libc"
 #endif
 
+/* 主动碎片整理需要分配器告诉我们一个内存块所在的 slab 的使用率，
+ * 只有 jemalloc 5.2 之后的 experimental.utilization.query 提供这个信息，
+ * 其他分配器上不能开启碎片整理，见 defrag.c */
+#if defined(USE_JEMALLOC) && (JEMALLOC_VERSION_MAJOR > 5 || \
+    (JEMALLOC_VERSION_MAJOR == 5 && JEMALLOC_VERSION_MINOR >= 2))
+#define HAVE_DEFRAG
+#endif
+
+/* 缓存的 RSS 和私有脏页超过这么久（毫秒）没有被采样时，读取时重新采样，
+ * 正常情况下 serverCron 每 REDIS_*_SAMPLE_PERIOD 毫秒采样一次，缓存不会过期 */
+#define ZMALLOC_RSS_MAX_AGE 200
+#define ZMALLOC_PRIVATE_DIRTY_MAX_AGE 2000
+
 void *zmalloc(size_t size);
 void *zcalloc(size_t size);
 void *zrealloc(void *ptr, size_t size);
@@ -22,8 +76,18 @@ void zmalloc_set_oom_handler(void (*oom_handler)(size_t));
 float zmalloc_get_fragmentation_ratio(size_t rss);
 size_t zmalloc_get_rss(void);
 size_t zmalloc_get_private_dirty(void);
+void zmalloc_sample_rss(void);
+void zmalloc_sample_private_dirty(void);
 void zlibc_free(void *ptr);
 
+#ifndef HAVE_MALLOC_SIZE
 size_t zmalloc_size(void *ptr);
+#endif
+
+#ifdef HAVE_DEFRAG
+void *zmalloc_no_tcache(size_t size);
+void zfree_no_tcache(void *ptr);
+int zmalloc_defrag_hint(void *ptr);
+#endif
 
 #endif
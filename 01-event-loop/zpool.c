@@ -0,0 +1,238 @@
+/* zpool - 固定大小的小对象的内存池
+ *
+ * dictEntry 、robj 和 listNode 数量多、体积小、创建和释放都很频繁，
+ * 每次都调用 zmalloc/zfree 的开销和元数据都不小。
+ * 这里为每种对象维护一个空闲对象链表：
+ *
+ *  - 链表为空时，向 zmalloc 申请一个 ZPOOL_SLAB_SIZE 字节的 slab ，
+ *    切分成多个对象放进链表，同一种对象紧挨着存放，局部性更好；
+ *  - 分配对象就是从链表头部弹出一个对象，释放就是把对象压回链表头部。
+ *
+ * 空闲链表是每个线程一个的，分配和释放都不需要加锁。
+ * 一个线程释放另一个线程分配的对象时，对象先进入释放者的链表。
+ * 线程链表中的空闲对象超过 ZPOOL_CACHE_MAX 个时，
+ * 整批 ZPOOL_BATCH 个对象被交还给所有线程共享的仓库（depot），
+ * 链表为空的线程先从仓库取回一批对象，仓库也为空时才申请新的 slab 。
+ * 这样一个线程分配、另一个线程释放的对象（比如 I/O 线程和主线程之间传递的客户端数据）
+ * 会经过仓库回到分配者手里，不会在释放者的链表中无限堆积。
+ *
+ * 线程退出时，它链表中的空闲对象全部交还给仓库，线程槽可以被新线程使用。
+ *
+ * slab 不会归还给 zmalloc ，对象被释放之后留在链表或仓库中等待重用，
+ * 每种对象正在使用和已经分配的内存可以通过 zpoolGetStats 查看。
+ */
+
+#include <assert.h>
+#include <pthread.h>
+#include "zpool.h"
+#include "zmalloc.h"
+
+/* 一个线程中某种对象的空闲链表 */
+typedef struct zpoolCache {
+    void *freelist;     // 空闲对象链表，对象的前几个字节保存下一个空闲对象的地址
+    long free;          // 空闲链表中的对象数量
+    long long used;     // 本线程分配的数量减去本线程释放的数量，可以为负数
+} zpoolCache;
+
+/* 一个线程的所有空闲链表，按缓存行对齐，避免线程之间互相干扰 */
+typedef struct zpoolThread {
+    zpoolCache caches[ZPOOL_TYPES];
+    int inuse;          // 线程槽是否被某个线程占用
+} __attribute__((aligned(64))) zpoolThread;
+
+static zpoolThread zpool_threads[ZPOOL_MAX_THREADS];
+// 被占用过的线程槽的最大索引加一，统计时只需检查这些槽
+static int zpool_threads_count = 0;
+// 当前线程使用的线程槽
+static __thread zpoolThread *zpool_thread = NULL;
+// 线程退出时交还空闲对象、释放线程槽
+static pthread_key_t zpool_thread_key;
+static pthread_once_t zpool_thread_once = PTHREAD_ONCE_INIT;
+
+/* 共享仓库，每种对象一条由整批空闲对象组成的链表，
+ * 每批对象由第一个指针串成链表，第一个对象的第二个指针指向下一批 */
+static pthread_mutex_t zpool_depot_lock = PTHREAD_MUTEX_INITIALIZER;
+static void *zpool_depot[ZPOOL_TYPES];
+
+static const char *zpool_names[ZPOOL_TYPES] = {
+    "dictEntry", "robj", "listNode"
+};
+// 每种对象的大小，第一次分配时记录
+static size_t zpool_sizes[ZPOOL_TYPES];
+// 每种对象已经申请的 slab 数量
+static size_t zpool_slabs[ZPOOL_TYPES];
+
+/*
+ * 从空闲链表 c 的头部取下 count 个对象，作为一批放进 type 类型的仓库
+ */
+static void zpoolFlush(int type, zpoolCache *c, long count) {
+    void **head = c->freelist, **tail = head;
+    long j;
+
+    for (j = 1; j < count; j++) tail = *tail;
+    c->freelist = *tail;
+    c->free -= count;
+    *tail = NULL;
+
+    pthread_mutex_lock(&zpool_depot_lock);
+    head[1] = zpool_depot[type];
+    zpool_depot[type] = head;
+    pthread_mutex_unlock(&zpool_depot_lock);
+}
+
+/*
+ * 从 type 类型的仓库取回一批对象放进空闲链表 c ，仓库为空时返回 0
+ */
+static int zpoolFetch(int type, zpoolCache *c) {
+    void **head, **obj;
+
+    pthread_mutex_lock(&zpool_depot_lock);
+    head = zpool_depot[type];
+    if (head) zpool_depot[type] = head[1];
+    pthread_mutex_unlock(&zpool_depot_lock);
+    if (head == NULL) return 0;
+
+    c->freelist = head;
+    for (obj = head; obj; obj = *obj) c->free++;
+    return 1;
+}
+
+/*
+ * 线程退出时调用，把线程的空闲对象全部交还给仓库，并释放线程槽
+ *
+ * used 计数器留在线程槽中，继续计入统计
+ */
+static void zpoolThreadExit(void *arg) {
+    zpoolThread *t = arg;
+    int type;
+
+    for (type = 0; type < ZPOOL_TYPES; type++) {
+        zpoolCache *c = &t->caches[type];
+
+        while (c->free > 0)
+            zpoolFlush(type,c,c->free < ZPOOL_BATCH ? c->free : ZPOOL_BATCH);
+    }
+    // 之后的其他析构函数如果还在使用内存池，会重新占用一个线程槽
+    zpool_thread = NULL;
+    __atomic_store_n(&t->inuse,0,__ATOMIC_RELEASE);
+}
+
+static void zpoolThreadKeyInit(void) {
+    pthread_key_create(&zpool_thread_key,zpoolThreadExit);
+}
+
+/*
+ * 返回当前线程的线程槽，第一次调用时占用一个空闲的槽
+ */
+static zpoolThread *zpoolGetThread(void) {
+    int j;
+
+    if (zpool_thread) return zpool_thread;
+
+    pthread_once(&zpool_thread_once,zpoolThreadKeyInit);
+    for (j = 0; j < ZPOOL_MAX_THREADS; j++) {
+        int expected = 0, count;
+
+        if (__atomic_load_n(&zpool_threads[j].inuse,__ATOMIC_RELAXED)) continue;
+        if (!__atomic_compare_exchange_n(&zpool_threads[j].inuse,&expected,1,0,
+                __ATOMIC_ACQ_REL,__ATOMIC_RELAXED)) continue;
+
+        count = __atomic_load_n(&zpool_threads_count,__ATOMIC_RELAXED);
+        while (count <= j &&
+               !__atomic_compare_exchange_n(&zpool_threads_count,&count,j+1,0,
+                    __ATOMIC_RELAXED,__ATOMIC_RELAXED));
+
+        zpool_thread = &zpool_threads[j];
+        pthread_setspecific(zpool_thread_key,zpool_thread);
+        return zpool_thread;
+    }
+    assert(!"too many threads using zpool");
+    return NULL;
+}
+
+/*
+ * 申请一个新的 slab ，切分成大小为 size 的对象放进空闲链表 c
+ */
+static void zpoolRefill(int type, zpoolCache *c, size_t size) {
+    char *slab = zmalloc(ZPOOL_SLAB_SIZE);
+    size_t j, count = ZPOOL_SLAB_SIZE/size;
+
+    // 从后往前压入，让链表中的对象按地址顺序排列
+    for (j = count; j > 0; j--) {
+        void **obj = (void**)(slab + (j-1)*size);
+
+        *obj = c->freelist;
+        c->freelist = obj;
+    }
+    c->free += count;
+    __atomic_store_n(&zpool_sizes[type],size,__ATOMIC_RELAXED);
+    __atomic_add_fetch(&zpool_slabs[type],1,__ATOMIC_RELAXED);
+}
+
+/*
+ * 从 type 类型的内存池中分配一个大小为 size 的对象
+ *
+ * 同一种对象的 size 必须总是相同的
+ */
+void *zpoolAlloc(int type, size_t size) {
+    zpoolCache *c = &zpoolGetThread()->caches[type];
+    void **obj;
+
+    // 对象中要能放下两个指针（仓库用第二个指针串起每批对象），并且按指针大小对齐
+    if (size < 2*sizeof(void*)) size = 2*sizeof(void*);
+    size = (size+sizeof(void*)-1) & ~(sizeof(void*)-1);
+
+    if (c->freelist == NULL && !zpoolFetch(type,c)) zpoolRefill(type,c,size);
+    obj = c->freelist;
+    c->freelist = *obj;
+    c->free--;
+    __atomic_store_n(&c->used,__atomic_load_n(&c->used,__ATOMIC_RELAXED)+1,
+                     __ATOMIC_RELAXED);
+    return obj;
+}
+
+/*
+ * 将 zpoolAlloc 分配的对象 ptr 放回 type 类型的内存池
+ */
+void zpoolFree(int type, void *ptr) {
+    zpoolCache *c;
+
+    if (ptr == NULL) return;
+    c = &zpoolGetThread()->caches[type];
+    *(void**)ptr = c->freelist;
+    c->freelist = ptr;
+    c->free++;
+    __atomic_store_n(&c->used,__atomic_load_n(&c->used,__ATOMIC_RELAXED)-1,
+                     __ATOMIC_RELAXED);
+
+    // 空闲对象太多，交还一批给仓库，让其他线程可以重用
+    if (c->free > ZPOOL_CACHE_MAX) zpoolFlush(type,c,ZPOOL_BATCH);
+}
+
+/*
+ * 返回对象类型的名字
+ */
+const char *zpoolName(int type) {
+    return zpool_names[type];
+}
+
+/*
+ * 将 type 类型的对象正在使用的内存保存到 *used ，
+ * 已经向 zmalloc 申请的内存保存到 *allocated
+ *
+ * 其他线程可能同时在分配和释放，结果是近似值
+ */
+void zpoolGetStats(int type, size_t *used, size_t *allocated) {
+    int threads = __atomic_load_n(&zpool_threads_count,__ATOMIC_RELAXED);
+    long long count = 0;
+    int j;
+
+    for (j = 0; j < threads; j++)
+        count += __atomic_load_n(&zpool_threads[j].caches[type].used,
+                                 __ATOMIC_RELAXED);
+    if (count < 0) count = 0;
+
+    *used = (size_t)count * __atomic_load_n(&zpool_sizes[type],__ATOMIC_RELAXED);
+    *allocated = __atomic_load_n(&zpool_slabs[type],__ATOMIC_RELAXED) *
+                 ZPOOL_SLAB_SIZE;
+}
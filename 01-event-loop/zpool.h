@@ -0,0 +1,31 @@
+/* zpool - 固定大小的小对象的内存池 */
+
+#ifndef _ZPOOL_H
+#define _ZPOOL_H
+
+#include <stdlib.h>
+
+/* 使用内存池的对象类型 */
+#define ZPOOL_DICT_ENTRY 0      // 链地址法字典中不嵌入键的 dictEntry
+#define ZPOOL_ROBJ 1            // 不是 EMBSTR 编码的 robj
+#define ZPOOL_LIST_NODE 2       // adlist 的 listNode
+#define ZPOOL_TYPES 3
+
+/* 每次向 zmalloc 申请的 slab 大小 */
+#define ZPOOL_SLAB_SIZE 4096
+
+/* 每次在线程的空闲链表和共享仓库之间移动的对象数量 */
+#define ZPOOL_BATCH 64
+
+/* 线程空闲链表中的对象超过这个数量时，把一批对象交还给共享仓库 */
+#define ZPOOL_CACHE_MAX 256
+
+/* 可以同时使用内存池的线程数量上限，线程退出后它的槽可以被新线程使用 */
+#define ZPOOL_MAX_THREADS 256
+
+void *zpoolAlloc(int type, size_t size);
+void zpoolFree(int type, void *ptr);
+const char *zpoolName(int type);
+void zpoolGetStats(int type, size_t *used, size_t *allocated);
+
+#endif